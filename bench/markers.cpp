@@ -0,0 +1,69 @@
+// Draws a scatter plot of 100k circles, once with arc and fill per point and
+// once with drawMarkers, which composites cached coverage stamps. The
+// stamps are placed at quarter pixel phases, so the plots differ slightly.
+
+#include <ContextCairo.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+using namespace canvas;
+
+static const size_t NUM_POINTS = 100000;
+static const unsigned int WIDTH = 1000, HEIGHT = 1000;
+static const double RADIUS = 3;
+
+static double
+run(const vector<Point> & points, const vector<Color> & colors, bool use_markers, bool use_colors, shared_ptr<Image> & image) {
+  ContextCairo context(WIDTH, HEIGHT, RGBA8);
+  auto start = chrono::steady_clock::now();
+  if (use_markers) {
+    Path2D shape;
+    shape.arc(Point(0, 0), RADIUS, 0, 2 * M_PI, false);
+    Style style(&context);
+    style = Color(0.8f, 0.2f, 0.1f, 1.0f);
+    context.drawMarkers(shape, style, points.data(), points.size(), use_colors ? colors.data() : 0);
+  } else {
+    context.fillStyle = Color(0.8f, 0.2f, 0.1f, 1.0f);
+    for (size_t i = 0; i < points.size(); i++) {
+      if (use_colors) context.fillStyle = colors[i];
+      context.beginPath();
+      context.arc(points[i].x, points[i].y, RADIUS, 0, 2 * M_PI);
+      context.fill();
+    }
+  }
+  context.getDefaultSurface().flush();
+  double t = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  image = context.getDefaultSurface().createImage();
+  return t;
+}
+
+int
+main() {
+  vector<Point> points;
+  vector<Color> colors;
+  srand(1);
+  for (size_t i = 0; i < NUM_POINTS; i++) {
+    points.push_back(Point(rand() % (WIDTH * 100) / 100.0, rand() % (HEIGHT * 100) / 100.0));
+    colors.push_back(Color(rand() % 256 / 255.0f, rand() % 256 / 255.0f, rand() % 256 / 255.0f, 0.7f));
+  }
+  for (int use_colors = 0; use_colors < 2; use_colors++) {
+    shared_ptr<Image> reference, image;
+    double fill_time = run(points, colors, false, use_colors, reference);
+    double marker_time = run(points, colors, true, use_colors, image);
+    size_t size = reference->getWidth() * reference->getHeight() * 4;
+    double total_diff = 0;
+    int max_diff = 0;
+    for (size_t i = 0; i < size; i++) {
+      int d = abs(int(image->getData()[i]) - int(reference->getData()[i]));
+      total_diff += d;
+      if (d > max_diff) max_diff = d;
+    }
+    printf("%s: arc and fill %.1f ms, drawMarkers %.1f ms, speedup %.1fx, mean difference %.3f, max difference %d\n", use_colors ? "per-instance colors" : "single color", fill_time * 1000, marker_time * 1000, fill_time / marker_time, total_diff / size, max_diff);
+  }
+  return 0;
+}
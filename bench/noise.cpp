@@ -0,0 +1,78 @@
+// Compares the cost of classic Perlin, periodic Perlin and 2D and 3D
+// simplex noise per sample and for a whole surface, and checks that the
+// periodic noise wraps.
+
+#include <PerlinSurface.h>
+#include <ThreadPool.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+using namespace std;
+using namespace canvas;
+
+static const unsigned int SIZE = 1024;
+static const unsigned int PERIOD = 8;
+
+// PerlinSurface with the drawing functions left empty and the evaluator exposed
+class NoiseSurface : public PerlinSurface {
+public:
+  NoiseSurface(int octaves) : PerlinSurface(SIZE, SIZE, SIZE, SIZE, octaves) { }
+
+  void renderPath(RenderMode mode, const Path2D & path, const Style & style, float lineWidth, Operator op, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath) override { }
+  void renderText(RenderMode mode, const Font & font, const Style & style, TextBaseline textBaseline, TextAlign textAlign, const std::string & text, const Point & p, float lineWidth, Operator op, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath) override { }
+  TextMetrics measureText(const Font & font, const std::string & text, TextBaseline textBaseline, float displayScale) override { return TextMetrics(); }
+  void drawImage(Surface & _img, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled, ImageSmoothingQuality imageSmoothingQuality) override { }
+  void drawImage(const Image & _img, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled, ImageSmoothingQuality imageSmoothingQuality) override { }
+
+  using PerlinSurface::evaluate;
+};
+
+int
+main() {
+  ThreadPool::setSerial();
+  const struct {
+    const char * name;
+    NoiseType type;
+    bool periodic;
+  } generators[] = {
+    { "perlin", NOISE_PERLIN, false },
+    { "periodic perlin", NOISE_PERLIN, true },
+    { "simplex 2D", NOISE_SIMPLEX_2D, false },
+    { "simplex 3D", NOISE_SIMPLEX_3D, false }
+  };
+  const float dx = 1.0f / 32;
+  for (auto & g : generators) {
+    NoiseSurface surface(4);
+    surface.setNoiseType(g.type);
+    if (g.periodic) surface.setPeriod(PERIOD, PERIOD);
+
+    volatile float sink = 0;
+    auto start = chrono::steady_clock::now();
+    for (unsigned int y = 0; y < SIZE; y++) {
+      for (unsigned int x = 0; x < SIZE; x++) sink = sink + surface.evaluate(x * dx, y * dx, 0.5f);
+    }
+    double sample_time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    start = chrono::steady_clock::now();
+    surface.lockMemory();
+    surface.releaseMemory();
+    double surface_time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    double samples = double(SIZE) * SIZE;
+    printf("%s: %.1f Msamples/s per sample, %ux%u surface in %.1f ms", g.name, samples / sample_time / 1e6, SIZE, SIZE, surface_time * 1000);
+    if (g.periodic) {
+      // the noise must repeat after the period in both directions
+      float max_seam = 0;
+      for (int i = 0; i < 1000; i++) {
+	float x = i * 0.037f, y = i * 0.011f, v = surface.evaluate(x, y, 0.5f);
+	max_seam = max(max_seam, fabsf(v - surface.evaluate(x + PERIOD, y, 0.5f)));
+	max_seam = max(max_seam, fabsf(v - surface.evaluate(x, y + PERIOD, 0.5f)));
+      }
+      printf(", max difference across the period %g", max_seam);
+    }
+    printf("\n");
+  }
+  return 0;
+}
@@ -0,0 +1,65 @@
+// Reports the throughput of Perlin noise evaluated one sample at a time and
+// with the vectorized row evaluation, and of the tiled generation of a
+// whole surface.
+
+#include <PerlinSurface.h>
+#include <ThreadPool.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using namespace std;
+using namespace canvas;
+
+static const unsigned int SIZE = 1024;
+
+// PerlinSurface with the drawing functions left empty and the evaluators exposed
+class NoiseSurface : public PerlinSurface {
+public:
+  NoiseSurface(int octaves) : PerlinSurface(SIZE, SIZE, SIZE, SIZE, octaves) { }
+
+  void renderPath(RenderMode mode, const Path2D & path, const Style & style, float lineWidth, Operator op, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath) override { }
+  void renderText(RenderMode mode, const Font & font, const Style & style, TextBaseline textBaseline, TextAlign textAlign, const std::string & text, const Point & p, float lineWidth, Operator op, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath) override { }
+  TextMetrics measureText(const Font & font, const std::string & text, TextBaseline textBaseline, float displayScale) override { return TextMetrics(); }
+  void drawImage(Surface & _img, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled, ImageSmoothingQuality imageSmoothingQuality) override { }
+  void drawImage(const Image & _img, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled, ImageSmoothingQuality imageSmoothingQuality) override { }
+
+  using PerlinSurface::evaluate;
+  using PerlinSurface::evaluateRow;
+};
+
+int
+main() {
+  ThreadPool::setSerial();
+  const float dx = 1.0f / 32;
+  for (int octaves = 1; octaves <= 4; octaves += 3) {
+    NoiseSurface surface(octaves);
+    vector<float> scalar(SIZE), vector_output(SIZE);
+    float max_error = 0;
+
+    auto start = chrono::steady_clock::now();
+    for (unsigned int y = 0; y < SIZE; y++) {
+      for (unsigned int x = 0; x < SIZE; x++) scalar[x] = surface.evaluate(x * dx, y * dx, 0.5f);
+    }
+    auto middle = chrono::steady_clock::now();
+    for (unsigned int y = 0; y < SIZE; y++) {
+      surface.evaluateRow(0, y * dx, 0.5f, dx, SIZE, vector_output.data());
+    }
+    auto end = chrono::steady_clock::now();
+    // the last rows of both are compared
+    for (unsigned int x = 0; x < SIZE; x++) max_error = max(max_error, fabsf(scalar[x] - vector_output[x]));
+
+    double scalar_time = chrono::duration<double>(middle - start).count(), vector_time = chrono::duration<double>(end - middle).count();
+    double samples = double(SIZE) * SIZE;
+    printf("%d octaves: scalar %.1f Msamples/s, vector %.1f Msamples/s, speedup %.1fx, max error %g\n", octaves, samples / scalar_time / 1e6, samples / vector_time / 1e6, scalar_time / vector_time, max_error);
+
+    start = chrono::steady_clock::now();
+    surface.lockMemory();
+    surface.releaseMemory();
+    double t = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    printf("%d octaves: %ux%u surface in %.1f ms, %.1f Msamples/s\n", octaves, SIZE, SIZE, t * 1000, samples / t / 1e6);
+  }
+  return 0;
+}
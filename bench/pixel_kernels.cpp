@@ -0,0 +1,132 @@
+// Compares the integer pixel kernels against straightforward float loops
+// like the ones they replaced. Reports the throughput of both and the
+// largest difference from the rounded float result.
+
+#include <PixelKernels.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+using namespace std;
+using namespace canvas;
+
+static const size_t NUM_PIXELS = 1 << 20;
+static const int NUM_ITERATIONS = 20;
+
+// Rounds a non-negative value
+static inline unsigned char
+to_byte(float v) {
+  return (unsigned char)std::min(255.0f, v + 0.5f);
+}
+
+static void
+colorizeFloat(const unsigned char * mask, unsigned char * dst, size_t n, const unsigned char color[4]) {
+  for (size_t i = 0; i < n; i++) {
+    float m = mask[i] / 255.0f;
+    for (int c = 0; c < 4; c++) dst[4 * i + c] = to_byte(color[c] * m);
+  }
+}
+
+static void
+blendMaskFloat(const unsigned char * mask, unsigned char * dst, size_t n, const unsigned char color[4]) {
+  for (size_t i = 0; i < n; i++) {
+    float m = mask[i] / 255.0f, inv = 1.0f - color[3] * m / 255.0f;
+    for (int c = 0; c < 4; c++) dst[4 * i + c] = to_byte(color[c] * m + dst[4 * i + c] * inv);
+  }
+}
+
+static void
+multiplyFloat(unsigned char * dst, size_t n, const unsigned char color[4]) {
+  for (size_t i = 0; i < n; i++) {
+    for (int c = 0; c < 4; c++) dst[4 * i + c] = to_byte(dst[4 * i + c] * (color[c] / 255.0f));
+  }
+}
+
+static void
+sourceOverFloat(const unsigned char * src, unsigned char * dst, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    float inv = 1.0f - src[4 * i + 3] / 255.0f;
+    for (int c = 0; c < 4; c++) dst[4 * i + c] = to_byte(src[4 * i + c] + dst[4 * i + c] * inv);
+  }
+}
+
+// Runs func on a fresh copy of the initial pixels and returns the time per iteration
+static double
+measure(const vector<unsigned char> & initial, vector<unsigned char> & output, const function<void(unsigned char * dst)> & func) {
+  double total = 0;
+  for (int i = 0; i < NUM_ITERATIONS; i++) {
+    output = initial;
+    auto start = chrono::steady_clock::now();
+    func(output.data());
+    total += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  }
+  return total / NUM_ITERATIONS;
+}
+
+static void
+report(const char * name, double kernel_time, double float_time, const vector<unsigned char> & a, const vector<unsigned char> & b) {
+  int max_diff = 0;
+  for (size_t i = 0; i < a.size(); i++) {
+    max_diff = std::max(max_diff, abs(int(a[i]) - int(b[i])));
+  }
+  printf("%s: kernel %.0f Mpixels/s, float %.0f Mpixels/s, speedup %.1fx, max difference %d\n", name, NUM_PIXELS / kernel_time / 1e6, NUM_PIXELS / float_time / 1e6, float_time / kernel_time, max_diff);
+}
+
+int
+main() {
+  // random premultiplied pixels
+  vector<unsigned char> mask(NUM_PIXELS), src(4 * NUM_PIXELS), dst(4 * NUM_PIXELS);
+  srand(1);
+  for (size_t i = 0; i < NUM_PIXELS; i++) {
+    mask[i] = rand() % 4 ? rand() % 256 : 0;
+    unsigned char sa = rand() % 256, da = rand() % 256;
+    for (int c = 0; c < 3; c++) {
+      src[4 * i + c] = rand() % (sa + 1);
+      dst[4 * i + c] = rand() % (da + 1);
+    }
+    src[4 * i + 3] = sa;
+    dst[4 * i + 3] = da;
+  }
+  const unsigned char color[4] = { 40, 120, 200, 220 };
+  vector<unsigned char> a, b;
+
+  double kt = measure(dst, a, [&](unsigned char * d) { PixelKernels::colorize(mask.data(), d, NUM_PIXELS, color); });
+  double ft = measure(dst, b, [&](unsigned char * d) { colorizeFloat(mask.data(), d, NUM_PIXELS, color); });
+  report("colorize", kt, ft, a, b);
+
+  kt = measure(dst, a, [&](unsigned char * d) { PixelKernels::blendMask(mask.data(), d, NUM_PIXELS, color); });
+  ft = measure(dst, b, [&](unsigned char * d) { blendMaskFloat(mask.data(), d, NUM_PIXELS, color); });
+  report("blendMask", kt, ft, a, b);
+
+  kt = measure(dst, a, [&](unsigned char * d) { PixelKernels::multiply(d, NUM_PIXELS, color); });
+  ft = measure(dst, b, [&](unsigned char * d) { multiplyFloat(d, NUM_PIXELS, color); });
+  report("multiply", kt, ft, a, b);
+
+  kt = measure(dst, a, [&](unsigned char * d) { PixelKernels::composite(SOURCE_OVER, src.data(), d, NUM_PIXELS); });
+  ft = measure(dst, b, [&](unsigned char * d) { sourceOverFloat(src.data(), d, NUM_PIXELS); });
+  report("source-over", kt, ft, a, b);
+
+  // the other operators have no float version to compare against
+  const struct {
+    const char * name;
+    Operator op;
+  } operators[] = {
+    { "source-atop", SOURCE_ATOP },
+    { "destination-out", DESTINATION_OUT },
+    { "xor", XOR },
+    { "multiply", MULTIPLY },
+    { "screen", SCREEN },
+    { "overlay", OVERLAY },
+    { "soft-light", SOFT_LIGHT },
+    { "difference", DIFFERENCE }
+  };
+  for (auto & o : operators) {
+    kt = measure(dst, a, [&](unsigned char * d) { PixelKernels::composite(o.op, src.data(), d, NUM_PIXELS); });
+    printf("composite %s: %.0f Mpixels/s\n", o.name, NUM_PIXELS / kt / 1e6);
+  }
+  return 0;
+}
@@ -0,0 +1,75 @@
+// Strokes a time series of 1M points into a 1000 pixel wide chart, built
+// with lineTo per point, with polyline, and with the decimating polylines.
+// The decimated charts are compared against the full one.
+
+#include <ContextCairo.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+using namespace canvas;
+
+static const size_t NUM_POINTS = 1000000;
+static const unsigned int WIDTH = 1000, HEIGHT = 300;
+
+enum Method { LINE_TO, POLYLINE, POLYLINE_MINMAX, POLYLINE_LTTB };
+
+static double
+run(const vector<float> & xy, Method method, shared_ptr<Image> & image, size_t & num_components) {
+  ContextCairo context(WIDTH, HEIGHT, RGBA8);
+  context.fillStyle = Color(1.0f, 1.0f, 1.0f, 1.0f);
+  context.fillRect(0, 0, WIDTH, HEIGHT);
+  context.strokeStyle = Color(0.0f, 0.0f, 0.5f, 1.0f);
+  auto start = chrono::steady_clock::now();
+  context.beginPath();
+  switch (method) {
+  case LINE_TO:
+    context.moveTo(xy[0], xy[1]);
+    for (size_t i = 1; i < NUM_POINTS; i++) context.lineTo(xy[2 * i], xy[2 * i + 1]);
+    break;
+  case POLYLINE: context.polyline(xy.data(), NUM_POINTS); break;
+  case POLYLINE_MINMAX: context.polyline(xy.data(), NUM_POINTS, DECIMATE_MINMAX); break;
+  case POLYLINE_LTTB: context.polyline(xy.data(), NUM_POINTS, DECIMATE_LTTB); break;
+  }
+  num_components = context.currentPath.getData().size();
+  context.stroke();
+  context.getDefaultSurface().flush();
+  double t = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  image = context.getDefaultSurface().createImage();
+  return t;
+}
+
+int
+main() {
+  // a random walk with a sine wave, scaled to the chart
+  vector<float> xy(2 * NUM_POINTS);
+  float v = 0;
+  srand(1);
+  for (size_t i = 0; i < NUM_POINTS; i++) {
+    v += (rand() % 2001 - 1000) / 1000.0f;
+    xy[2 * i] = i * float(WIDTH) / NUM_POINTS;
+    xy[2 * i + 1] = HEIGHT / 2 + 60 * sinf(i * 0.00002f) + v * 0.05f;
+  }
+
+  const char * names[] = { "lineTo", "polyline", "polyline minmax", "polyline lttb" };
+  shared_ptr<Image> reference;
+  for (int method = LINE_TO; method <= POLYLINE_LTTB; method++) {
+    shared_ptr<Image> image;
+    size_t num_components;
+    double t = run(xy, Method(method), image, num_components);
+    if (!reference) reference = image;
+    size_t size = reference->getWidth() * reference->getHeight() * 4, differing = 0;
+    int max_diff = 0;
+    for (size_t i = 0; i < size; i++) {
+      int d = abs(int(image->getData()[i]) - int(reference->getData()[i]));
+      if (d) differing++;
+      if (d > max_diff) max_diff = d;
+    }
+    printf("%s: %.1f ms, %zu path components, %.2f%% of bytes differ from lineTo, max difference %d\n", names[method], t * 1000, num_components, 100.0 * differing / size, max_diff);
+  }
+  return 0;
+}
@@ -0,0 +1,61 @@
+// Blurs a shadow mask with the exact and the pyramid blur across radii.
+// The cost of the exact blur grows with the radius, while the pyramid blur
+// stays roughly constant. The error is measured away from the edges, which
+// the exact blur clears.
+
+#include <PixelKernels.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+using namespace canvas;
+
+static const unsigned int SIZE = 1024;
+
+static double
+run(const vector<unsigned char> & mask, vector<unsigned char> & output, float radius, bool pyramid) {
+  output = mask;
+  auto start = chrono::steady_clock::now();
+  if (pyramid) {
+    PixelKernels::pyramidBlur(output.data(), SIZE, SIZE, SIZE, 1, radius, radius);
+  } else {
+    PixelKernels::gaussianBlur(output.data(), SIZE, SIZE, SIZE, 1, radius, radius);
+  }
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int
+main() {
+  // a rectangle and a circle in the middle, like the coverage mask of a shadow
+  vector<unsigned char> mask(SIZE * SIZE);
+  for (unsigned int y = 0; y < SIZE; y++) {
+    for (unsigned int x = 0; x < SIZE; x++) {
+      int dx = int(x) - 600, dy = int(y) - 600;
+      bool inside = (x >= 384 && x < 560 && y >= 384 && y < 640) || dx * dx + dy * dy < 60 * 60;
+      mask[y * SIZE + x] = inside ? 255 : 0;
+    }
+  }
+  const float radii[] = { 4, 8, 16, 32, 64, 128 };
+  for (float radius : radii) {
+    vector<unsigned char> exact, approximate;
+    double exact_time = run(mask, exact, radius, false);
+    double pyramid_time = run(mask, approximate, radius, true);
+    unsigned int margin = (unsigned int)radius + 1;
+    int max_diff = 0;
+    double total_diff = 0;
+    size_t n = 0;
+    for (unsigned int y = margin; y < SIZE - margin; y++) {
+      for (unsigned int x = margin; x < SIZE - margin; x++, n++) {
+	int d = abs(int(exact[y * SIZE + x]) - int(approximate[y * SIZE + x]));
+	max_diff = std::max(max_diff, d);
+	total_diff += d;
+      }
+    }
+    printf("radius %3.0f: exact %6.1f ms, pyramid %5.1f ms, mean error %.3f, max error %d\n", radius, exact_time * 1000, pyramid_time * 1000, total_diff / n, max_diff);
+  }
+  return 0;
+}
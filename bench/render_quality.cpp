@@ -0,0 +1,105 @@
+// Renders a thumbnail-like scene of shapes, text, downscaled images and
+// shadows with each render quality tier, and reports the time and the
+// difference from RENDER_BEST.
+
+#include <ContextCairo.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+using namespace canvas;
+
+static const unsigned int WIDTH = 400, HEIGHT = 300;
+static const int NUM_FRAMES = 20;
+
+static void
+drawScene(Context & context, const Image & photo) {
+  context.clearRect(0, 0, WIDTH, HEIGHT);
+  context.shadowColor = Color(0.0f, 0.0f, 0.0f, 0.5f);
+  context.shadowBlur = 12;
+  context.shadowOffsetY = 4;
+  context.fillStyle = Color(0.95f, 0.95f, 0.9f, 1.0f);
+  context.beginPath();
+  context.arc(200, 150, 120, 0, 2 * M_PI);
+  context.fill();
+  context.shadowBlur = 0;
+  context.shadowOffsetY = 0;
+
+  context.drawImage(photo, 20, 20, 160, 120);
+  for (int i = 0; i < 40; i++) {
+    context.strokeStyle = Color(i / 40.0f, 0.3f, 1.0f - i / 40.0f, 1.0f);
+    context.lineWidth = 1 + i % 3;
+    context.beginPath();
+    context.arc(280 + 3 * cos(i * 0.7), 200 + 3 * sin(i * 0.7), 10 + i * 1.5, i * 0.1, i * 0.1 + 4);
+    context.stroke();
+  }
+  context.fillStyle = Color(0.1f, 0.1f, 0.1f, 1.0f);
+  context.font.size = 14;
+  for (int i = 0; i < 8; i++) {
+    context.fillText("Thumbnail preview text", 20, 170 + i * 16);
+  }
+}
+
+static double
+run(RenderQuality quality, const Image & photo, shared_ptr<Image> & image) {
+  ContextCairo context(WIDTH, HEIGHT, RGBA8);
+  context.setRenderQuality(quality);
+  auto start = chrono::steady_clock::now();
+  for (int i = 0; i < NUM_FRAMES; i++) {
+    drawScene(context, photo);
+  }
+  context.getDefaultSurface().flush();
+  double t = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  image = context.getDefaultSurface().createImage();
+  return t / NUM_FRAMES;
+}
+
+int
+main() {
+  // a detailed photo that is drawn at an eighth of its size
+  vector<unsigned char> pixels(1280 * 960 * 4);
+  srand(1);
+  for (unsigned int i = 0; i < 1280 * 960; i++) {
+    unsigned int x = i % 1280, y = i / 1280;
+    pixels[4 * i + 0] = (unsigned char)((x ^ y) & 255);
+    pixels[4 * i + 1] = (unsigned char)(128 + 127 * sin(x * 0.05) * cos(y * 0.05));
+    pixels[4 * i + 2] = (unsigned char)(rand() % 256);
+    pixels[4 * i + 3] = 255;
+  }
+  Image photo(pixels.data(), RGBA8, 1280, 960);
+
+  const struct {
+    const char * name;
+    RenderQuality quality;
+  } tiers[] = {
+    { "best", RENDER_BEST },
+    { "balanced", RENDER_BALANCED },
+    { "fast", RENDER_FAST }
+  };
+  shared_ptr<Image> reference;
+  double best_time = 0;
+  for (auto & tier : tiers) {
+    shared_ptr<Image> image;
+    double t = run(tier.quality, photo, image);
+    if (!reference) {
+      reference = image;
+      best_time = t;
+    }
+    size_t size = reference->getWidth() * reference->getHeight() * 4;
+    double total_diff = 0, squared_diff = 0;
+    int max_diff = 0;
+    for (size_t i = 0; i < size; i++) {
+      int d = abs(int(image->getData()[i]) - int(reference->getData()[i]));
+      total_diff += d;
+      squared_diff += d * d;
+      if (d > max_diff) max_diff = d;
+    }
+    double psnr = squared_diff ? 10 * log10(255.0 * 255.0 * size / squared_diff) : INFINITY;
+    printf("%s: %.2f ms per frame, speedup %.2fx, mean difference %.3f, max difference %d, PSNR %.1f dB\n", tier.name, t * 1000, best_time / t, total_diff / size, max_diff, psnr);
+  }
+  return 0;
+}
@@ -0,0 +1,148 @@
+// Compares the fixed point Resampler against a float separable resampler
+// with the same kernels, which serves as the reference for the error. It is
+// not the stbir code that the Resampler replaced. Both run on a single
+// thread. Reports the time of both and the difference.
+
+#include <Resampler.h>
+#include <ThreadPool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace std;
+using namespace canvas;
+
+static float
+evaluateFilter(ResampleFilter filter, float x) {
+  if (filter == RESAMPLE_BOX) return x > -0.5f && x <= 0.5f ? 1.0f : 0.0f;
+  x = fabsf(x);
+  switch (filter) {
+  case RESAMPLE_BOX: break;
+  case RESAMPLE_BILINEAR: return x < 1.0f ? 1.0f - x : 0.0f;
+  case RESAMPLE_BICUBIC:
+    if (x < 1.0f) return (1.5f * x - 2.5f) * x * x + 1.0f;
+    if (x < 2.0f) return ((-0.5f * x + 2.5f) * x - 4.0f) * x + 2.0f;
+    return 0.0f;
+  case RESAMPLE_LANCZOS:
+    if (x == 0.0f) return 1.0f;
+    if (x >= 3.0f) return 0.0f;
+    return 3.0f * sinf(float(M_PI) * x) * sinf(float(M_PI) * x / 3.0f) / (float(M_PI) * float(M_PI) * x * x);
+  }
+  return 0.0f;
+}
+
+static float
+getSupport(ResampleFilter filter) {
+  switch (filter) {
+  case RESAMPLE_BOX: return 0.5f;
+  case RESAMPLE_BILINEAR: return 1.0f;
+  case RESAMPLE_BICUBIC: return 2.0f;
+  case RESAMPLE_LANCZOS: return 3.0f;
+  }
+  return 1.0f;
+}
+
+// Resamples one dimension of float RGBA buffers, where step is the distance between
+// the samples of a line and line_step the distance between the lines
+static void
+resampleFloat(const float * input, unsigned int input_size, size_t input_step, size_t input_line_step,
+	      float * output, unsigned int output_size, size_t output_step, size_t output_line_step,
+	      unsigned int lines, ResampleFilter filter) {
+  float scale = float(input_size) / output_size, filter_scale = std::max(scale, 1.0f);
+  float support = getSupport(filter) * filter_scale;
+  vector<float> weights;
+  for (unsigned int i = 0; i < output_size; i++) {
+    float center = (i + 0.5f) * scale;
+    int x0 = std::max(int(center - support + 0.5f), 0), x1 = std::min(int(center + support + 0.5f), int(input_size));
+    weights.clear();
+    float sum = 0;
+    for (int x = x0; x < x1; x++) {
+      weights.push_back(evaluateFilter(filter, (x - center + 0.5f) / filter_scale));
+      sum += weights.back();
+    }
+    for (unsigned int line = 0; line < lines; line++) {
+      float acc[4] = { 0, 0, 0, 0 };
+      for (int x = x0; x < x1; x++) {
+	const float * p = input + line * input_line_step + x * input_step;
+	float w = weights[x - x0] / sum;
+	for (int c = 0; c < 4; c++) acc[c] += p[c] * w;
+      }
+      float * q = output + line * output_line_step + i * output_step;
+      for (int c = 0; c < 4; c++) q[c] = acc[c];
+    }
+  }
+}
+
+static void
+resizeFloat(const unsigned char * input, unsigned int iw, unsigned int ih, unsigned char * output, unsigned int ow, unsigned int oh, ResampleFilter filter) {
+  vector<float> in(input, input + iw * ih * 4), tmp(ow * ih * 4), out(ow * oh * 4);
+  resampleFloat(in.data(), iw, 4, iw * 4, tmp.data(), ow, 4, ow * 4, ih, filter);
+  resampleFloat(tmp.data(), ih, ow * 4, 4, out.data(), oh, ow * 4, 4, ow, filter);
+  for (size_t i = 0; i < out.size(); i += 4) {
+    float alpha = std::min(std::max(out[i + 3], 0.0f), 255.0f);
+    for (int c = 0; c < 4; c++) {
+      // premultiplied colors are clamped to the alpha
+      output[i + c] = (unsigned char)(std::min(std::max(out[i + c], 0.0f), alpha) + 0.5f);
+    }
+  }
+}
+
+int
+main() {
+  ThreadPool::setSerial();
+
+  const struct {
+    unsigned int iw, ih, ow, oh;
+  } sizes[] = {
+    { 2048, 1536, 256, 192 },
+    { 1024, 768, 200, 150 },
+    { 640, 480, 1280, 960 }
+  };
+  const struct {
+    const char * name;
+    ResampleFilter filter;
+  } filters[] = {
+    { "box", RESAMPLE_BOX },
+    { "bilinear", RESAMPLE_BILINEAR },
+    { "bicubic", RESAMPLE_BICUBIC },
+    { "lanczos", RESAMPLE_LANCZOS }
+  };
+
+  srand(1);
+  for (auto & s : sizes) {
+    // smooth gradients with noise, premultiplied
+    vector<unsigned char> input(s.iw * s.ih * 4);
+    for (unsigned int y = 0; y < s.ih; y++) {
+      for (unsigned int x = 0; x < s.iw; x++) {
+	unsigned char * p = &input[(y * s.iw + x) * 4];
+	int alpha = 128 + 127 * ((x / 64 + y / 64) % 2);
+	p[0] = (unsigned char)((x * 255 / s.iw) * alpha / 255);
+	p[1] = (unsigned char)((y * 255 / s.ih) * alpha / 255);
+	p[2] = (unsigned char)(rand() % (alpha + 1));
+	p[3] = (unsigned char)alpha;
+      }
+    }
+    vector<unsigned char> a(s.ow * s.oh * 4), b(s.ow * s.oh * 4);
+    for (auto & f : filters) {
+      auto start = chrono::steady_clock::now();
+      Resampler::resize(input.data(), s.iw, s.ih, a.data(), s.ow, s.oh, RGBA8, f.filter);
+      auto middle = chrono::steady_clock::now();
+      resizeFloat(input.data(), s.iw, s.ih, b.data(), s.ow, s.oh, f.filter);
+      auto end = chrono::steady_clock::now();
+      double fixed_time = chrono::duration<double>(middle - start).count(), float_time = chrono::duration<double>(end - middle).count();
+      double total_diff = 0;
+      int max_diff = 0;
+      for (size_t i = 0; i < a.size(); i++) {
+	int d = abs(int(a[i]) - int(b[i]));
+	total_diff += d;
+	max_diff = std::max(max_diff, d);
+      }
+      printf("%ux%u -> %ux%u %s: fixed point %.1f ms, float %.1f ms, speedup %.1fx, mean difference %.3f, max difference %d\n", s.iw, s.ih, s.ow, s.oh, f.name, fixed_time * 1000, float_time * 1000, float_time / fixed_time, total_diff / a.size(), max_diff);
+    }
+  }
+  return 0;
+}
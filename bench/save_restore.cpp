@@ -0,0 +1,45 @@
+// Measures the cost of a save and restore pair with a large current path,
+// a clip and a gradient in the state, with and without changes to the state
+// between the calls.
+
+#include <ContextCairo.h>
+
+#include <chrono>
+#include <cstdio>
+
+using namespace std;
+using namespace canvas;
+
+static const int NUM_PAIRS = 1000000;
+
+int
+main() {
+  ContextCairo context(256, 256, RGBA8);
+  context.beginPath();
+  context.rect(10, 10, 200, 200);
+  context.clip();
+  context.beginPath();
+  for (int i = 0; i < 1000; i++) context.lineTo(i % 256, i * 7 % 256);
+  Style & gradient = context.createLinearGradient(0, 0, 256, 0);
+  for (int i = 0; i <= 10; i++) gradient.addColorStop(i / 10.0f, Color(i / 10.0f, 0.0f, 1.0f, 1.0f));
+  context.fillStyle = gradient;
+  context.font.family = "DejaVu Sans";
+  context.font.size = 12;
+
+  for (int mutate = 0; mutate < 2; mutate++) {
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < NUM_PAIRS; i++) {
+      context.save();
+      if (mutate) {
+	// the changes a widget typically makes before drawing
+	context.fillStyle = Color(1.0f, 0.0f, 0.0f, 1.0f);
+	context.lineWidth = 2;
+	context.translate(i % 10, 0);
+      }
+      context.restore();
+    }
+    double t = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    printf("%s: %.1f ns per save and restore\n", mutate ? "with changes" : "without changes", t / NUM_PAIRS * 1e9);
+  }
+  return 0;
+}
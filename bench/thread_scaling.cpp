@@ -0,0 +1,68 @@
+// Runs the parallel pixel operations with 1 to 32 threads and reports the
+// speedup over a single thread. The thread count includes the calling
+// thread, which processes bands too.
+
+#include <ThreadPool.h>
+#include <Image.h>
+#include <PixelKernels.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+using namespace std;
+using namespace canvas;
+
+static const unsigned int SIZE = 2048;
+
+static double
+measure(const function<void()> & func) {
+  // the best of three runs
+  double best = 0;
+  for (int i = 0; i < 3; i++) {
+    auto start = chrono::steady_clock::now();
+    func();
+    double t = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (!i || t < best) best = t;
+  }
+  return best;
+}
+
+int
+main() {
+  vector<unsigned char> pixels(SIZE * SIZE * 4);
+  srand(1);
+  for (auto & v : pixels) v = rand() % 256;
+  Image image(pixels.data(), RGBA8, SIZE, SIZE);
+  vector<unsigned char> buffer;
+
+  const struct {
+    const char * name;
+    function<void()> func;
+  } operations[] = {
+    { "gaussian blur", [&]() { buffer = pixels; PixelKernels::gaussianBlur(buffer.data(), SIZE, SIZE, SIZE * 4, 4, 12, 12); } },
+    { "pyramid blur", [&]() { buffer = pixels; PixelKernels::pyramidBlur(buffer.data(), SIZE, SIZE, SIZE * 4, 4, 48, 48); } },
+    { "convert to RGB565", [&]() { image.convert(RGB565); } },
+    { "scale to 1/4", [&]() { image.scale(SIZE / 4, SIZE / 4, 1, RESAMPLE_LANCZOS); } }
+  };
+  const unsigned int thread_counts[] = { 1, 2, 4, 8, 16, 32 };
+  for (auto & op : operations) {
+    double single = 0;
+    for (unsigned int threads : thread_counts) {
+      // the calling thread takes part, so n threads are n - 1 workers
+      if (threads == 1) {
+	ThreadPool::setSerial();
+      } else {
+	ThreadPool::setNumThreads(threads - 1);
+      }
+      double t = measure(op.func);
+      if (threads == 1) single = t;
+      printf("%s, %2u threads: %7.1f ms, speedup %.2fx\n", op.name, threads, t * 1000, single / t);
+    }
+  }
+  // back to the default pool
+  ThreadPool::setNumThreads(0);
+  return 0;
+}
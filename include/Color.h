@@ -2,21 +2,35 @@
 #define _COLOR_H_
 
 #include <string>
+#include <cstddef>
 
 namespace canvas {
   class Color {
   public:
     static Color BLACK, WHITE, RED;
     
-  Color() : red(0.0f), green(0.0f), blue(0.0f), alpha(1.0f) { }
+  constexpr Color() : red(0.0f), green(0.0f), blue(0.0f), alpha(1.0f) { }
+    // Parses a CSS color: a named color, #rgb, #rgba, #rrggbb, #rrggbbaa, rgb(), rgba(), hsl() or hsla().
+    // Assigning a string that is not a valid color leaves the color unchanged.
     Color(const std::string & s)
       : red(0.0f), green(0.0f), blue(0.0f), alpha(1.0f) {
       setValue(s);
     }
-  Color(float _red, float _green, float _blue, float _alpha)
+  constexpr Color(float _red, float _green, float _blue, float _alpha)
     : red(_red), green(_green), blue(_blue), alpha(_alpha) { }
+
+    // Creates a color from a packed 0xRRGGBB value
+    static constexpr Color fromRGB(unsigned int rgb, float alpha = 1.0f) {
+      return Color(((rgb >> 16) & 0xff) / 255.0f, ((rgb >> 8) & 0xff) / 255.0f, (rgb & 0xff) / 255.0f, alpha);
+    }
+    // Creates a color from a packed 0xRRGGBBAA value
+    static constexpr Color fromRGBA(unsigned int rgba) {
+      return Color(((rgba >> 24) & 0xff) / 255.0f, ((rgba >> 16) & 0xff) / 255.0f, ((rgba >> 8) & 0xff) / 255.0f, (rgba & 0xff) / 255.0f);
+    }
     
     Color & operator=(const std::string & s);
+    bool operator==(const Color & other) const { return red == other.red && green == other.green && blue == other.blue && alpha == other.alpha; }
+    bool operator!=(const Color & other) const { return !(*this == other); }
     
 	Color mix(float f, const Color & other) {
 		return Color(f * other.red + (1 - f) * red,
@@ -28,7 +42,12 @@ namespace canvas {
     
   private:
     void setValue(const std::string & s);
+    bool parse(const char * s, size_t len);
   };
+
+  // Color literals, e.g. 0xff8800_rgb or 0xff880080_rgba
+  constexpr Color operator"" _rgb(unsigned long long rgb) { return Color::fromRGB((unsigned int)rgb); }
+  constexpr Color operator"" _rgba(unsigned long long rgba) { return Color::fromRGBA((unsigned int)rgba); }
 };
 
 #endif
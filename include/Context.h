@@ -3,6 +3,7 @@
 
 #include <string>
 #include <memory>
+#include <functional>
 
 #include "InternalFormat.h"
 #include "Color.h"
@@ -10,13 +11,16 @@
 #include "Image.h"
 #include "HitRegion.h"
 #include "GraphicsState.h"
+#include "ShadowCache.h"
 
 namespace canvas {
   class Context : public GraphicsState {
   public:
     Context(float _display_scale = 1.0f)
       : display_scale(_display_scale),
-      current_linear_gradient(this)
+      current_linear_gradient(this),
+      current_radial_gradient(this),
+      current_pattern(this)
       { }
     Context(const Context & other) = delete;
     Context & operator=(const Context & other) = delete;
@@ -31,12 +35,24 @@ namespace canvas {
     virtual std::shared_ptr<Surface> createSurface(const std::string & filename) = 0;
     virtual void resize(unsigned int _width, unsigned int _height);
         
-    Context & stroke() { return renderPath(STROKE, currentPath, strokeStyle); }
-    Context & stroke(const Path2D & path) { return renderPath(STROKE, path, strokeStyle); }
-    Context & fill() { return renderPath(FILL, currentPath, fillStyle); }
-    Context & fill(const Path2D & path) { return renderPath(FILL, path, fillStyle); }
+    Context & stroke() { return renderPath(STROKE, currentPath, strokeStyle, globalCompositeOperation.getValue()); }
+    Context & stroke(const Path2D & path) { return renderPath(STROKE, path, strokeStyle, globalCompositeOperation.getValue()); }
+    Context & fill() { return renderPath(FILL, currentPath, fillStyle, globalCompositeOperation.getValue()); }
+    Context & fill(const Path2D & path) { return renderPath(FILL, path, fillStyle, globalCompositeOperation.getValue()); }
+    // Renders a path built in user space under the current transform combined with the given matrix.
+    // The path is not modified, so the same path can be drawn any number of times.
+    Context & stroke(const Path2D & path, const Matrix & m) { return renderPath(STROKE, path, strokeStyle, currentTransform * m, globalCompositeOperation.getValue()); }
+    Context & fill(const Path2D & path, const Matrix & m) { return renderPath(FILL, path, fillStyle, currentTransform * m, globalCompositeOperation.getValue()); }
     Context & save();
     Context & restore();
+
+    // Appends a polyline of n points given as interleaved x, y coordinates to the current path.
+    // With decimation the points are reduced to what is visible in each column of device pixels,
+    // since the path holds the transformed coordinates.
+    Context & polyline(const float * xy, size_t n, PolylineDecimation decimation = DECIMATE_NONE) {
+      currentPath.polyline(xy, n, currentTransform, 1.0, decimation);
+      return *this;
+    }
     
     bool isPointInPath(const Path2D & path, double x, double y) { return false; }
     
@@ -44,11 +60,17 @@ namespace canvas {
       return getDefaultSurface().measureText(font, text, textBaseline.getValue(), getDisplayScale());
     }
     
+    // Fills the shape at each of the n points, which are transformed by the current transform.
+    // The shape itself is given in surface coordinates relative to each point, so markers keep
+    // their size under scaling. colors is optional and gives a color for each instance.
+    Context & drawMarkers(const Path2D & shape, const Style & style, const Point * points, size_t n, const Color * colors = 0);
+    // Solid rectangles whose device space edges are at half-integer coordinates cover
+    // whole pixels and are written directly into the surface where the backend allows.
     Context & fillRect(double x, double y, double w, double h);
     Context & strokeRect(double x, double y, double w, double h);
     Context & clearRect(double x, double y, double w, double h);
-    Context & fillText(const std::string & text, double x, double y) { return renderText(FILL, fillStyle, text, currentTransform.multiply(x, y)); }
-    Context & strokeText(const std::string & text, double x, double y) { return renderText(STROKE, strokeStyle, text, currentTransform.multiply(x, y)); }
+    Context & fillText(const std::string & text, double x, double y) { return renderText(FILL, fillStyle, text, currentTransform.multiply(x, y), globalCompositeOperation.getValue()); }
+    Context & strokeText(const std::string & text, double x, double y) { return renderText(STROKE, strokeStyle, text, currentTransform.multiply(x, y), globalCompositeOperation.getValue()); }
     
     virtual Surface & getDefaultSurface() = 0;
     virtual const Surface & getDefaultSurface() const = 0;
@@ -67,8 +89,21 @@ namespace canvas {
     Style & createLinearGradient(double x0, double y0, double x1, double y1) {
       current_linear_gradient.setType(Style::LINEAR_GRADIENT);
       current_linear_gradient.setVector(x0, y0, x1, y1);
+      current_linear_gradient.clearColorStops();
       return current_linear_gradient;
     }
+    Style & createRadialGradient(double x0, double y0, double r0, double x1, double y1, double r1) {
+      current_radial_gradient.setType(Style::RADIAL_GRADIENT);
+      current_radial_gradient.setVector(x0, y0, x1, y1);
+      current_radial_gradient.setRadii(r0, r1);
+      current_radial_gradient.clearColorStops();
+      return current_radial_gradient;
+    }
+    // Backends cache the native pattern by image, so reuse the same shared image for repeated fills
+    Style & createPattern(const std::shared_ptr<Image> & image, const std::string & repeat = "repeat");
+    Style & createPattern(const Image & image, const std::string & repeat = "repeat") {
+      return createPattern(std::make_shared<Image>(image), repeat);
+    }
 
     float getDisplayScale() const { return display_scale; }
     Context & addHitRegion(const std::string & id, const std::string & cursor) {
@@ -85,28 +120,61 @@ namespace canvas {
       return null_region;
     }
     const std::vector<HitRegion> & getHitRegions() const { return hit_regions; }
-    
-#if 0
-    Style & createPattern(const Image & image, const char * repeat) {
-      
+
+    ShadowCache & getShadowCache() { return shadow_cache; }
+    // Shadows with a blur radius above the threshold (in pixels) use the approximate pyramid blur
+    void setPyramidBlurThreshold(float threshold) {
+      pyramid_blur_threshold = threshold;
+      getDefaultSurface().setBlurThreshold(getBlurThreshold());
+      shadow_cache.clear();
     }
-    Style & createRadialGradient(double x0, double y0, double r0, double x1, double y1, double r1) {
-     }
-#endif
+    float getPyramidBlurThreshold() const { return pyramid_blur_threshold; }
+    // The pyramid blur threshold limited by the render quality
+    float getBlurThreshold() const;
+
+    // Applies to the default surface and to the temporary surfaces of shadows and filters
+    void setRenderQuality(RenderQuality quality) {
+      render_quality = quality;
+      getDefaultSurface().setRenderQuality(quality);
+      getDefaultSurface().setBlurThreshold(getBlurThreshold());
+      shadow_cache.clear();
+    }
+    RenderQuality getRenderQuality() const { return render_quality; }
     
   protected:
-    Context & renderPath(RenderMode mode, const Path2D & path, const Style & style, Operator op = SOURCE_OVER);
+    Context & renderPath(RenderMode mode, const Path2D & path, const Style & style, Operator op = SOURCE_OVER) { return renderPath(mode, path, style, Matrix(), op); }
+    Context & renderPath(RenderMode mode, const Path2D & path, const Style & style, const Matrix & transform, Operator op = SOURCE_OVER);
     Context & renderText(RenderMode mode, const Style & style, const std::string & text, const Point & p, Operator op = SOURCE_OVER);
     virtual bool hasNativeShadows() const { return false; }
 
+    // Draws the shadow of a shape within the given device space bounds. render draws the shape with the
+    // given style into the R8 coverage mask at the given offset. A non-zero geometry hash identifies the
+    // shape relative to (min_x, min_y) and lets the blurred mask be reused from the shadow cache.
+    // If prefiltered is set, render writes the blurred coverage itself.
+    void renderShadow(double min_x, double min_y, double max_x, double max_y, uint64_t geometry, const std::function<void(Surface & shadow, const Style & shadow_style, double offset_x, double offset_y)> & render, bool prefiltered = false);
+    bool renderBoxShadow(RenderMode mode, const Path2D & path, const Matrix & transform);
+    void renderPathShadow(RenderMode mode, const Path2D & path, const Matrix & transform);
+    void renderTextShadow(RenderMode mode, const std::string & text, const Point & p);
+    void renderImageShadow(Surface & img, const Point & p, double w, double h);
+    void renderImageShadow(const Image & img, const Point & p, double w, double h);
+    // Renders a draw call within the given device space bounds through the current filter
+    void renderFiltered(double min_x, double min_y, double max_x, double max_y, const std::function<void(Surface & layer, double offset_x, double offset_y)> & render);
+    void getPathExtents(RenderMode mode, const Path2D & path, const Matrix & transform, double & min_x, double & min_y, double & max_x, double & max_y) const;
+    void getTextExtents(RenderMode mode, const std::string & text, const Point & p, double & min_x, double & min_y, double & max_x, double & max_y);
     bool hasShadow() const { return shadowBlur.getValue() > 0.0f || shadowOffsetX.getValue() != 0 || shadowOffsetY.getValue() != 0; }
     
   private:
+    Path2D createRect(double x, double y, double w, double h) const;
+    bool fillAxisAlignedRect(double x, double y, double w, double h, const Color & color, Operator op);
+
     float display_scale;
-    Style current_linear_gradient;
+    Style current_linear_gradient, current_radial_gradient, current_pattern;
     std::vector<GraphicsState> restore_stack;
     std::vector<HitRegion> hit_regions;
     HitRegion null_region;
+    ShadowCache shadow_cache;
+    float pyramid_blur_threshold = 16.0f;
+    RenderQuality render_quality = RENDER_BEST;
   };
   
   class FilenameConverter {
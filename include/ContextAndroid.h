@@ -88,6 +88,7 @@ public:
       bitmapCopyMethod = env->GetMethodID(bitmapClass, "copy", "(Landroid/graphics/Bitmap$Config;Z)Landroid/graphics/Bitmap;");
       paintConstructor = env->GetMethodID(paintClass, "<init>", "()V");
       paintSetAntiAliasMethod = env->GetMethodID(paintClass, "setAntiAlias", "(Z)V");
+      paintSetFilterBitmapMethod = env->GetMethodID(paintClass, "setFilterBitmap", "(Z)V");
       pathMoveToMethod = env->GetMethodID(pathClass, "moveTo", "(FF)V");
       pathConstructor = env->GetMethodID(pathClass, "<init>", "()V");
       textAlignMethod = env->GetMethodID(paintClass, "setTextAlign", "(Landroid/graphics/Paint$Align;)V");
@@ -152,6 +153,7 @@ public:
   jmethodID bitmapCopyMethod;
   jmethodID paintConstructor;
   jmethodID paintSetAntiAliasMethod;
+  jmethodID paintSetFilterBitmapMethod;
   jmethodID pathMoveToMethod;
   jmethodID pathConstructor;
   jmethodID canvasTextDrawMethod;
@@ -251,6 +253,17 @@ public:
     }
   }
 
+  void setAntiAlias(bool enabled) {
+    create();
+    cache->getJNIEnv()->CallVoidMethod(obj, cache->paintSetAntiAliasMethod, enabled ? JNI_TRUE : JNI_FALSE);
+  }
+
+  // Android has no quality levels for bitmap filtering, only bilinear or nearest
+  void setImageSmoothing(bool enabled) {
+    create();
+    cache->getJNIEnv()->CallVoidMethod(obj, cache->paintSetFilterBitmapMethod, enabled ? JNI_TRUE : JNI_FALSE);
+  }
+
   void setShadow(float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor) {
     create();
     cache->getJNIEnv()->CallVoidMethod(getObject(), cache->paintSetShadowMethod, shadowBlur, shadowOffsetX, shadowOffsetY, getAndroidColor(shadowColor, globalAlpha));
@@ -394,6 +407,12 @@ public:
     // is there AndroidBitmap_releasePixels?
   }
 
+  // Android has only an on/off switch for antialiasing and bitmap filtering
+  void setRenderQuality(RenderQuality quality) override {
+    Surface::setRenderQuality(quality);
+    paint.setAntiAlias(quality != RENDER_FAST);
+  }
+
   void renderPath(RenderMode mode, const Path2D & path, const Style & style, float lineWidth, Operator op, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath) override {
     checkForCanvas();
 
@@ -528,24 +547,25 @@ public:
     return TextMetrics(textWidth, descent, ascent);
   }
 
-  void drawImage(Surface & _img, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled = true) override {
+  void drawImage(Surface & _img, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled = true, ImageSmoothingQuality imageSmoothingQuality = SMOOTHING_LOW) override {
     __android_log_print(ANDROID_LOG_VERBOSE, "Sometrik", "DrawImage (Surface) called");
     AndroidSurface * native_surface = dynamic_cast<canvas::AndroidSurface *>(&_img);
     if (native_surface) {
       checkForCanvas();
       paint.setGlobalAlpha(globalAlpha);
       paint.setShadow(shadowBlur, shadowOffsetX, shadowOffsetY, shadowColor);
+      paint.setImageSmoothing(imageSmoothingEnabled && getRenderQuality() != RENDER_FAST);
 
       JNIEnv * env = cache->getJNIEnv();
       jobject dstRect = env->NewObject(cache->rectFClass, cache->rectFConstructor, displayScale * p.x, displayScale * p.y, displayScale * (p.x + w), displayScale * (p.y + h));
       env->CallVoidMethod(canvas, cache->canvasBitmapDrawMethod2, native_surface->getBitmap(), NULL, dstRect, paint.getObject());
     } else {
       auto img = native_surface->createImage();
-      drawImage(*img, p, w, h, displayScale, globalAlpha, shadowBlur, shadowOffsetX, shadowOffsetY, shadowColor, clipPath, imageSmoothingEnabled);
+      drawImage(*img, p, w, h, displayScale, globalAlpha, shadowBlur, shadowOffsetX, shadowOffsetY, shadowColor, clipPath, imageSmoothingEnabled, imageSmoothingQuality);
     }
   }
 
-  void drawImage(const Image & _img, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled = true) override {
+  void drawImage(const Image & _img, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled = true, ImageSmoothingQuality imageSmoothingQuality = SMOOTHING_LOW) override {
 
     __android_log_print(ANDROID_LOG_VERBOSE, "Sometrik", "DrawImage (Image) called");
 
@@ -553,6 +573,7 @@ public:
 
     paint.setGlobalAlpha(globalAlpha);
     paint.setShadow(shadowBlur, shadowOffsetX, shadowOffsetY, shadowColor);
+    paint.setImageSmoothing(imageSmoothingEnabled && getRenderQuality() != RENDER_FAST);
     
     jobject drawableBitmap = imageToBitmap(_img);
 
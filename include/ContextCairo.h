@@ -2,6 +2,8 @@
 
 #include <cairo/cairo.h>
 
+#include <vector>
+
 namespace canvas {
   class ContextCairo;
 
@@ -30,13 +32,20 @@ namespace canvas {
 	markDirty();
       }
     }
+    // A8 surfaces have the rows padded to a multiple of four bytes
+    unsigned int getStride() const { return surface ? cairo_image_surface_get_stride(surface) : 0; }
     void resize(unsigned int _logical_width, unsigned int _logical_height, unsigned int _actual_width, unsigned int _actual_height, InternalFormat _format);
+    void setRenderQuality(RenderQuality quality);
 
     void renderPath(RenderMode mode, const Path2D & path, const Style & style, float lineWidth, Operator op, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath);
+    void renderPath(RenderMode mode, const Path2D & path, const Matrix & transform, const Style & style, float lineWidth, Operator op, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath);
     void renderText(RenderMode mode, const Font & font, const Style & style, TextBaseline textBaseline, TextAlign textAlign, const std::string & text, const Point & p, float lineWidth, Operator op, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath);
     TextMetrics measureText(const Font & font, const std::string & text, TextBaseline textBaseline, float displayScale);
-    void drawImage(Surface & _img, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled = true);
-    void drawImage(const Image & _img, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled = true);
+    void drawImage(Surface & _img, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled = true, ImageSmoothingQuality imageSmoothingQuality = SMOOTHING_LOW);
+    void drawImage(const Image & _img, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled = true, ImageSmoothingQuality imageSmoothingQuality = SMOOTHING_LOW);
+    void drawMask(Surface & mask, const Point & p, double w, double h, const Color & color, float displayScale, float globalAlpha, const Path2D & clipPath);
+    void fillRect(double x, double y, double w, double h, const Color & color, Operator op, float displayScale, float globalAlpha, const Path2D & clipPath);
+    void drawMarkers(const Path2D & shape, const Style & style, const Point * points, size_t n, const Color * colors, float displayScale, float globalAlpha, const Path2D & clipPath);
     
   protected:
     void initializeContext() {
@@ -45,19 +54,107 @@ namespace canvas {
 	  surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 4, 4);
 	}
 	cr = cairo_create(surface);	
-	cairo_set_antialias(cr, CAIRO_ANTIALIAS_BEST);
+	cairo_set_antialias(cr, getQualityAntialias());
+	cairo_set_tolerance(cr, getQualityTolerance());
+	resetNativeState();
       }
     }
+    void resetNativeState() {
+      applied_operator = CAIRO_OPERATOR_OVER;
+      applied_antialias = getQualityAntialias();
+      applied_line_width = 2.0; // Cairo default
+      has_source_color = has_font = has_font_options = false;
+    }
+
+    void drawNativeSurface(CairoSurface & img, const Point & p, double w, double h, float displayScale, float globalAlpha, const Path2D & clipPath, bool imageSmoothingEnabled, ImageSmoothingQuality imageSmoothingQuality);
 
-    void drawNativeSurface(CairoSurface & img, const Point & p, double w, double h, float displayScale, float globalAlpha, const Path2D & clipPath, bool imageSmoothingEnabled);
+    void sendPath(const Path2D & path, const Matrix & transform = Matrix());
+    void setClip(const Path2D & clipPath);
+    cairo_surface_t * getMarkerStamp(const Path2D & shape, unsigned int phase);
+    void clearMarkerStamps();
 
-    void sendPath(const Path2D & path);
+    // The setters below skip the Cairo call if the state is already applied
+    void setOperator(Operator op);
+    void setSourceColor(const Color & color, float globalAlpha);
+    void setSourcePattern(cairo_pattern_t * pattern);
+    void setLineWidth(double width);
+    void setAntialias(cairo_antialias_t antialias);
+    // The antialiasing of shapes and the curve flattening tolerance in pixels for the render quality
+    cairo_antialias_t getQualityAntialias() const;
+    double getQualityTolerance() const;
+    void setFont(const Font & font, float displayScale);
+    // Sets a filtered copy of the pixels around the path as the source
+    bool setFilteredSource(const Path2D & path, const Matrix & transform, const Filter & filter, double pad);
+
+    // Returns the surface or its smallest mip level that is at least the given size in pixels
+    CairoSurface & getMipmap(double width, double height);
+    void clearMipmaps() { mipmaps.clear(); }
+    // Returns a copy of the image that keeps its mip levels between draws
+    CairoSurface & getCachedImage(const Image & image);
+
+    // Returns a cached native pattern for a gradient or pattern style
+    cairo_pattern_t * getPattern(const Style & style, float displayScale, float globalAlpha);
+    void clearPatternCache();
 
   private:
     cairo_t * cr = 0;
     cairo_surface_t * surface;
     unsigned int * storage = 0;
     bool locked_for_write = false;
+
+    // Shadow copy of the state applied to cr
+    cairo_operator_t applied_operator = CAIRO_OPERATOR_OVER;
+    cairo_antialias_t applied_antialias = CAIRO_ANTIALIAS_BEST;
+    double applied_line_width = 2.0;
+    bool has_source_color = false;
+    float source_red = 0, source_green = 0, source_blue = 0, source_alpha = 0;
+    bool has_font = false;
+    std::string font_family;
+    cairo_font_slant_t font_slant = CAIRO_FONT_SLANT_NORMAL;
+    cairo_font_weight_t font_weight = CAIRO_FONT_WEIGHT_NORMAL;
+    double font_size = 0;
+    bool has_font_options = false;
+    bool font_antialiasing = true, font_hinting = true, font_cleartype = false;
+
+    // The clip is kept active in the Cairo context until the clip path changes
+    Path2D current_clip;
+    bool clip_is_rect = false;
+    int clip_x0 = 0, clip_y0 = 0, clip_x1 = 0, clip_y1 = 0;
+
+    // Coverage stamps of the last marker shape, one for each subpixel phase
+    static const unsigned int MARKER_SUBPIXELS = 4;
+    Path2D marker_shape;
+    cairo_surface_t * marker_stamps[MARKER_SUBPIXELS * MARKER_SUBPIXELS] = { };
+    int marker_x0 = 0, marker_y0 = 0, marker_width = 0, marker_height = 0;
+
+    // Recently used gradients and patterns, the least recently used entry is replaced when full
+    struct CachedPattern {
+      Style::StyleType type;
+      double x0, y0, x1, y1, r0, r1;
+      float displayScale, globalAlpha;
+      std::map<float, Color> colors;
+      unsigned int image_id;
+      Style::RepeatMode repeat;
+      std::shared_ptr<CairoSurface> image_surface;
+      cairo_pattern_t * pattern;
+      unsigned int last_used;
+    };
+    static const size_t PATTERN_CACHE_SIZE = 16;
+    std::vector<CachedPattern> pattern_cache;
+    unsigned int pattern_clock = 0;
+
+    // Box filtered half size levels, built when the surface is drawn downscaled and cleared when it is written
+    std::vector<std::unique_ptr<CairoSurface> > mipmaps;
+
+    // Recently downscaled images, the least recently used entry is replaced when full
+    struct CachedImage {
+      unsigned int image_id;
+      std::shared_ptr<CairoSurface> surface;
+      unsigned int last_used;
+    };
+    static const size_t IMAGE_CACHE_SIZE = 4;
+    std::vector<CachedImage> image_cache;
+    unsigned int image_clock = 0;
   };
 
   class ContextCairo : public Context {
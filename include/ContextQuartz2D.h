@@ -102,6 +102,11 @@ namespace canvas {
     void renderPath(RenderMode mode, const Path2D & path, const Style & style, float lineWidth, Operator op, float display_scale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath) override;
 
     void resize(unsigned int _logical_width, unsigned int _logical_height, unsigned int _actual_width, unsigned int _actual_height, InternalFormat _format) override;
+
+    void setRenderQuality(RenderQuality quality) override {
+      Surface::setRenderQuality(quality);
+      if (gc) applyRenderQuality();
+    }
     
     void renderText(RenderMode mode, const Font & font, const Style & style, TextBaseline textBaseline, TextAlign textAlign, const std::string & text, const Point & p, float lineWidth, Operator op, float display_scale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath) override {
       initializeContext();
@@ -234,11 +239,11 @@ namespace canvas {
       return TextMetrics(width / display_scale);
     }
 
-    void drawImage(Surface & surface, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled = true) override {
+    void drawImage(Surface & surface, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled = true, ImageSmoothingQuality imageSmoothingQuality = SMOOTHING_LOW) override {
       initializeContext();
 #if 1
       auto img = surface.createImage();
-      drawImage(*img, p, w, h, displayScale, globalAlpha, shadowBlur, shadowOffsetX, shadowOffsetY, shadowColor, clipPath, imageSmoothingEnabled);
+      drawImage(*img, p, w, h, displayScale, globalAlpha, shadowBlur, shadowOffsetX, shadowOffsetY, shadowColor, clipPath, imageSmoothingEnabled, imageSmoothingQuality);
 #else
       _img.initializeContext();
       Quartz2DSurface & img = dynamic_cast<Quartz2DSurface &>(_img);
@@ -247,7 +252,7 @@ namespace canvas {
       CGImageRelease(myImage);
 #endif
     }
-    void drawImage(const Image & _img, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled = true) override;
+    void drawImage(const Image & _img, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled = true, ImageSmoothingQuality imageSmoothingQuality = SMOOTHING_LOW) override;
    
   protected:
     void sendPath(const Path2D & path, float display_scale);
@@ -275,11 +280,19 @@ namespace canvas {
         gc = CGBitmapContextCreate(bitmapData, getActualWidth(), getActualHeight(), 8, bitmapBytesPerRow, cache->getColorSpace(),
                                    (getFormat() == RGBA8 ? kCGImageAlphaPremultipliedLast : kCGImageAlphaNoneSkipLast)); // | kCGBitmapByteOrder32Big);
         CGContextSetInterpolationQuality(gc, kCGInterpolationHigh);
-        CGContextSetShouldAntialias(gc, true);
+	applyRenderQuality();
 	flipY();
       }
     }
 
+    // Font smoothing is the subpixel antialiasing of text, and flatness the curve tolerance in pixels
+    void applyRenderQuality() {
+      RenderQuality quality = getRenderQuality();
+      CGContextSetShouldAntialias(gc, quality != RENDER_FAST);
+      CGContextSetShouldSmoothFonts(gc, quality == RENDER_BEST);
+      CGContextSetFlatness(gc, quality == RENDER_FAST ? 2.0 : (quality == RENDER_BALANCED ? 1.0 : 0.5));
+    }
+
     void flipY() {
       CGContextTranslateCTM(gc, 0, getActualHeight());
       CGContextScaleCTM(gc, 1.0, -1.0);
@@ -1,11 +1,58 @@
 #ifndef _FILTER_H_
 #define _FILTER_H_
 
-class Filter {
- public:
-  Filter() { }
-  virtual ~Filter() { }
-  
+#include "Color.h"
+
+#include <vector>
+
+namespace canvas {
+  class Surface;
+
+  // A chain of image filters in the order they are added. Adjacent color
+  // stages (brightness, contrast, grayscale, color matrices and opacity) are
+  // folded into a single 4x5 matrix as they are added, so they take one pass
+  // over the pixels. Intermediate results of a folded chain are not clamped.
+  // The matrices work on unpremultiplied RGBA with the offsets in [0, 1].
+  class Filter {
+  public:
+    enum StageType {
+      BLUR = 1,
+      DROP_SHADOW,
+      COLOR_MATRIX
+    };
+    struct Stage {
+      StageType type;
+      float matrix[20];
+      float radius, offset_x, offset_y;
+      Color color;
+    };
+
+    Filter() { }
+    virtual ~Filter() { }
+
+    // Gaussian blur with the given standard deviation
+    Filter & blur(float std_deviation);
+    // Shadow of the alpha, blurred with the same radius as shadowBlur of the context
+    Filter & dropShadow(float offset_x, float offset_y, float blur, const Color & color);
+    Filter & brightness(float amount);
+    Filter & contrast(float amount);
+    Filter & grayscale(float amount);
+    Filter & opacity(float amount);
+    Filter & colorMatrix(const float matrix[20]);
+
+    bool empty() const { return stages.empty(); }
+    const std::vector<Stage> & getStages() const { return stages; }
+    // How far the filter can move content outside its original bounds
+    int getOutset() const;
+
+    // Filters the region of an RGBA8 surface. Pixels outside the region are treated as transparent.
+    // Blurs with a radius above blur_threshold use the pyramid blur, see Context::getBlurThreshold().
+    void apply(Surface & surface, int x0, int y0, int x1, int y1, float blur_threshold) const;
+    void apply(Surface & surface, float blur_threshold) const;
+
+  private:
+    std::vector<Stage> stages;
+  };
 };
 
 #endif
@@ -5,11 +5,13 @@
 #include <Font.h>
 #include <TextBaseline.h>
 #include <TextAlign.h>
+#include <ImageSmoothingQuality.h>
 #include <Path2D.h>
 #include <ColorAttribute.h>
 #include <FloatAttribute.h>
 #include <BoolAttribute.h>
 #include <Matrix.h>
+#include <Operator.h>
 
 #include <cmath>
 
@@ -24,10 +26,12 @@ namespace canvas {
       shadowColor(this),
       shadowOffsetX(this), shadowOffsetY(this),
       globalAlpha(this, 1.0f),
+      globalCompositeOperation(this),
       font(this),
       textBaseline(this),
       textAlign(this),
-      imageSmoothingEnabled(this, true)
+      imageSmoothingEnabled(this, true),
+      imageSmoothingQuality(this)
       { }
     GraphicsState(const GraphicsState & other)
       : lineWidth(this, other.lineWidth),
@@ -38,10 +42,13 @@ namespace canvas {
       shadowOffsetX(this, other.shadowOffsetX),
       shadowOffsetY(this, other.shadowOffsetY),    
       globalAlpha(this, other.globalAlpha),
+      globalCompositeOperation(this, other.globalCompositeOperation),
       font(this, other.font),
       textBaseline(this, other.textBaseline),
       textAlign(this, other.textAlign),     
       imageSmoothingEnabled(this, other.imageSmoothingEnabled),
+      imageSmoothingQuality(this, other.imageSmoothingQuality),
+      filter(other.filter),
       currentPath(other.currentPath),
       clipPath(other.clipPath),
       currentTransform(other.currentTransform) {
@@ -58,10 +65,13 @@ namespace canvas {
 	shadowOffsetX = other.shadowOffsetX;
 	shadowOffsetY = other.shadowOffsetY;
 	globalAlpha = other.globalAlpha;
+	globalCompositeOperation = other.globalCompositeOperation;
 	font = other.font;
 	textBaseline = other.textBaseline;
 	textAlign = other.textAlign;
 	imageSmoothingEnabled = other.imageSmoothingEnabled;
+	imageSmoothingQuality = other.imageSmoothingQuality;
+	filter = other.filter;
 	currentPath = other.currentPath;
 	clipPath = other.clipPath;
 	currentTransform = other.currentTransform;
@@ -69,7 +79,11 @@ namespace canvas {
       return *this;
     }
 
-    GraphicsState & arc(double x, double y, double r, double a0, double a1, bool t = false) { currentPath.arc(currentTransform.multiply(x, y), r, currentTransform.transformAngle(a0), currentTransform.transformAngle(a1), t); return *this; }
+    GraphicsState & arc(double x, double y, double r, double a0, double a1, bool t = false) {
+      bool reflect = currentTransform.getDeterminant() < 0;
+      currentPath.arc(currentTransform.multiply(x, y), r * currentTransform.getScale(), currentTransform.transformAngle(a0), currentTransform.transformAngle(a1), reflect ? !t : t);
+      return *this;
+    }
     GraphicsState & moveTo(double x, double y) { currentPath.moveTo(currentTransform.multiply(x, y)); return *this; }
     GraphicsState & lineTo(double x, double y) { currentPath.lineTo(currentTransform.multiply(x, y)); return *this; }
     GraphicsState & arcTo(double x1, double y1, double x2, double y2, double radius) { currentPath.arcTo(currentTransform.multiply(x1, y1), currentTransform.multiply(x2, y2), radius); return *this; }
@@ -125,10 +139,14 @@ namespace canvas {
     ColorAttribute shadowColor;
     FloatAttribute shadowOffsetX, shadowOffsetY;
     FloatAttribute globalAlpha;
+    OperatorAttribute globalCompositeOperation;
     Font font;
     TextBaselineAttribute textBaseline;
     TextAlignAttribute textAlign;
     BoolAttribute imageSmoothingEnabled;
+    ImageSmoothingQualityAttribute imageSmoothingQuality;
+    // Filter applied to each draw call, shared with the saved states
+    std::shared_ptr<Filter> filter;
     Path2D currentPath, clipPath;
     Matrix currentTransform;
   };
@@ -3,9 +3,11 @@
 
 #include <cstring>
 #include <memory>
+#include <atomic>
 
 #include "ImageFormat.h"
 #include "InternalFormat.h"
+#include "ResampleFilter.h"
 
 namespace canvas {
   class Image {
@@ -26,6 +28,9 @@ namespace canvas {
       case RGB565: return ImageFormat::RGB565;
       case RGBA4: return ImageFormat::RGBA4;
       case RGBA_DXT5: return ImageFormat::RGBA_DXT5;
+      case RGBA_ETC2: return ImageFormat::RGBA_ETC2;
+      case R11_EAC: return ImageFormat::R11_EAC;
+      case RG11_EAC: return ImageFormat::RG11_EAC;
       case NO_FORMAT: return ImageFormat::UNDEF;
       }
       return ImageFormat::UNDEF;
@@ -67,6 +72,7 @@ namespace canvas {
 	levels = other.levels;
 	format = other.format;
 	quality = other.quality;
+	id = next_id++;
 	size_t s = calculateSize();	
 	data = new unsigned char[s];
 	if (other.data) {
@@ -79,7 +85,8 @@ namespace canvas {
     }
 
     std::shared_ptr<Image> convert(InternalFormat target_format) const;
-    std::shared_ptr<Image> scale(unsigned int target_width, unsigned int target_height, unsigned int target_levels = 1) const;
+    // Supports R8, RG8, RGB565, RGB8 and RGBA8 images
+    std::shared_ptr<Image> scale(unsigned int target_width, unsigned int target_height, unsigned int target_levels = 1, ResampleFilter filter = RESAMPLE_BICUBIC) const;
     std::shared_ptr<Image> createMipmaps(unsigned int levels) const;
 
     void setQuality(short _quality) { quality = _quality; }
@@ -90,6 +97,8 @@ namespace canvas {
     InternalFormat getInternalFormat() const { return format; }
     ImageFormat getImageFormat() const { return getImageFormat(format); }
     short getQuality() const { return quality; }
+    // Unique id of the image contents, used as a cache key for derived objects
+    unsigned int getId() const { return id; }
     const unsigned char * getData() const { return data; }
     const unsigned char * getDataForLevel(unsigned int level) {
       return data + calculateOffset(level);
@@ -98,15 +107,9 @@ namespace canvas {
     static size_t calculateOffset(unsigned int width, unsigned int height, unsigned int level, InternalFormat input_format) {
       ImageFormat format = getImageFormat(input_format);
       size_t s = 0;
-      if (format.getCompression() == ImageFormat::ETC1 || format.getCompression() == ImageFormat::DXT1 || format.getCompression() == ImageFormat::RGTC1) {
+      if (format.getCompression()) {
 	for (unsigned int l = 0; l < level; l++) {
-	  s += 8 * ((width + 3) / 4) * ((height + 3) / 4);
-	  width = (width + 1) / 2;
-	  height = (height + 1) / 2;
-	}
-      } else if (format.getCompression() == ImageFormat::RGTC2) {
-	for (unsigned int l = 0; l < level; l++) {
-	  s += 16 * ((width + 3) / 4) * ((height + 3) / 4);
+	  s += format.getBytesPerBlock() * ((width + 3) / 4) * ((height + 3) / 4);
 	  width = (width + 1) / 2;
 	  height = (height + 1) / 2;
 	}
@@ -132,7 +135,9 @@ namespace canvas {
     unsigned char * data = 0;
     InternalFormat format;
     short quality = 0;
+    unsigned int id = next_id++;
     static bool etc1_initialized;
+    static std::atomic<unsigned int> next_id;
   };
 };
 #endif
@@ -37,6 +37,9 @@ namespace canvas {
     static ImageFormat RGBA_DXT5;
     static ImageFormat RED_RGTC1;
     static ImageFormat RG_RGTC2;
+    static ImageFormat RGBA_ETC2;
+    static ImageFormat R11_EAC;
+    static ImageFormat RG11_EAC;
     static ImageFormat FLOAT32;
 
     enum Compression {
@@ -47,7 +50,8 @@ namespace canvas {
       RGTC1,
       RGTC2,
       EAC,
-      EAC_SIGNED
+      EAC_SIGNED,
+      ETC2
     };
     
     ImageFormat(unsigned short _channels, unsigned short _bytes_per_pixel, bool _force_alpha = false, Compression _compression = NO_COMPRESSION)
@@ -73,6 +77,16 @@ namespace canvas {
     bool defined() const { return channels > 0; }
     bool hasAlpha() const { return channels >= 4 || force_alpha; }
     Compression getCompression() const { return compression; }
+    // Size of a 4x4 block for compressed formats. EAC has a block of 8 bytes for each channel.
+    unsigned short getBytesPerBlock() const {
+      switch (compression) {
+      case NO_COMPRESSION: return 0;
+      case ETC1: case DXT1: case RGTC1: return 8;
+      case DXT5: case RGTC2: case ETC2: return 16;
+      case EAC: case EAC_SIGNED: return 8 * channels;
+      }
+      return 0;
+    }
   
   private:
     unsigned short channels;
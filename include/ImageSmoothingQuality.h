@@ -0,0 +1,41 @@
+#ifndef _CANVAS_IMAGESMOOTHINGQUALITY_H_
+#define _CANVAS_IMAGESMOOTHINGQUALITY_H_
+
+#include "Attribute.h"
+
+namespace canvas {
+  enum ImageSmoothingQuality {
+    SMOOTHING_LOW = 1,
+    SMOOTHING_MEDIUM,
+    SMOOTHING_HIGH
+  };
+
+  class ImageSmoothingQualityAttribute : public Attribute {
+  public:
+  ImageSmoothingQualityAttribute(GraphicsState * _context, ImageSmoothingQuality _value = SMOOTHING_LOW) : Attribute(_context), value(_value) { }
+  ImageSmoothingQualityAttribute(GraphicsState * _context, const ImageSmoothingQualityAttribute & other) : Attribute(_context), value(other.value) { }
+  ImageSmoothingQualityAttribute(GraphicsState * _context, const std::string & _value) : Attribute(_context) { setValue(_value.c_str()); }
+  ImageSmoothingQualityAttribute(GraphicsState * _context, const char * _value) : Attribute(_context) { setValue(_value); }
+
+    ImageSmoothingQualityAttribute & operator=(const ImageSmoothingQualityAttribute & other) { value = other.value; return *this; }
+    ImageSmoothingQualityAttribute & operator=(const ImageSmoothingQuality & other) { value = other; return *this; }
+    ImageSmoothingQualityAttribute & operator=(const std::string & _value) { setValue(_value.c_str()); return *this; }
+    ImageSmoothingQualityAttribute & operator=(const char * _value) { setValue(_value); return *this; }
+
+    ImageSmoothingQuality getValue() const { return value; }
+    
+  private:
+    void setValue(const char * _value) {
+      if (strcmp(_value, "low") == 0) value = SMOOTHING_LOW;
+      else if (strcmp(_value, "medium") == 0) value = SMOOTHING_MEDIUM;
+      else if (strcmp(_value, "high") == 0) value = SMOOTHING_HIGH;
+      else {
+	value = SMOOTHING_LOW;
+      }
+    };
+
+    ImageSmoothingQuality value;
+  };
+};
+
+#endif
@@ -18,7 +18,10 @@ namespace canvas {
     RGB_ETC1,
     LUMINANCE_ALPHA,
     LA44, // not a real OpenGL format
-    R32F
+    R32F,
+    RGBA_ETC2,
+    R11_EAC,
+    RG11_EAC
   };
 };
 
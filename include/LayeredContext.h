@@ -0,0 +1,98 @@
+#ifndef _CANVAS_LAYEREDCONTEXT_H_
+#define _CANVAS_LAYEREDCONTEXT_H_
+
+#include "Context.h"
+#include "TextureRef.h"
+#include "Filter.h"
+
+#include <vector>
+#include <memory>
+#include <functional>
+
+namespace canvas {
+  // A canvas made of layers that are drawn and uploaded separately. Each layer
+  // has its own context and texture, and only the layers whose content, filter
+  // or size has changed are filtered and uploaded again. The layers can be
+  // drawn by the application from the textures in z order, or composited on
+  // the CPU into a context.
+  class LayeredContext {
+  public:
+    // Creates a texture from the content of a layer, e.g. OpenGLTexture::createTexture
+    typedef std::function<TextureRef(Surface & surface)> TextureFactoryFunc;
+
+    class Layer {
+    public:
+      Layer(int _id, const std::shared_ptr<Context> & _context, float _z) : id(_id), context(_context), z(_z) { }
+
+      int getId() const { return id; }
+      Context & getContext() { return *context; }
+      const Context & getContext() const { return *context; }
+      // The filtered content of the layer, or the surface of the context if there is no filter
+      Surface & getSurface() { return filtered.get() ? *filtered : context->getDefaultSurface(); }
+      const TextureRef & getTexture() const { return texture; }
+      float getZ() const { return z; }
+      float getOpacity() const { return opacity; }
+      const std::shared_ptr<Filter> & getFilter() const { return filter; }
+      bool isVisible() const { return visible; }
+      bool isDirty() const { return needs_filter || needs_upload; }
+
+    private:
+      friend class LayeredContext;
+
+      int id;
+      std::shared_ptr<Context> context;
+      std::shared_ptr<Surface> filtered;
+      TextureRef texture;
+      float z, opacity = 1.0f;
+      std::shared_ptr<Filter> filter;
+      bool visible = true, needs_filter = true, needs_upload = true;
+    };
+
+    LayeredContext(ContextFactory & _factory, unsigned int _width, unsigned int _height, const TextureFactoryFunc & _texture_factory = TextureFactoryFunc())
+      : factory(_factory), width(_width), height(_height), texture_factory(_texture_factory) { }
+    LayeredContext(const LayeredContext & other) = delete;
+    LayeredContext & operator=(const LayeredContext & other) = delete;
+
+    // Returns the id of a new transparent layer. Layers with the same z are drawn in the order they were created.
+    int createLayer(float z = 0.0f);
+    void removeLayer(int id);
+    Layer * getLayer(int id);
+    const Layer * getLayer(int id) const;
+
+    // Clears the layer and redraws it with render
+    void updateLayer(int id, const std::function<void(Context & context)> & render);
+    // Marks a layer changed after it was drawn to directly through its context
+    void invalidate(int id);
+    void setZ(int id, float z);
+    void setOpacity(int id, float opacity);
+    void setFilter(int id, const std::shared_ptr<Filter> & filter);
+    void setVisible(int id, bool visible);
+    void resize(unsigned int _width, unsigned int _height);
+
+    // Filters and uploads the changed layers. Returns the number of textures updated.
+    unsigned int upload();
+    // Draws the visible layers with their opacities into the context, which is not cleared first
+    void composite(Context & target);
+    // True if the layers have changed since the last upload or composite
+    bool needsRedraw() const { return needs_redraw; }
+
+    // The visible layers from back to front
+    std::vector<const Layer *> getDrawOrder() const;
+    const std::vector<std::unique_ptr<Layer> > & getLayers() const { return layers; }
+    unsigned int getWidth() const { return width; }
+    unsigned int getHeight() const { return height; }
+
+  private:
+    void applyFilter(Layer & layer);
+    void sortLayers();
+
+    ContextFactory & factory;
+    unsigned int width, height;
+    TextureFactoryFunc texture_factory;
+    std::vector<std::unique_ptr<Layer> > layers; // sorted by z
+    int next_id = 1;
+    bool needs_redraw = true;
+  };
+};
+
+#endif
@@ -11,7 +11,7 @@ namespace canvas {
   Matrix(double _a, double _b, double _c, double _d, double _e, double _f)
     : a(_a), b(_b), c(_c), d(_d), e(_e), f(_f) { }
     
-    Matrix operator* (const Matrix & other) {
+    Matrix operator* (const Matrix & other) const {
       return multiply(*this, other);    
     }
     
@@ -30,7 +30,22 @@ namespace canvas {
       return multiply(p.x, p.y);
     }
     
-    double transformAngle(double alpha) {
+    // true if the matrix only scales and translates
+    bool isAxisAligned() const { return b == 0.0 && c == 0.0; }
+    bool isIdentity() const { return a == 1.0 && b == 0.0 && c == 0.0 && d == 1.0 && e == 0.0 && f == 0.0; }
+
+    double getDeterminant() const { return a * d - b * c; }
+    // uniform scale factor of the matrix, used for transforming lengths such as arc radii
+    double getScale() const { return sqrt(fabs(getDeterminant())); }
+
+    double getA() const { return a; }
+    double getB() const { return b; }
+    double getC() const { return c; }
+    double getD() const { return d; }
+    double getE() const { return e; }
+    double getF() const { return f; }
+
+    double transformAngle(double alpha) const {
       double x = cos(alpha), y = sin(alpha);
       return atan2(x * b + y * d, x * a + y * c);
     }
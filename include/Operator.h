@@ -1,10 +1,91 @@
 #ifndef _OPERATOR_H_
 #define _OPERATOR_H_
 
+#include "Attribute.h"
+
+#include <cstring>
+
 namespace canvas {
   enum Operator {
     SOURCE_OVER = 1,
-    COPY
+    COPY,
+    // Porter-Duff operators
+    SOURCE_IN,
+    SOURCE_OUT,
+    SOURCE_ATOP,
+    DESTINATION_OVER,
+    DESTINATION_IN,
+    DESTINATION_OUT,
+    DESTINATION_ATOP,
+    XOR,
+    LIGHTER,
+    CLEAR,
+    // Separable blend modes
+    MULTIPLY,
+    SCREEN,
+    OVERLAY,
+    DARKEN,
+    LIGHTEN,
+    COLOR_DODGE,
+    COLOR_BURN,
+    HARD_LIGHT,
+    SOFT_LIGHT,
+    DIFFERENCE,
+    EXCLUSION
+  };
+
+  class OperatorAttribute : public Attribute {
+  public:
+  OperatorAttribute(GraphicsState * _context, Operator _value = SOURCE_OVER) : Attribute(_context), value(_value) { }
+  OperatorAttribute(GraphicsState * _context, const OperatorAttribute & other) : Attribute(_context), value(other.value) { }
+
+    OperatorAttribute & operator=(const OperatorAttribute & other) { value = other.value; return *this; }
+    OperatorAttribute & operator=(const Operator & other) { value = other; return *this; }
+    OperatorAttribute & operator=(const std::string & _value) { setValue(_value.c_str()); return *this; }
+    OperatorAttribute & operator=(const char * _value) { setValue(_value); return *this; }
+
+    Operator getValue() const { return value; }
+
+  private:
+    // Unknown values are ignored as in the Canvas API
+    void setValue(const char * _value) {
+      static const struct {
+	const char * name;
+	Operator op;
+      } operators[] = {
+	{ "source-over", SOURCE_OVER },
+	{ "copy", COPY },
+	{ "source-in", SOURCE_IN },
+	{ "source-out", SOURCE_OUT },
+	{ "source-atop", SOURCE_ATOP },
+	{ "destination-over", DESTINATION_OVER },
+	{ "destination-in", DESTINATION_IN },
+	{ "destination-out", DESTINATION_OUT },
+	{ "destination-atop", DESTINATION_ATOP },
+	{ "xor", XOR },
+	{ "lighter", LIGHTER },
+	{ "clear", CLEAR },
+	{ "multiply", MULTIPLY },
+	{ "screen", SCREEN },
+	{ "overlay", OVERLAY },
+	{ "darken", DARKEN },
+	{ "lighten", LIGHTEN },
+	{ "color-dodge", COLOR_DODGE },
+	{ "color-burn", COLOR_BURN },
+	{ "hard-light", HARD_LIGHT },
+	{ "soft-light", SOFT_LIGHT },
+	{ "difference", DIFFERENCE },
+	{ "exclusion", EXCLUSION }
+      };
+      for (auto & o : operators) {
+	if (strcmp(_value, o.name) == 0) {
+	  value = o.op;
+	  return;
+	}
+      }
+    }
+
+    Operator value;
   };
 };
 
@@ -2,9 +2,18 @@
 #define _CANVAS_PATH2D_H_
 
 #include <Point.h>
+#include <Matrix.h>
 #include <vector>
+#include <memory>
+#include <cstddef>
 
 namespace canvas {
+  enum PolylineDecimation {
+    DECIMATE_NONE = 0,
+    DECIMATE_MINMAX, // first, min, max and last point of each pixel column
+    DECIMATE_LTTB // largest triangle three buckets
+  };
+
   class PathComponent {
   public:
     enum Type { MOVE_TO = 1, LINE_TO, ARC, CLOSE };
@@ -12,6 +21,11 @@ namespace canvas {
   PathComponent(Type _type) : type(_type), x0(0), y0(0), radius(0), sa(0), ea(0), anticlockwise(false) { }
   PathComponent(Type _type, double _x0, double _y0) : type(_type), x0(_x0), y0(_y0), radius(0), sa(0), ea(0), anticlockwise(false) { }
   PathComponent(Type _type, double _x0, double _y0, double _radius, double _sa, double _ea, bool _anticlockwise) : type(_type), x0(_x0), y0(_y0), radius(_radius), sa(_sa), ea(_ea), anticlockwise(_anticlockwise) { }
+
+    bool operator==(const PathComponent & other) const {
+      return type == other.type && x0 == other.x0 && y0 == other.y0 && radius == other.radius && sa == other.sa && ea == other.ea && anticlockwise == other.anticlockwise;
+    }
+    bool operator!=(const PathComponent & other) const { return !(*this == other); }
       
     Type type;
     double x0, y0, radius, sa, ea;
@@ -21,61 +35,97 @@ namespace canvas {
   class Path2D {
   public:
     Path2D() : current_point(0, 0) { }
+
+    bool operator==(const Path2D & other) const { return data == other.data || getData() == other.getData(); }
+    bool operator!=(const Path2D & other) const { return !(*this == other); }
     
     void moveTo(const Point & p) {
-      data.push_back(PathComponent(PathComponent::MOVE_TO, p.x, p.y));
+      editData().push_back(PathComponent(PathComponent::MOVE_TO, p.x, p.y));
       current_point = p;
     }
     void lineTo(const Point & p) {
-      data.push_back(PathComponent(PathComponent::LINE_TO, p.x, p.y));
+      editData().push_back(PathComponent(PathComponent::LINE_TO, p.x, p.y));
       current_point = p;
     }
     void closePath() {
-      if (!data.empty()) {
-	data.push_back(PathComponent(PathComponent::CLOSE));
-	current_point = Point(data.front().x0, data.front().y0);
+      if (!empty()) {
+	editData().push_back(PathComponent(PathComponent::CLOSE));
+	current_point = Point(data->front().x0, data->front().y0);
       }
     }
     void arc(const Point & p, double radius, double sa, double ea, bool anticlockwise);
     void arcTo(const Point & p1, const Point & p2, double radius);
+    // Appends a new subpath through n points given as interleaved x, y coordinates
+    void polyline(const float * xy, size_t n);
+    // Transforms the points with m and optionally decimates them to columns of the given width
+    void polyline(const float * xy, size_t n, const Matrix & m, double column_width, PolylineDecimation decimation = DECIMATE_NONE);
 
-    const std::vector<PathComponent> & getData() const { return data; }
+    const std::vector<PathComponent> & getData() const { return data ? *data : getEmptyData(); }
 
     void clear() {
-      data.clear();
+      if (data.use_count() == 1) {
+	data->clear(); // keep the allocation
+      } else {
+	data.reset();
+      }
       current_point = Point(0, 0);
     }
 
     const Point & getCurrentPoint() const { return current_point; }
 
     void offset(double dx, double dy) {
-      for (auto & pc : data) {
+      if (empty()) return;
+      for (auto & pc : editData()) {
 	pc.x0 += dx;
 	pc.y0 += dy;
       }
     }
+    void transform(const Matrix & m);
 
     void getExtents(double & min_x, double & min_y, double & max_x, double & max_y) const {
-      if (data.empty()) {
+      if (empty()) {
 	min_x = min_y = max_x = max_y = 0;
       } else {
-	auto it = data.begin();
+	auto it = data->begin();
 	min_x = max_x = it->x0;
 	min_y = max_y = it->y0;
-	for (auto & pc : data) {
-	  if (pc.x0 < min_x) min_x = pc.x0;
-	  if (pc.y0 < min_y) min_y = pc.x0;
-	  if (pc.x0 < max_x) max_x = pc.y0;
-	  if (pc.y0 < max_y) max_y = pc.y0;
+	for (auto & pc : *data) {
+	  if (pc.type == PathComponent::CLOSE) continue;
+	  // arcs are bounded by their full circle
+	  double r = pc.type == PathComponent::ARC ? pc.radius : 0;
+	  if (pc.x0 - r < min_x) min_x = pc.x0 - r;
+	  if (pc.y0 - r < min_y) min_y = pc.y0 - r;
+	  if (pc.x0 + r > max_x) max_x = pc.x0 + r;
+	  if (pc.y0 + r > max_y) max_y = pc.y0 + r;
 	}
       }
     }
 
-    bool empty() const { return data.empty(); }
+    bool empty() const { return !data || data->empty(); }
     bool isInside(float x, float y) const;
+    // Returns true if the path is a single axis-aligned rectangle
+    bool isRect(double & min_x, double & min_y, double & max_x, double & max_y) const;
+    // Returns true if the path is a single axis-aligned rectangle with quarter circle corners of the same radius
+    bool isRoundedRect(double & min_x, double & min_y, double & max_x, double & max_y, double & radius) const;
     
+  protected:
+    // The components are shared between copies of the path and cloned on
+    // the first modification, so copying a path (e.g. in save()) is cheap
+    std::vector<PathComponent> & editData() {
+      if (!data) {
+	data = std::make_shared<std::vector<PathComponent> >();
+      } else if (data.use_count() > 1) {
+	data = std::make_shared<std::vector<PathComponent> >(*data);
+      }
+      return *data;
+    }
+    static const std::vector<PathComponent> & getEmptyData() {
+      static const std::vector<PathComponent> empty_data;
+      return empty_data;
+    }
+
   private:
-    std::vector<PathComponent> data;
+    std::shared_ptr<std::vector<PathComponent> > data;
     Point current_point;
   };
 };
@@ -3,52 +3,107 @@
 
 #include "Surface.h"
 
+#include <vector>
+#include <memory>
+
 // #define USE_FIXEDPOINT
 
 namespace canvas {
+  enum NoiseType {
+    NOISE_PERLIN = 1,
+    // Simplex noise evaluates 3 or 4 corners per sample instead of the 8 of classic Perlin
+    NOISE_SIMPLEX_2D,
+    NOISE_SIMPLEX_3D
+  };
+
+  // A surface filled with Perlin or simplex noise. The noise is generated lazily in
+  // tiles that are cached until the parameters or the size change, so that
+  // lockMemoryPartial only evaluates the tiles under the requested region.
   class PerlinSurface : public Surface {
   public:
-    PerlinSurface(unsigned int _logical_width, unsigned int _logical_height, unsigned int _actual_width, unsigned int _actual_height, int octaves = 1, float alpha = 2, float beta = 2);
+    PerlinSurface(unsigned int _logical_width, unsigned int _logical_height, unsigned int _actual_width, unsigned int _actual_height, int octaves = 1, float alpha = 2, float beta = 2, unsigned int seed = 0);
     ~PerlinSurface() {
       delete[] buffer;
+      delete[] partial_buffer;
+#ifdef USE_FIXEDPOINT
+      delete[] fadetbl;
+#endif
     }
 
-    void * lockMemory(bool write_access = false) {
-      unsigned int w = getActualWidth(), h = getActualHeight();
+    void resize(unsigned int _logical_width, unsigned int _logical_height, unsigned int _actual_width, unsigned int _actual_height, InternalFormat _format) override;
+    void * lockMemory(bool write_access = false) override;
+    void * lockMemoryPartial(unsigned int x0, unsigned int y0, unsigned int required_width, unsigned int required_height) override;
+
+    void releaseMemory() override {
+      Surface::releaseMemory();
       delete[] buffer;
-      buffer = new unsigned char[w * h * 4];
-      unsigned int offset = 0;
-      for (unsigned int y = 0; y < h; y++) {
-	for (unsigned int x = 0; x < w; x++) {
-	  int f = int((evaluate(x, y, 0) + 0.7) / 1.4 * 255);
-	  unsigned char v = f < 0 ? 0 : (f >= 255 ? 255 : (unsigned char)f);
-	  buffer[offset++] = v;
-	  buffer[offset++] = v;
-	  buffer[offset++] = v;
-	  buffer[offset++] = 255;
-	}
-      }
-      return buffer;
+      delete[] partial_buffer;
+      buffer = partial_buffer = 0;
     }
 
-    void releaseMemory() {
-      delete[] buffer;
-      buffer = 0;
+    void setOctaves(int _octaves) { if (_octaves != octaves) { octaves = _octaves; clearTiles(); } }
+    void setAlpha(float _alpha) { if (_alpha != alpha) { alpha = _alpha; clearTiles(); } }
+    void setBeta(float _beta) { if (_beta != beta) { beta = _beta; clearTiles(); } }
+    // The frequency of the first octave in cycles per pixel
+    void setFrequency(float _frequency) { if (_frequency != frequency) { frequency = _frequency; clearTiles(); } }
+    // Seed zero is the permutation of the reference implementation
+    void setSeed(unsigned int _seed);
+    void setNoiseType(NoiseType type) { if (type != noise_type) { noise_type = type; clearTiles(); } }
+    // The slice of the 3D noise that is drawn, e.g. for animation. Not used by NOISE_SIMPLEX_2D.
+    void setZ(float z) { if (z != slice) { slice = z; clearTiles(); } }
+    // Makes Perlin noise repeat after the given number of lattice cells of the first octave (at most 256),
+    // so that a surface of period / frequency pixels tiles seamlessly. Zero disables the wrap. The higher
+    // octaves wrap only if beta is an integer. Simplex noise is not periodic.
+    void setPeriod(unsigned int _period_x, unsigned int _period_y) {
+      if (_period_x != period_x || _period_y != period_y) {
+	period_x = _period_x;
+	period_y = _period_y;
+	clearTiles();
+      }
     }
 
+    int getOctaves() const { return octaves; }
+    float getAlpha() const { return alpha; }
+    float getBeta() const { return beta; }
+    float getFrequency() const { return frequency; }
+    unsigned int getSeed() const { return seed; }
+    NoiseType getNoiseType() const { return noise_type; }
+    float getZ() const { return slice; }
+    unsigned int getPeriodX() const { return period_x; }
+    unsigned int getPeriodY() const { return period_y; }
+
+    static const unsigned int TILE_SIZE = 64;
+
   protected:
     float evaluatePerlin(float x, float y, float z);
+    float evaluatePeriodicPerlin(float x, float y, float z, int px, int py);
+    float evaluateSimplex(float x, float y);
+    float evaluateSimplex(float x, float y, float z);
     float evaluate(float x, float y, float z);
+    // Evaluates n samples at x + i * dx. Uses SSE2 or AVX2 when available, except with USE_FIXEDPOINT.
+    void evaluateRow(float x, float y, float z, float dx, size_t n, float * output);
+
+    // Generates the missing tiles that intersect the given rectangle
+    void generateTiles(unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1);
+    void clearTiles();
+    void copyRegion(unsigned char * output, unsigned int x0, unsigned int y0, unsigned int w, unsigned int h) const;
     
   private:  
-    unsigned char * buffer = 0;
+    void initializePermutation();
+
+    unsigned char * buffer = 0, * partial_buffer = 0;
+    // The tiles keep one byte per pixel in row-major order, and missing tiles are null
+    std::vector<std::unique_ptr<unsigned char[]> > tiles;
+    unsigned int tiles_x = 0, tiles_y = 0;
 
     int octaves;
-    float alpha, beta;
+    float alpha, beta, frequency = 1.0f / 32, slice = 0;
+    unsigned int seed;
+    NoiseType noise_type = NOISE_PERLIN;
+    unsigned int period_x = 0, period_y = 0;
     int p[512];
 #ifdef USE_FIXEDPOINT
-    int * fadetbl;
-    int xftable[16], yftable[16], zftable[16];
+    int * fadetbl = 0;
 #endif
   };
 };
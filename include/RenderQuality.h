@@ -0,0 +1,15 @@
+#ifndef _CANVAS_RENDERQUALITY_H_
+#define _CANVAS_RENDERQUALITY_H_
+
+namespace canvas {
+  // Trades rendering quality for speed, e.g. for thumbnails and previews.
+  // The tier selects the antialiasing of shapes and text, the image filter,
+  // the blur used for shadows and the tolerance of curve flattening.
+  enum RenderQuality {
+    RENDER_FAST = 1,
+    RENDER_BALANCED,
+    RENDER_BEST
+  };
+};
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef _CANVAS_RESAMPLEFILTER_H_
+#define _CANVAS_RESAMPLEFILTER_H_
+
+namespace canvas {
+  enum ResampleFilter {
+    RESAMPLE_BOX = 1,
+    RESAMPLE_BILINEAR,
+    RESAMPLE_BICUBIC,
+    RESAMPLE_LANCZOS
+  };
+};
+
+#endif
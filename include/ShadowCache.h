@@ -0,0 +1,73 @@
+#ifndef _CANVAS_SHADOWCACHE_H_
+#define _CANVAS_SHADOWCACHE_H_
+
+#include <Surface.h>
+
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+namespace canvas {
+  // Blurred shadow masks of recently drawn shapes. The geometry is hashed
+  // relative to the mask origin, so a hit can be composited at any offset.
+  // The least recently used masks are evicted when the byte budget is exceeded.
+  class ShadowCache {
+  public:
+    struct Key {
+      uint64_t geometry;
+      float blur, displayScale, lineWidth;
+
+      bool operator==(const Key & other) const {
+	return geometry == other.geometry && blur == other.blur && displayScale == other.displayScale && lineWidth == other.lineWidth;
+      }
+    };
+
+    ShadowCache(size_t _max_bytes = 8 * 1024 * 1024) : max_bytes(_max_bytes) { }
+    ShadowCache(const ShadowCache & other) = delete;
+    ShadowCache & operator=(const ShadowCache & other) = delete;
+
+    // Returns the mask for the key or null, and counts the lookup as a hit or a miss
+    std::shared_ptr<Surface> get(const Key & key);
+    void put(const Key & key, const std::shared_ptr<Surface> & mask);
+    void clear();
+
+    void setMaxBytes(size_t _max_bytes);
+    size_t getMaxBytes() const { return max_bytes; }
+    size_t getBytes() const { return bytes; }
+    size_t size() const { return entries.size(); }
+    unsigned long long getHits() const { return hits; }
+    unsigned long long getMisses() const { return misses; }
+    void resetCounters() { hits = misses = 0; }
+
+    // FNV-1a, used for building the geometry hash
+    static uint64_t hash(const void * data, size_t size, uint64_t h = 14695981039346656037ULL) {
+      auto p = (const unsigned char *)data;
+      for (size_t i = 0; i < size; i++) {
+	h = (h ^ p[i]) * 1099511628211ULL;
+      }
+      return h;
+    }
+    template<class T> static uint64_t hashValue(const T & value, uint64_t h = 14695981039346656037ULL) { return hash(&value, sizeof(T), h); }
+
+  private:
+    struct KeyHash {
+      size_t operator()(const Key & key) const { return size_t(key.geometry); }
+    };
+    struct Entry {
+      Key key;
+      std::shared_ptr<Surface> mask;
+      size_t bytes;
+    };
+
+    void evict(size_t limit);
+
+    std::list<Entry> entries; // most recently used first
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+    size_t max_bytes, bytes = 0;
+    unsigned long long hits = 0, misses = 0;
+  };
+};
+
+#endif
@@ -11,6 +11,8 @@
 #include "Filter.h"
 
 namespace canvas {
+  class Image;
+
   class Style : public Attribute {
   public:
     enum StyleType {
@@ -20,12 +22,23 @@ namespace canvas {
       PATTERN,
       FILTER
     };
+    enum RepeatMode {
+      REPEAT = 1,
+      REPEAT_X,
+      REPEAT_Y,
+      NO_REPEAT
+    };
     Style(GraphicsState * _context) : Attribute(_context) { }
     Style(GraphicsState * _context, const Style & other)
       : Attribute(_context),
+      color(other.color),
+      x0(other.x0), y0(other.y0), x1(other.x1), y1(other.y1),
+      r0(other.r0), r1(other.r1),
       type(other.type),
       colors(other.colors),
-      filter(other.filter) { }
+      filter(other.filter),
+      image(other.image),
+      repeat(other.repeat) { }
     Style(const Style & other) = delete;
 #if 0
     Style(const std::string & s);
@@ -41,10 +54,10 @@ namespace canvas {
     void setType(StyleType _type) { type = _type; }
 
     void addColorStop(float f, const Color & c) {
-      colors[f] = c;
+      editColors()[f] = c;
     }
     void addColorStop(float f, const std::string & s) {
-      colors[f] = s;
+      editColors()[f] = s;
     }
     void setVector(double _x0, double _y0, double _x1, double _y1) {
       x0 = _x0;
@@ -52,16 +65,46 @@ namespace canvas {
       x1 = _x1;
       y1 = _y1;
     }
+    void setRadii(double _r0, double _r1) {
+      r0 = _r0;
+      r1 = _r1;
+    }
+    void setPattern(const std::shared_ptr<Image> & _image, RepeatMode _repeat) {
+      image = _image;
+      repeat = _repeat;
+    }
+    void setFilter(const std::shared_ptr<Filter> & _filter) { filter = _filter; }
+    void clearColorStops() { colors.reset(); }
 
-    const std::map<float, Color> & getColors() const { return colors; }
+    const std::map<float, Color> & getColors() const {
+      static const std::map<float, Color> empty_colors;
+      return colors ? *colors : empty_colors;
+    }
+    const std::shared_ptr<Image> & getImage() const { return image; }
+    RepeatMode getRepeat() const { return repeat; }
+    const std::shared_ptr<Filter> & getFilter() const { return filter; }
     
     Color color;
     double x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+    double r0 = 0, r1 = 0;
+
+  protected:
+    // Color stops are shared between copies and cloned on the first modification
+    std::map<float, Color> & editColors() {
+      if (!colors) {
+	colors = std::make_shared<std::map<float, Color> >();
+      } else if (colors.use_count() > 1) {
+	colors = std::make_shared<std::map<float, Color> >(*colors);
+      }
+      return *colors;
+    }
 
   private:
     StyleType type = SOLID;
-    std::map<float, Color> colors;
+    std::shared_ptr<std::map<float, Color> > colors;
     std::shared_ptr<Filter> filter;
+    std::shared_ptr<Image> image;
+    RepeatMode repeat = REPEAT;
   };
 };
 
@@ -5,10 +5,13 @@
 #include "FilterMode.h"
 #include "InternalFormat.h"
 #include "Path2D.h"
+#include "Matrix.h"
 #include "Style.h"
 #include "Font.h"
 #include "TextBaseline.h"
 #include "TextAlign.h"
+#include "ImageSmoothingQuality.h"
+#include "RenderQuality.h"
 #include "TextMetrics.h"
 #include "Operator.h"
 
@@ -52,27 +55,53 @@ namespace canvas {
     virtual void flush() { }
     virtual void markDirty() { }
 
+    virtual void setRenderQuality(RenderQuality quality) { render_quality = quality; }
+    RenderQuality getRenderQuality() const { return render_quality; }
+    // The blur threshold of the context, for the filters that the surface applies itself
+    void setBlurThreshold(float threshold) { blur_threshold = threshold; }
+    float getBlurThreshold() const { return blur_threshold; }
+    // The image smoothing quality limited by the render quality
+    ImageSmoothingQuality limitSmoothingQuality(ImageSmoothingQuality quality) const {
+      if (render_quality == RENDER_FAST) return SMOOTHING_LOW;
+      if (render_quality == RENDER_BALANCED && quality == SMOOTHING_HIGH) return SMOOTHING_MEDIUM;
+      return quality;
+    }
+
     // virtual Surface * copy() = 0;
     virtual void * lockMemory(bool write_access = false) = 0;
     virtual void * lockMemoryPartial(unsigned int x0, unsigned int y0, unsigned int required_width, unsigned int required_height);
+    // The distance in bytes between the rows of the memory returned by lockMemory
+    virtual unsigned int getStride() const;
     virtual void releaseMemory() {
       delete[] scaled_buffer;
       scaled_buffer = 0;
     }
 
     virtual void renderPath(RenderMode mode, const Path2D & path, const Style & style, float lineWidth, Operator op, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath) = 0;
+    // Renders a path whose coordinates are transformed by the given matrix at render time
+    virtual void renderPath(RenderMode mode, const Path2D & path, const Matrix & transform, const Style & style, float lineWidth, Operator op, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath);
     virtual void renderText(RenderMode mode, const Font & font, const Style & style, TextBaseline textBaseline, TextAlign textAlign, const std::string & text, const Point & p, float lineWidth, Operator op, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath) = 0;
     virtual TextMetrics measureText(const Font & font, const std::string & text, TextBaseline textBaseline, float displayScale) = 0;
 	  
-    virtual void drawImage(Surface & _img, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled = true) = 0;
-    virtual void drawImage(const Image & _img, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled = true) = 0;
+    virtual void drawImage(Surface & _img, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled = true, ImageSmoothingQuality imageSmoothingQuality = SMOOTHING_LOW) = 0;
+    virtual void drawImage(const Image & _img, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled = true, ImageSmoothingQuality imageSmoothingQuality = SMOOTHING_LOW) = 0;
+    // Composites the R8 coverage mask filled with a solid color onto the surface
+    virtual void drawMask(Surface & mask, const Point & p, double w, double h, const Color & color, float displayScale, float globalAlpha, const Path2D & clipPath);
+    // Fills the shape at each of the n points. colors is optional and gives a color for each instance.
+    virtual void drawMarkers(const Path2D & shape, const Style & style, const Point * points, size_t n, const Color * colors, float displayScale, float globalAlpha, const Path2D & clipPath);
+    // Fills an axis-aligned rectangle given in surface coordinates with a solid color
+    virtual void fillRect(double x, double y, double w, double h, const Color & color, Operator op, float displayScale, float globalAlpha, const Path2D & clipPath);
     
     // void colorFill(const Color & color);
     void slowBlur(float hradius, float vradius);
+    // Approximates slowBlur for large radii by blurring a downsampled copy
+    void pyramidBlur(float hradius, float vradius);
     void blur(float r);
+    // Writes the coverage of a rounded rectangle convolved with a Gaussian into an R8 surface.
+    // The coordinates are in pixels and sigma is the standard deviation of the Gaussian.
+    void fillBoxShadow(double x0, double y0, double x1, double y1, double radius, float sigma);
     void colorize(const Color & color, Surface & target);
-
-    // void multiply(const Color & color);
+    void multiply(const Color & color);
     
     std::shared_ptr<Image> createImage();
 
@@ -104,6 +133,8 @@ namespace canvas {
     FilterMode min_filter = LINEAR;
     InternalFormat format;
     InternalFormat target_format = NO_FORMAT;
+    RenderQuality render_quality = RENDER_BEST;
+    float blur_threshold = 16.0f;
     unsigned int * scaled_buffer = 0;
   };
 };
@@ -0,0 +1,75 @@
+#ifndef _CANVAS_THREADPOOL_H_
+#define _CANVAS_THREADPOOL_H_
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstddef>
+
+namespace canvas {
+  // Runs the background tasks of the library. An application with its own
+  // thread pool can implement this and install it with ThreadPool::setExecutor.
+  class Executor {
+  public:
+    virtual ~Executor() { }
+    // Number of tasks that can run at the same time in addition to the calling thread
+    virtual unsigned int getConcurrency() const = 0;
+    virtual void run(std::function<void()> task) = 0;
+  };
+
+  // A work stealing pool. Each worker has its own queue and takes the newest
+  // task from it, and steals the oldest task from the other queues when its
+  // own is empty. Tasks submitted from a worker go to the queue of that worker.
+  class ThreadPool : public Executor {
+  public:
+    // With zero threads, one less than the number of hardware threads is used
+    ThreadPool(unsigned int num_threads = 0);
+    ThreadPool(const ThreadPool & other) = delete;
+    ThreadPool & operator=(const ThreadPool & other) = delete;
+    ~ThreadPool();
+
+    unsigned int getConcurrency() const override { return (unsigned int)workers.size(); }
+    void run(std::function<void()> task) override;
+
+    // The executor used by the pixel operations. A null executor runs everything on the calling thread.
+    static std::shared_ptr<Executor> getExecutor();
+    static void setExecutor(const std::shared_ptr<Executor> & executor);
+    // Replaces the executor with a pool of the given number of worker threads. Zero picks
+    // the size from the hardware like the constructor, so it only means serial on one core.
+    static void setNumThreads(unsigned int num_threads);
+    // Removes the executor, so that everything runs on the calling thread
+    static void setSerial() { setExecutor(std::shared_ptr<Executor>()); }
+
+  private:
+    struct Worker {
+      std::mutex mutex;
+      std::deque<std::function<void()> > tasks;
+      std::thread thread;
+    };
+
+    bool takeTask(unsigned int index, std::function<void()> & task);
+    void workerLoop(unsigned int index);
+
+    std::vector<std::unique_ptr<Worker> > workers;
+    std::mutex mutex;
+    std::condition_variable cond;
+    size_t pending = 0;
+    bool stopping = false;
+    std::atomic<unsigned int> next_queue;
+  };
+
+  // Calls func for consecutive ranges that cover [begin, end) using the
+  // current executor. The range is split only if it is longer than grain, and
+  // the calling thread processes ranges too, so nested calls do not deadlock.
+  void parallelFor(size_t begin, size_t end, size_t grain, const std::function<void(size_t begin, size_t end)> & func);
+  // The number of rows of the given size in a band that stays in the cache, so
+  // that surfaces smaller than one band are processed serially
+  size_t getRowGrain(size_t row_bytes);
+};
+
+#endif
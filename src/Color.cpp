@@ -1,6 +1,8 @@
 #include <Color.h>
 
-#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
 
 using namespace canvas;
 
@@ -16,42 +18,508 @@ static int get_xdigit(char c) {
   } else if (c >= 'a' && c <= 'f') {
     return c - 'a' + 10;
   } else {
-    return 0;
+    return -1;
   }
 }
 
+static inline char to_lower(char c) {
+  return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+static inline bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+static inline float clamp01(double v) {
+  return v < 0.0 ? 0.0f : (v > 1.0 ? 1.0f : float(v));
+}
+
+// Case-insensitive FNV-1a
+static inline uint32_t hash_name(const char * s, size_t len, uint32_t seed) {
+  uint32_t h = 2166136261u ^ seed;
+  for (size_t i = 0; i < len; i++) {
+    h = (h ^ (unsigned char)to_lower(s[i])) * 16777619u;
+  }
+  return h;
+}
+
+// The named colors are placed with a two-level perfect hash: the name is first
+// hashed to a bucket, and the bucket's seed then gives a collision-free slot.
+// The seeds and the table were generated offline, and must be regenerated
+// together if the hash function changes.
+static const unsigned int NAMED_COLOR_BUCKETS = 64;
+static const unsigned int NAMED_COLOR_SLOTS = 256;
+static const size_t MAX_COLOR_NAME_LENGTH = 20;
+
+static const uint8_t named_color_seeds[NAMED_COLOR_BUCKETS] = {
+    0, 0, 0, 6, 1, 2, 1, 0, 2, 1, 2, 0, 2, 1, 2, 2,
+    4, 1, 3, 2, 2, 3, 1, 2, 4, 2, 1, 0, 2, 1, 1, 3,
+    3, 0, 1, 0, 4, 0, 1, 2, 1, 2, 1, 1, 1, 5, 1, 1,
+    5, 3, 5, 3, 8, 1, 1, 3, 0, 5, 1, 1, 1, 5, 1, 14,
+};
+
+static const struct {
+  const char * name;
+  uint32_t rgb;
+} named_colors[NAMED_COLOR_SLOTS] = {
+    { "mediumpurple", 0x9370db },
+    { "aquamarine", 0x7fffd4 },
+    { 0, 0 },
+    { "darkgrey", 0xa9a9a9 },
+    { "whitesmoke", 0xf5f5f5 },
+    { "lightgoldenrodyellow", 0xfafad2 },
+    { "lightcoral", 0xf08080 },
+    { 0, 0 },
+    { "linen", 0xfaf0e6 },
+    { "mediumturquoise", 0x48d1cc },
+    { "goldenrod", 0xdaa520 },
+    { "coral", 0xff7f50 },
+    { 0, 0 },
+    { "fuchsia", 0xff00ff },
+    { "thistle", 0xd8bfd8 },
+    { 0, 0 },
+    { "darkseagreen", 0x8fbc8f },
+    { 0, 0 },
+    { 0, 0 },
+    { "lightsteelblue", 0xb0c4de },
+    { "darkblue", 0x00008b },
+    { 0, 0 },
+    { "darkred", 0x8b0000 },
+    { 0, 0 },
+    { "blueviolet", 0x8a2be2 },
+    { "purple", 0x800080 },
+    { 0, 0 },
+    { "lightsalmon", 0xffa07a },
+    { "wheat", 0xf5deb3 },
+    { "lime", 0x00ff00 },
+    { "palevioletred", 0xdb7093 },
+    { 0, 0 },
+    { 0, 0 },
+    { "lemonchiffon", 0xfffacd },
+    { "khaki", 0xf0e68c },
+    { 0, 0 },
+    { 0, 0 },
+    { 0, 0 },
+    { 0, 0 },
+    { 0, 0 },
+    { "slategray", 0x708090 },
+    { "darkturquoise", 0x00ced1 },
+    { 0, 0 },
+    { "greenyellow", 0xadff2f },
+    { "darksalmon", 0xe9967a },
+    { "dimgrey", 0x696969 },
+    { 0, 0 },
+    { "chocolate", 0xd2691e },
+    { 0, 0 },
+    { "rosybrown", 0xbc8f8f },
+    { 0, 0 },
+    { 0, 0 },
+    { 0, 0 },
+    { "firebrick", 0xb22222 },
+    { "olivedrab", 0x6b8e23 },
+    { "dodgerblue", 0x1e90ff },
+    { 0, 0 },
+    { "saddlebrown", 0x8b4513 },
+    { "olive", 0x808000 },
+    { 0, 0 },
+    { 0, 0 },
+    { 0, 0 },
+    { "mediumaquamarine", 0x66cdaa },
+    { 0, 0 },
+    { 0, 0 },
+    { 0, 0 },
+    { 0, 0 },
+    { 0, 0 },
+    { 0, 0 },
+    { 0, 0 },
+    { 0, 0 },
+    { 0, 0 },
+    { "skyblue", 0x87ceeb },
+    { "lightskyblue", 0x87cefa },
+    { "indianred", 0xcd5c5c },
+    { "palegoldenrod", 0xeee8aa },
+    { 0, 0 },
+    { 0, 0 },
+    { "mediumseagreen", 0x3cb371 },
+    { "bisque", 0xffe4c4 },
+    { 0, 0 },
+    { "white", 0xffffff },
+    { 0, 0 },
+    { "lavender", 0xe6e6fa },
+    { 0, 0 },
+    { "turquoise", 0x40e0d0 },
+    { "plum", 0xdda0dd },
+    { "sandybrown", 0xf4a460 },
+    { "ghostwhite", 0xf8f8ff },
+    { 0, 0 },
+    { 0, 0 },
+    { "slategrey", 0x708090 },
+    { "teal", 0x008080 },
+    { 0, 0 },
+    { "lightcyan", 0xe0ffff },
+    { "grey", 0x808080 },
+    { "lightyellow", 0xffffe0 },
+    { 0, 0 },
+    { "yellowgreen", 0x9acd32 },
+    { "violet", 0xee82ee },
+    { "paleturquoise", 0xafeeee },
+    { 0, 0 },
+    { 0, 0 },
+    { "rebeccapurple", 0x663399 },
+    { "navy", 0x000080 },
+    { "springgreen", 0x00ff7f },
+    { 0, 0 },
+    { "gray", 0x808080 },
+    { "pink", 0xffc0cb },
+    { 0, 0 },
+    { 0, 0 },
+    { 0, 0 },
+    { 0, 0 },
+    { "ivory", 0xfffff0 },
+    { 0, 0 },
+    { 0, 0 },
+    { "mediumblue", 0x0000cd },
+    { 0, 0 },
+    { "cornflowerblue", 0x6495ed },
+    { "seashell", 0xfff5ee },
+    { 0, 0 },
+    { "moccasin", 0xffe4b5 },
+    { "blanchedalmond", 0xffebcd },
+    { "magenta", 0xff00ff },
+    { 0, 0 },
+    { 0, 0 },
+    { 0, 0 },
+    { 0, 0 },
+    { "deeppink", 0xff1493 },
+    { "slateblue", 0x6a5acd },
+    { "beige", 0xf5f5dc },
+    { "darkorchid", 0x9932cc },
+    { "hotpink", 0xff69b4 },
+    { "gold", 0xffd700 },
+    { "palegreen", 0x98fb98 },
+    { 0, 0 },
+    { "blue", 0x0000ff },
+    { 0, 0 },
+    { 0, 0 },
+    { 0, 0 },
+    { "darkolivegreen", 0x556b2f },
+    { 0, 0 },
+    { "lightpink", 0xffb6c1 },
+    { "darkcyan", 0x008b8b },
+    { "brown", 0xa52a2a },
+    { "azure", 0xf0ffff },
+    { "mistyrose", 0xffe4e1 },
+    { 0, 0 },
+    { "darkslategray", 0x2f4f4f },
+    { "orangered", 0xff4500 },
+    { 0, 0 },
+    { "darkviolet", 0x9400d3 },
+    { "gainsboro", 0xdcdcdc },
+    { 0, 0 },
+    { "indigo", 0x4b0082 },
+    { "darkgreen", 0x006400 },
+    { 0, 0 },
+    { 0, 0 },
+    { 0, 0 },
+    { 0, 0 },
+    { "black", 0x000000 },
+    { "crimson", 0xdc143c },
+    { "peachpuff", 0xffdab9 },
+    { "royalblue", 0x4169e1 },
+    { "seagreen", 0x2e8b57 },
+    { "mediumspringgreen", 0x00fa9a },
+    { "steelblue", 0x4682b4 },
+    { "papayawhip", 0xffefd5 },
+    { 0, 0 },
+    { "cadetblue", 0x5f9ea0 },
+    { 0, 0 },
+    { "cornsilk", 0xfff8dc },
+    { "mintcream", 0xf5fffa },
+    { "mediumslateblue", 0x7b68ee },
+    { "red", 0xff0000 },
+    { "burlywood", 0xdeb887 },
+    { "mediumorchid", 0xba55d3 },
+    { "navajowhite", 0xffdead },
+    { "darkorange", 0xff8c00 },
+    { 0, 0 },
+    { "midnightblue", 0x191970 },
+    { 0, 0 },
+    { "lavenderblush", 0xfff0f5 },
+    { 0, 0 },
+    { 0, 0 },
+    { "lightslategray", 0x778899 },
+    { 0, 0 },
+    { 0, 0 },
+    { 0, 0 },
+    { 0, 0 },
+    { "orange", 0xffa500 },
+    { "darkmagenta", 0x8b008b },
+    { 0, 0 },
+    { 0, 0 },
+    { 0, 0 },
+    { "darkslategrey", 0x2f4f4f },
+    { "yellow", 0xffff00 },
+    { 0, 0 },
+    { 0, 0 },
+    { 0, 0 },
+    { 0, 0 },
+    { "antiquewhite", 0xfaebd7 },
+    { "oldlace", 0xfdf5e6 },
+    { 0, 0 },
+    { "chartreuse", 0x7fff00 },
+    { "darkslateblue", 0x483d8b },
+    { 0, 0 },
+    { 0, 0 },
+    { "lightslategrey", 0x778899 },
+    { 0, 0 },
+    { 0, 0 },
+    { "cyan", 0x00ffff },
+    { "honeydew", 0xf0fff0 },
+    { "peru", 0xcd853f },
+    { "darkkhaki", 0xbdb76b },
+    { "lightgray", 0xd3d3d3 },
+    { "salmon", 0xfa8072 },
+    { 0, 0 },
+    { 0, 0 },
+    { "mediumvioletred", 0xc71585 },
+    { "floralwhite", 0xfffaf0 },
+    { 0, 0 },
+    { 0, 0 },
+    { 0, 0 },
+    { "lightseagreen", 0x20b2aa },
+    { "tomato", 0xff6347 },
+    { 0, 0 },
+    { "deepskyblue", 0x00bfff },
+    { 0, 0 },
+    { "powderblue", 0xb0e0e6 },
+    { 0, 0 },
+    { 0, 0 },
+    { 0, 0 },
+    { "lawngreen", 0x7cfc00 },
+    { 0, 0 },
+    { "snow", 0xfffafa },
+    { "tan", 0xd2b48c },
+    { "aliceblue", 0xf0f8ff },
+    { "sienna", 0xa0522d },
+    { "green", 0x008000 },
+    { 0, 0 },
+    { "dimgray", 0x696969 },
+    { "lightgrey", 0xd3d3d3 },
+    { "silver", 0xc0c0c0 },
+    { "lightblue", 0xadd8e6 },
+    { "forestgreen", 0x228b22 },
+    { "darkgoldenrod", 0xb8860b },
+    { "darkgray", 0xa9a9a9 },
+    { 0, 0 },
+    { "limegreen", 0x32cd32 },
+    { 0, 0 },
+    { "lightgreen", 0x90ee90 },
+    { "maroon", 0x800000 },
+    { 0, 0 },
+    { "aqua", 0x00ffff },
+    { "orchid", 0xda70d6 },
+};
+
+static bool lookup_named_color(const char * s, size_t len, uint32_t & rgb) {
+  if (len > MAX_COLOR_NAME_LENGTH) return false;
+  uint32_t seed = named_color_seeds[hash_name(s, len, 0) % NAMED_COLOR_BUCKETS];
+  auto & e = named_colors[hash_name(s, len, seed) % NAMED_COLOR_SLOTS];
+  if (!e.name || strlen(e.name) != len) return false;
+  for (size_t i = 0; i < len; i++) {
+    if (to_lower(s[i]) != e.name[i]) return false;
+  }
+  rgb = e.rgb;
+  return true;
+}
+
+static bool match_keyword(const char * s, size_t len, const char * keyword) {
+  size_t n = strlen(keyword);
+  if (len != n) return false;
+  for (size_t i = 0; i < n; i++) {
+    if (to_lower(s[i]) != keyword[i]) return false;
+  }
+  return true;
+}
+
+// Parses a number without locale dependency and advances p past it
+static bool parse_number(const char *& p, const char * end, double & v) {
+  const char * start = p;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+  double r = 0;
+  bool has_digits = false;
+  for (; p < end && *p >= '0' && *p <= '9'; p++) {
+    r = r * 10 + (*p - '0');
+    has_digits = true;
+  }
+  if (p < end && *p == '.') {
+    double f = 0.1;
+    for (p++; p < end && *p >= '0' && *p <= '9'; p++, f *= 0.1) {
+      r += (*p - '0') * f;
+      has_digits = true;
+    }
+  }
+  if (!has_digits) {
+    p = start;
+    return false;
+  }
+  if (p + 1 < end && (*p == 'e' || *p == 'E') && (p[1] == '-' || p[1] == '+' || (p[1] >= '0' && p[1] <= '9'))) {
+    const char * q = p + 1;
+    bool negative_exp = false;
+    if (*q == '-' || *q == '+') negative_exp = *q++ == '-';
+    int e = 0;
+    for (; q < end && *q >= '0' && *q <= '9'; q++) e = e * 10 + (*q - '0');
+    r *= pow(10.0, negative_exp ? -e : e);
+    p = q;
+  }
+  v = negative ? -r : r;
+  return true;
+}
+
+static bool parse_hex(const char * s, size_t len, float & red, float & green, float & blue, float & alpha) {
+  if (len != 3 && len != 4 && len != 6 && len != 8) return false;
+  int d[8];
+  for (size_t i = 0; i < len; i++) {
+    if ((d[i] = get_xdigit(s[i])) < 0) return false;
+  }
+  if (len <= 4) {
+    red = d[0] * 17 / 255.0f;
+    green = d[1] * 17 / 255.0f;
+    blue = d[2] * 17 / 255.0f;
+    alpha = len == 4 ? d[3] * 17 / 255.0f : 1.0f;
+  } else {
+    red = (d[0] * 16 + d[1]) / 255.0f;
+    green = (d[2] * 16 + d[3]) / 255.0f;
+    blue = (d[4] * 16 + d[5]) / 255.0f;
+    alpha = len == 8 ? (d[6] * 16 + d[7]) / 255.0f : 1.0f;
+  }
+  return true;
+}
+
+static float hue_to_rgb(float m1, float m2, float h) {
+  if (h < 0) h += 1;
+  if (h > 1) h -= 1;
+  if (h * 6 < 1) return m1 + (m2 - m1) * h * 6;
+  if (h * 2 < 1) return m2;
+  if (h * 3 < 2) return m1 + (m2 - m1) * (2.0f / 3.0f - h) * 6;
+  return m1;
+}
+
+// Parses the arguments of rgb(), rgba(), hsl() or hsla(). Both the comma
+// separated and the space separated syntax with a slash before alpha are accepted.
+static bool parse_function(const char * p, const char * end, bool is_hsl, float & red, float & green, float & blue, float & alpha) {
+  double values[4];
+  bool percent[4];
+  int n = 0;
+  while (1) {
+    while (p < end && is_space(*p)) p++;
+    if (p < end && *p == ')') break;
+    if (n == 4 || !parse_number(p, end, values[n])) return false;
+    percent[n] = false;
+    if (p < end && *p == '%') {
+      percent[n] = true;
+      p++;
+    } else if (is_hsl && n == 0) {
+      const char * unit = p;
+      while (p < end && ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z'))) p++;
+      if (match_keyword(unit, p - unit, "rad")) values[0] *= 180.0 / M_PI;
+      else if (match_keyword(unit, p - unit, "grad")) values[0] *= 0.9;
+      else if (match_keyword(unit, p - unit, "turn")) values[0] *= 360.0;
+      else if (p != unit && !match_keyword(unit, p - unit, "deg")) return false;
+    }
+    n++;
+    while (p < end && is_space(*p)) p++;
+    if (p < end && (*p == ',' || *p == '/')) p++;
+  }
+  if (n < 3 || p + 1 != end) return false;
+
+  alpha = n == 4 ? clamp01(percent[3] ? values[3] / 100.0 : values[3]) : 1.0f;
+  if (!is_hsl) {
+    red = clamp01(percent[0] ? values[0] / 100.0 : values[0] / 255.0);
+    green = clamp01(percent[1] ? values[1] / 100.0 : values[1] / 255.0);
+    blue = clamp01(percent[2] ? values[2] / 100.0 : values[2] / 255.0);
+  } else {
+    float h = float(fmod(values[0], 360.0) / 360.0);
+    if (h < 0) h += 1;
+    float sat = clamp01(values[1] / 100.0), light = clamp01(values[2] / 100.0);
+    float m2 = light <= 0.5f ? light * (sat + 1) : light + sat - light * sat;
+    float m1 = light * 2 - m2;
+    red = hue_to_rgb(m1, m2, h + 1.0f / 3.0f);
+    green = hue_to_rgb(m1, m2, h);
+    blue = hue_to_rgb(m1, m2, h - 1.0f / 3.0f);
+  }
+  return true;
+}
+
 Color &
 Color::operator=(const std::string & s) {
   setValue(s);
   return *this;
 }
 
+bool
+Color::parse(const char * s, size_t len) {
+  while (len && is_space(*s)) { s++; len--; }
+  while (len && is_space(s[len - 1])) len--;
+  if (!len) return false;
+
+  if (s[0] == '#') {
+    return parse_hex(s + 1, len - 1, red, green, blue, alpha);
+  }
+
+  const char * paren = (const char *)memchr(s, '(', len);
+  if (paren) {
+    size_t name_len = paren - s;
+    bool is_rgb = match_keyword(s, name_len, "rgb") || match_keyword(s, name_len, "rgba");
+    bool is_hsl = match_keyword(s, name_len, "hsl") || match_keyword(s, name_len, "hsla");
+    if (s[len - 1] != ')' || (!is_rgb && !is_hsl)) return false;
+    return parse_function(paren + 1, s + len, is_hsl, red, green, blue, alpha);
+  }
+
+  uint32_t rgb;
+  if (lookup_named_color(s, len, rgb)) {
+    *this = fromRGB(rgb);
+    return true;
+  } else if (match_keyword(s, len, "transparent")) {
+    *this = Color(0.0f, 0.0f, 0.0f, 0.0f);
+    return true;
+  }
+  // hex digits without the hash
+  return parse_hex(s, len, red, green, blue, alpha);
+}
+
+// A small direct-mapped cache of recently parsed strings, since the same
+// color strings are typically assigned over and over again
+static const unsigned int COLOR_CACHE_SIZE = 64;
+static const size_t MAX_CACHED_LENGTH = 31;
+
+struct ColorCacheEntry {
+  unsigned char length;
+  char key[MAX_CACHED_LENGTH];
+  Color color;
+};
+
+static thread_local ColorCacheEntry color_cache[COLOR_CACHE_SIZE];
+
 void
 Color::setValue(const std::string & s) {
-  if (s == "black") {
-    red = green = blue = 0;
-    alpha = 1.0f;
-  } else if (s == "white") {
-    red = green = blue = alpha = 1.0f;
-  } else if (s.compare(0, 5, "rgba(") == 0) {
-    assert(0);    
-  } else {
-    unsigned int pos = 0;
-    if (s.size() && s[0] == '#') pos++;
-    if (s.size() >= pos + 6) {
-      red = (get_xdigit(s[pos]) * 16 + get_xdigit(s[pos+1])) / 255.0f;
-      green = (get_xdigit(s[pos+2]) * 16 + get_xdigit(s[pos+3])) / 255.0f;
-      blue = (get_xdigit(s[pos+4]) * 16 + get_xdigit(s[pos+5])) / 255.0f;
-    } else if (s.size() >= pos + 3) {
-      int r = get_xdigit(s[pos]);
-      int g = get_xdigit(s[pos+1]);
-      int b = get_xdigit(s[pos+2]);
-      red = (r * 16 + r) / 255.0f;
-      green = (g * 16 + g) / 255.0f;
-      blue = (b * 16 + b) / 255.0f;
-    } else {
-      red = green = blue = 0;
+  ColorCacheEntry * entry = 0;
+  if (s.size() && s.size() <= MAX_CACHED_LENGTH) {
+    entry = &color_cache[hash_name(s.data(), s.size(), 0) % COLOR_CACHE_SIZE];
+    if (entry->length == s.size() && memcmp(entry->key, s.data(), s.size()) == 0) {
+      *this = entry->color;
+      return;
     }
-    alpha = 1.0f;
+  }
+  // an invalid color is ignored, and parse may have written part of the value
+  Color parsed;
+  if (!parsed.parse(s.data(), s.size())) {
+    return;
+  }
+  *this = parsed;
+  if (entry) {
+    entry->length = (unsigned char)s.size();
+    memcpy(entry->key, s.data(), s.size());
+    entry->color = *this;
   }
 }
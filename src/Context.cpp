@@ -1,6 +1,7 @@
 #include <Context.h>
 
 #include <cmath>
+#include <algorithm>
 #include <iostream>
 
 using namespace std;
@@ -12,53 +13,94 @@ Context::resize(unsigned int _width, unsigned int _height) {
   hit_regions.clear();
 }
 
+Path2D
+Context::createRect(double x, double y, double w, double h) const {
+  Path2D path;
+  path.moveTo(currentTransform.multiply(x, y));
+  path.lineTo(currentTransform.multiply(x + w, y));
+  path.lineTo(currentTransform.multiply(x + w, y + h));
+  path.lineTo(currentTransform.multiply(x, y + h));
+  path.closePath();
+  return path;
+}
+
+// Rectangles under a translate/scale-only transform are passed to the
+// surface as rectangles, bypassing the path pipeline
+bool
+Context::fillAxisAlignedRect(double x, double y, double w, double h, const Color & color, Operator op) {
+  if (!currentTransform.isAxisAligned()) {
+    return false;
+  }
+  Point p0 = currentTransform.multiply(x, y), p1 = currentTransform.multiply(x + w, y + h);
+  double x0 = p0.x < p1.x ? p0.x : p1.x, y0 = p0.y < p1.y ? p0.y : p1.y;
+  getDefaultSurface().fillRect(x0, y0, fabs(p1.x - p0.x), fabs(p1.y - p0.y), color, op, getDisplayScale(), op == COPY ? 1.0f : globalAlpha.getValue(), clipPath);
+  return true;
+}
+
+Context &
+Context::drawMarkers(const Path2D & shape, const Style & style, const Point * points, size_t n, const Color * colors) {
+  std::vector<Point> transformed_points;
+  transformed_points.reserve(n);
+  for (size_t i = 0; i < n; i++) {
+    transformed_points.push_back(currentTransform.multiply(points[i]));
+  }
+  Operator op = globalCompositeOperation.getValue();
+  if ((hasShadow() && !hasNativeShadows()) || (filter && !filter->empty()) || op != SOURCE_OVER) {
+    // shadows, filters and other operators need the full pipeline for each instance
+    Style instance_style(this, style);
+    for (size_t i = 0; i < n; i++) {
+      if (colors) instance_style = colors[i];
+      const Point & p = transformed_points[i];
+      renderPath(FILL, shape, instance_style, Matrix(1.0, 0.0, 0.0, 1.0, p.x, p.y), op);
+    }
+  } else {
+    getDefaultSurface().drawMarkers(shape, style, transformed_points.data(), n, colors, getDisplayScale(), globalAlpha.getValue(), clipPath);
+  }
+  return *this;
+}
+
 Context &
 Context::fillRect(double x, double y, double w, double h) {
-  beginPath().rect(x, y, w, h);
-  return fill();
+  Operator op = globalCompositeOperation.getValue();
+  if (op == SOURCE_OVER && fillStyle.getType() == Style::SOLID && !hasShadow() && (!filter || filter->empty()) && fillAxisAlignedRect(x, y, w, h, fillStyle.color, op)) {
+    return *this;
+  }
+  return renderPath(FILL, createRect(x, y, w, h), fillStyle, op);
 } 
 
 Context &
 Context::strokeRect(double x, double y, double w, double h) {
-  beginPath().rect(x, y, w, h);
-  return stroke();
+  return renderPath(STROKE, createRect(x, y, w, h), strokeStyle, globalCompositeOperation.getValue());
 }
 
 Context &
 Context::clearRect(double x, double y, double w, double h) {
-  Path2D path;
-  path.moveTo(currentTransform.multiply(x, y));
-  path.lineTo(currentTransform.multiply(x + w, y));
-  path.lineTo(currentTransform.multiply(x + w, y + h));
-  path.lineTo(currentTransform.multiply(x, y + h));
-  path.closePath();
+  if (fillAxisAlignedRect(x, y, w, h, Color(0.0f, 0.0f, 0.0f, 0.0f), COPY)) {
+    return *this;
+  }
   Style style(this);
   style = Color(0.0f, 0.0f, 0.0f, 0.0f);
-  return renderPath(FILL, path, style, COPY);
+  return renderPath(FILL, createRect(x, y, w, h), style, COPY);
 }
 
 Context &
 Context::renderText(RenderMode mode, const Style & style, const std::string & text, const Point & p, Operator op) {
-  if (hasNativeShadows()) {
+  if (filter && !filter->empty()) {
+    if (hasShadow()) {
+      renderTextShadow(mode, text, p);
+    }
+    double x0, y0, x1, y1;
+    getTextExtents(mode, text, p, x0, y0, x1, y1);
+    renderFiltered(x0, y0, x1, y1, [&](Surface & layer, double offset_x, double offset_y) {
+	Style layer_style(this, style);
+	layer_style.setVector(style.x0 + offset_x, style.y0 + offset_y, style.x1 + offset_x, style.y1 + offset_y);
+	layer.renderText(mode, font, layer_style, textBaseline.getValue(), textAlign.getValue(), text, Point(p.x + offset_x, p.y + offset_y), lineWidth.getValue(), SOURCE_OVER, getDisplayScale(), 1.0f, 0.0f, 0.0f, 0.0f, shadowColor.getValue(), Path2D());
+      });
+  } else if (hasNativeShadows()) {
     getDefaultSurface().renderText(mode, font, style, textBaseline.getValue(), textAlign.getValue(), text, p, lineWidth.getValue(), op, getDisplayScale(), globalAlpha.getValue(), shadowBlur.getValue(), shadowOffsetX.getValue(), shadowOffsetY.getValue(), shadowColor.getValue(), clipPath);
   } else {
     if (hasShadow()) {
-      float b = shadowBlur.getValue(), bs = shadowBlur.getValue() * getDisplayScale();
-      int bi = int(ceil(b));
-      auto shadow = createSurface(getDefaultSurface().getLogicalWidth() + 2 * bi, getDefaultSurface().getLogicalHeight() + 2 * bi, R8);
-      auto shadow2 = createSurface(getDefaultSurface().getLogicalWidth() + 2 * bi, getDefaultSurface().getLogicalHeight() + 2 * bi, RGBA8);
-
-      Style shadow_style(this);
-      shadow_style = shadowColor.getValue();
-      shadow_style.color.alpha = 1.0f;
-      shadow->renderText(mode, font, shadow_style, textBaseline.getValue(), textAlign.getValue(), text, Point(p.x + shadowOffsetX.getValue() + b, p.y + shadowOffsetY.getValue() + b), lineWidth.getValue(), op, getDisplayScale(), globalAlpha.getValue(), 0.0f, 0.0f, 0.0f, shadowColor.getValue(), clipPath);
-#if 1
-      shadow->slowBlur(bs, bs);
-#else
-      shadow->blur(bs);
-#endif
-      shadow->colorize(shadowColor.getValue(), *shadow2);
-      getDefaultSurface().drawImage(*shadow2, Point(-b, -b), shadow2->getLogicalWidth(), shadow2->getLogicalHeight(), getDisplayScale(), 1.0f, 0.0f, 0.0f, 0.0f, shadowColor.getValue(), Path2D(), false);
+      renderTextShadow(mode, text, p);
     }
     getDefaultSurface().renderText(mode, font, style, textBaseline.getValue(), textAlign.getValue(), text, p, lineWidth.getValue(), op, getDisplayScale(), globalAlpha.getValue(), 0.0f, 0.0f, 0.0f, shadowColor.getValue(), clipPath);
   }
@@ -66,31 +108,25 @@ Context::renderText(RenderMode mode, const Style & style, const std::string & te
 }
 
 Context &
-Context::renderPath(RenderMode mode, const Path2D & path, const Style & style, Operator op) {
-  if (hasNativeShadows()) {
-    getDefaultSurface().renderPath(mode, path, style, lineWidth.getValue(), op, getDisplayScale(), globalAlpha.getValue(), shadowBlur.getValue(), shadowOffsetX.getValue(), shadowOffsetY.getValue(), shadowColor.getValue(), clipPath);
+Context::renderPath(RenderMode mode, const Path2D & path, const Style & style, const Matrix & transform, Operator op) {
+  if (filter && !filter->empty()) {
+    if (hasShadow()) {
+      renderPathShadow(mode, path, transform);
+    }
+    double x0, y0, x1, y1;
+    getPathExtents(mode, path, transform, x0, y0, x1, y1);
+    renderFiltered(x0, y0, x1, y1, [&](Surface & layer, double offset_x, double offset_y) {
+	Style layer_style(this, style);
+	layer_style.setVector(style.x0 + offset_x, style.y0 + offset_y, style.x1 + offset_x, style.y1 + offset_y);
+	layer.renderPath(mode, path, Matrix(1.0, 0.0, 0.0, 1.0, offset_x, offset_y) * transform, layer_style, lineWidth.getValue(), SOURCE_OVER, getDisplayScale(), 1.0f, 0, 0, 0, shadowColor.getValue(), Path2D());
+      });
+  } else if (hasNativeShadows()) {
+    getDefaultSurface().renderPath(mode, path, transform, style, lineWidth.getValue(), op, getDisplayScale(), globalAlpha.getValue(), shadowBlur.getValue(), shadowOffsetX.getValue(), shadowOffsetY.getValue(), shadowColor.getValue(), clipPath);
   } else {
     if (hasShadow()) {
-      float b = shadowBlur.getValue(), bs = shadowBlur.getValue() * getDisplayScale();
-      float bi = int(ceil(b));
-      auto shadow = createSurface(getDefaultSurface().getLogicalWidth() + 2 * bi, getDefaultSurface().getLogicalHeight() + 2 * bi, R8);
-      auto shadow2 = createSurface(getDefaultSurface().getLogicalWidth() + 2 * bi, getDefaultSurface().getLogicalHeight() + 2 * bi, RGBA8);
-      Style shadow_style(this);
-      shadow_style = shadowColor.getValue();
-      Path2D tmp_path = path, tmp_clipPath = clipPath;
-      tmp_path.offset(shadowOffsetX.getValue() + bi, shadowOffsetY.getValue() + bi);
-      tmp_clipPath.offset(shadowOffsetX.getValue() + bi, shadowOffsetY.getValue() + bi);
-      
-      shadow->renderPath(mode, tmp_path, shadow_style, lineWidth.getValue(), op, getDisplayScale(), globalAlpha.getValue(), 0, 0, 0, shadowColor.getValue(), tmp_clipPath);
-#if 1
-      shadow->slowBlur(bs, bs);
-#else
-      shadow->blur(bs);
-#endif
-      shadow->colorize(shadowColor.getValue(), *shadow2);
-      getDefaultSurface().drawImage(*shadow2, Point(-b, -b), shadow2->getLogicalWidth(), shadow2->getLogicalHeight(), getDisplayScale(), 1.0f, 0.0f, 0.0f, 0.0f, shadowColor.getValue(), Path2D(), false);
+      renderPathShadow(mode, path, transform);
     }
-    getDefaultSurface().renderPath(mode, path, style, lineWidth.getValue(), op, getDisplayScale(), globalAlpha.getValue(), 0, 0, 0, shadowColor.getValue(), clipPath);
+    getDefaultSurface().renderPath(mode, path, transform, style, lineWidth.getValue(), op, getDisplayScale(), globalAlpha.getValue(), 0, 0, 0, shadowColor.getValue(), clipPath);
   }
   return *this;
 }
@@ -98,26 +134,20 @@ Context::renderPath(RenderMode mode, const Path2D & path, const Style & style, O
 Context &
 Context::drawImage(Surface & img, double x, double y, double w, double h) {
   Point p = currentTransform.multiply(x, y);
-  if (hasNativeShadows()) {
-    getDefaultSurface().drawImage(img, p, w, h, getDisplayScale(), globalAlpha.getValue(), shadowBlur.getValue(), shadowOffsetX.getValue(), shadowOffsetY.getValue(), shadowColor.getValue(), clipPath, imageSmoothingEnabled.getValue());
+  if (filter && !filter->empty()) {
+    if (hasShadow()) {
+      renderImageShadow(img, p, w, h);
+    }
+    renderFiltered(p.x, p.y, p.x + w, p.y + h, [&](Surface & layer, double offset_x, double offset_y) {
+	layer.drawImage(img, Point(p.x + offset_x, p.y + offset_y), w, h, getDisplayScale(), 1.0f, 0.0f, 0.0f, 0.0f, shadowColor.getValue(), Path2D(), imageSmoothingEnabled.getValue(), imageSmoothingQuality.getValue());
+      });
+  } else if (hasNativeShadows()) {
+    getDefaultSurface().drawImage(img, p, w, h, getDisplayScale(), globalAlpha.getValue(), shadowBlur.getValue(), shadowOffsetX.getValue(), shadowOffsetY.getValue(), shadowColor.getValue(), clipPath, imageSmoothingEnabled.getValue(), imageSmoothingQuality.getValue());
   } else {
     if (hasShadow()) {
-      float b = shadowBlur.getValue(), bs = shadowBlur.getValue() * getDisplayScale();
-      float bi = int(ceil(b));
-      auto shadow = createSurface(getDefaultSurface().getLogicalWidth() + 2 * bi, getDefaultSurface().getLogicalHeight() + 2 * bi, R8);
-      auto shadow2 = createSurface(getDefaultSurface().getLogicalWidth() + 2 * bi, getDefaultSurface().getLogicalHeight() + 2 * bi, RGBA8);
-
-      shadow->drawImage(img, Point(p.x + b + shadowOffsetX.getValue(), p.y + b + shadowOffsetY.getValue()), w, h, getDisplayScale(), globalAlpha.getValue(), 0.0f, 0.0f, 0.0f, shadowColor.getValue(), clipPath, imageSmoothingEnabled.getValue());
-      // shadow->colorFill(shadowColor.getValue());
-#if 1
-      shadow->slowBlur(bs, bs);
-#else
-      shadow->blur(bs);
-#endif
-      shadow->colorize(shadowColor.getValue(), *shadow2);
-      getDefaultSurface().drawImage(*shadow2, Point(-b, -b), shadow2->getLogicalWidth(), shadow2->getLogicalHeight(), getDisplayScale(), 1.0f, 0.0f, 0.0f, 0.0f, shadowColor.getValue(), Path2D(), false);
+      renderImageShadow(img, p, w, h);
     }
-    getDefaultSurface().drawImage(img, p, w, h, getDisplayScale(), globalAlpha.getValue(), 0.0f, 0.0f, 0.0f, shadowColor.getValue(), clipPath, imageSmoothingEnabled.getValue());
+    getDefaultSurface().drawImage(img, p, w, h, getDisplayScale(), globalAlpha.getValue(), 0.0f, 0.0f, 0.0f, shadowColor.getValue(), clipPath, imageSmoothingEnabled.getValue(), imageSmoothingQuality.getValue());
   }
   return *this;
 }
@@ -125,30 +155,236 @@ Context::drawImage(Surface & img, double x, double y, double w, double h) {
 Context &
 Context::drawImage(const Image & img, double x, double y, double w, double h) {
   Point p = currentTransform.multiply(x, y);
-  if (hasNativeShadows()) {
-    getDefaultSurface().drawImage(img, p, w, h, getDisplayScale(), globalAlpha.getValue(), shadowBlur.getValue(), shadowOffsetX.getValue(), shadowOffsetY.getValue(), shadowColor.getValue(), clipPath, imageSmoothingEnabled.getValue());
+  if (filter && !filter->empty()) {
+    if (hasShadow()) {
+      renderImageShadow(img, p, w, h);
+    }
+    renderFiltered(p.x, p.y, p.x + w, p.y + h, [&](Surface & layer, double offset_x, double offset_y) {
+	layer.drawImage(img, Point(p.x + offset_x, p.y + offset_y), w, h, getDisplayScale(), 1.0f, 0.0f, 0.0f, 0.0f, shadowColor.getValue(), Path2D(), imageSmoothingEnabled.getValue(), imageSmoothingQuality.getValue());
+      });
+  } else if (hasNativeShadows()) {
+    getDefaultSurface().drawImage(img, p, w, h, getDisplayScale(), globalAlpha.getValue(), shadowBlur.getValue(), shadowOffsetX.getValue(), shadowOffsetY.getValue(), shadowColor.getValue(), clipPath, imageSmoothingEnabled.getValue(), imageSmoothingQuality.getValue());
   } else {
     if (hasShadow()) {
-      float b = shadowBlur.getValue(), bs = shadowBlur.getValue() * getDisplayScale();
-      float bi = int(ceil(b));
-      auto shadow = createSurface(getDefaultSurface().getLogicalWidth() + 2 * bi, getDefaultSurface().getLogicalHeight() + 2 * bi, R8);
-      auto shadow2 = createSurface(getDefaultSurface().getLogicalWidth() + 2 * bi, getDefaultSurface().getLogicalHeight() + 2 * bi, RGBA8);
-
-      shadow->drawImage(img, Point(x + b + shadowOffsetX.getValue(), y + b + shadowOffsetY.getValue()), w, h, getDisplayScale(), globalAlpha.getValue(), 0.0f, 0.0f, 0.0f, shadowColor.getValue(), clipPath, imageSmoothingEnabled.getValue());
-      // shadow->colorFill(shadowColor.getValue());
-#if 1
-      shadow->slowBlur(bs, bs);
-#else
-      shadow->blur(bs);
-#endif
-      shadow->colorize(shadowColor.getValue(), *shadow2);
-      getDefaultSurface().drawImage(*shadow2, Point(-b, -b), shadow2->getLogicalWidth(), shadow2->getLogicalHeight(), getDisplayScale(), 1.0f, 0.0f, 0.0f, 0.0f, shadowColor.getValue(), Path2D(), false);
+      renderImageShadow(img, p, w, h);
     }
-    getDefaultSurface().drawImage(img, p, w, h, getDisplayScale(), globalAlpha.getValue(), 0.0f, 0.0f, 0.0f, shadowColor.getValue(), clipPath, imageSmoothingEnabled.getValue());
+    getDefaultSurface().drawImage(img, p, w, h, getDisplayScale(), globalAlpha.getValue(), 0.0f, 0.0f, 0.0f, shadowColor.getValue(), clipPath, imageSmoothingEnabled.getValue(), imageSmoothingQuality.getValue());
   }
   return *this;
 }
 
+// The box is conservative since it covers every alignment and baseline
+void
+Context::getTextExtents(RenderMode mode, const std::string & text, const Point & p, double & min_x, double & min_y, double & max_x, double & max_y) {
+  float size = font.size, lw = mode == STROKE ? lineWidth.getValue() : 0.0f;
+  float w = measureText(text).width + 0.25f * size + lw;
+  float h = 1.5f * size + lw;
+  min_x = p.x - w;
+  min_y = p.y - h;
+  max_x = p.x + w;
+  max_y = p.y + h;
+}
+
+// Device space bounds from the transformed corners of the path extents
+void
+Context::getPathExtents(RenderMode mode, const Path2D & path, const Matrix & transform, double & min_x, double & min_y, double & max_x, double & max_y) const {
+  double x0, y0, x1, y1;
+  path.getExtents(x0, y0, x1, y1);
+  Point corners[] = {
+    transform.multiply(x0, y0), transform.multiply(x1, y0),
+    transform.multiply(x0, y1), transform.multiply(x1, y1)
+  };
+  min_x = max_x = corners[0].x;
+  min_y = max_y = corners[0].y;
+  for (auto & c : corners) {
+    min_x = std::min(min_x, c.x);
+    min_y = std::min(min_y, c.y);
+    max_x = std::max(max_x, c.x);
+    max_y = std::max(max_y, c.y);
+  }
+  // miter joins reach up to half the line width times the miter limit (10 by default)
+  double pad = 1.0 + (mode == STROKE ? 5.0 * lineWidth.getValue() * getDisplayScale() : 0.0);
+  min_x -= pad;
+  min_y -= pad;
+  max_x += pad;
+  max_y += pad;
+}
+
+void
+Context::renderTextShadow(RenderMode mode, const std::string & text, const Point & p) {
+  double x0, y0, x1, y1;
+  getTextExtents(mode, text, p, x0, y0, x1, y1);
+  uint64_t geometry = ShadowCache::hash(text.data(), text.size());
+  geometry = ShadowCache::hash(font.family.data(), font.family.size(), geometry);
+  geometry = ShadowCache::hashValue(font.size, geometry);
+  geometry = ShadowCache::hashValue(int(font.style) | (int(font.weight.getValue()) << 4) | (int(mode) << 8), geometry);
+  geometry = ShadowCache::hashValue(int(textAlign.getValue()) | (int(textBaseline.getValue()) << 8), geometry);
+  renderShadow(x0, y0, x1, y1, geometry, [&](Surface & shadow, const Style & shadow_style, double offset_x, double offset_y) {
+      shadow.renderText(mode, font, shadow_style, textBaseline.getValue(), textAlign.getValue(), text, Point(p.x + offset_x, p.y + offset_y), lineWidth.getValue(), SOURCE_OVER, getDisplayScale(), 1.0f, 0.0f, 0.0f, 0.0f, shadowColor.getValue(), Path2D());
+    });
+}
+
+void
+Context::renderPathShadow(RenderMode mode, const Path2D & path, const Matrix & transform) {
+  if (renderBoxShadow(mode, path, transform)) {
+    return;
+  }
+  double min_x, min_y, max_x, max_y;
+  path.getExtents(min_x, min_y, max_x, max_y);
+  // the shape is hashed relative to its extents together with the linear part of the transform
+  uint64_t geometry = ShadowCache::hashValue(int(mode), ShadowCache::hashValue(path.getData().size()));
+  for (auto & pc : path.getData()) {
+    double v[] = { pc.x0 - min_x, pc.y0 - min_y, pc.radius, pc.sa, pc.ea, double(pc.type * 2 + (pc.anticlockwise ? 1 : 0)) };
+    geometry = ShadowCache::hash(v, sizeof(v), geometry);
+  }
+  double m[] = { transform.getA(), transform.getB(), transform.getC(), transform.getD() };
+  geometry = ShadowCache::hash(m, sizeof(m), geometry);
+  double x0, y0, x1, y1;
+  getPathExtents(mode, path, transform, x0, y0, x1, y1);
+  renderShadow(x0, y0, x1, y1, geometry, [&](Surface & shadow, const Style & shadow_style, double offset_x, double offset_y) {
+      shadow.renderPath(mode, path, Matrix(1.0, 0.0, 0.0, 1.0, offset_x, offset_y) * transform, shadow_style, lineWidth.getValue(), SOURCE_OVER, getDisplayScale(), 1.0f, 0, 0, 0, shadowColor.getValue(), Path2D());
+    });
+}
+
+void
+Context::renderImageShadow(Surface & img, const Point & p, double w, double h) {
+  renderShadow(p.x, p.y, p.x + w, p.y + h, 0, [&](Surface & shadow, const Style & shadow_style, double offset_x, double offset_y) {
+      shadow.drawImage(img, Point(p.x + offset_x, p.y + offset_y), w, h, getDisplayScale(), 1.0f, 0.0f, 0.0f, 0.0f, shadowColor.getValue(), Path2D(), imageSmoothingEnabled.getValue(), imageSmoothingQuality.getValue());
+    });
+}
+
+void
+Context::renderImageShadow(const Image & img, const Point & p, double w, double h) {
+  renderShadow(p.x, p.y, p.x + w, p.y + h, 0, [&](Surface & shadow, const Style & shadow_style, double offset_x, double offset_y) {
+      shadow.drawImage(img, Point(p.x + offset_x, p.y + offset_y), w, h, getDisplayScale(), 1.0f, 0.0f, 0.0f, 0.0f, shadowColor.getValue(), Path2D(), imageSmoothingEnabled.getValue(), imageSmoothingQuality.getValue());
+    });
+}
+
+// The draw call goes into a transparent layer that covers its bounds and the
+// outset of the filter. The filtered layer is composited with the global
+// alpha and the clip, but the composite operator is not applied. Gradients
+// are moved with the layer, while patterns stay anchored to its origin.
+void
+Context::renderFiltered(double min_x, double min_y, double max_x, double max_y, const std::function<void(Surface & layer, double offset_x, double offset_y)> & render) {
+  auto & surface = getDefaultSurface();
+  int outset = filter->getOutset();
+  int x0 = std::max(int(floor(min_x)) - outset, -outset);
+  int y0 = std::max(int(floor(min_y)) - outset, -outset);
+  int x1 = std::min(int(ceil(max_x)) + outset, int(surface.getLogicalWidth()) + outset);
+  int y1 = std::min(int(ceil(max_y)) + outset, int(surface.getLogicalHeight()) + outset);
+  if (x0 >= x1 || y0 >= y1) {
+    return;
+  }
+  auto layer = createSurface(x1 - x0, y1 - y0, RGBA8);
+  layer->setRenderQuality(render_quality);
+  layer->setBlurThreshold(getBlurThreshold());
+  render(*layer, -x0, -y0);
+  filter->apply(*layer, getBlurThreshold());
+  surface.drawImage(*layer, Point(x0, y0), layer->getLogicalWidth(), layer->getLogicalHeight(), getDisplayScale(), globalAlpha.getValue(), 0.0f, 0.0f, 0.0f, shadowColor.getValue(), clipPath, false);
+}
+
+// Rectangles and rounded rectangles under an axis-aligned transform get an
+// analytic shadow, which needs neither a rasterized shape nor blur passes
+bool
+Context::renderBoxShadow(RenderMode mode, const Path2D & path, const Matrix & transform) {
+  float bs = shadowBlur.getValue() * getDisplayScale();
+  if (mode != FILL || bs < 1.0f || !transform.isAxisAligned()) {
+    return false;
+  }
+  double x0, y0, x1, y1, radius = 0;
+  if (!path.isRect(x0, y0, x1, y1)) {
+    // corners stay circular only under uniform scaling
+    if (fabs(transform.getA()) != fabs(transform.getD()) || !path.isRoundedRect(x0, y0, x1, y1, radius)) {
+      return false;
+    }
+    radius *= fabs(transform.getA());
+  }
+  Point p0 = transform.multiply(x0, y0), p1 = transform.multiply(x1, y1);
+  x0 = std::min(p0.x, p1.x);
+  y0 = std::min(p0.y, p1.y);
+  x1 = std::max(p0.x, p1.x);
+  y1 = std::max(p0.y, p1.y);
+  // the same standard deviation as the kernel of slowBlur
+  float sigma = bs / 3.0f;
+  renderShadow(x0, y0, x1, y1, 0, [&](Surface & shadow, const Style & shadow_style, double offset_x, double offset_y) {
+      shadow.fillBoxShadow(x0 + offset_x, y0 + offset_y, x1 + offset_x, y1 + offset_y, radius, sigma);
+    }, true);
+  return true;
+}
+
+// Lower quality tiers switch to the pyramid blur at smaller radii
+float
+Context::getBlurThreshold() const {
+  switch (render_quality) {
+  case RENDER_FAST: return 0.0f;
+  case RENDER_BALANCED: return std::min(pyramid_blur_threshold, 4.0f);
+  default: return pyramid_blur_threshold;
+  }
+}
+
+void
+Context::renderShadow(double min_x, double min_y, double max_x, double max_y, uint64_t geometry, const std::function<void(Surface & shadow, const Style & shadow_style, double offset_x, double offset_y)> & render, bool prefiltered) {
+  auto & surface = getDefaultSurface();
+  float b = shadowBlur.getValue(), bs = b * getDisplayScale();
+  int bi = int(ceil(b)) + 1;
+
+  // the mask is aligned to whole pixels and the remaining fraction is part of the key
+  double x = min_x + shadowOffsetX.getValue(), y = min_y + shadowOffsetY.getValue();
+  double fx = x - floor(x), fy = y - floor(y);
+  int mask_x0 = int(floor(x)) - bi, mask_y0 = int(floor(y)) - bi;
+  int mask_x1 = int(floor(x)) + int(ceil(max_x - min_x + fx)) + bi;
+  int mask_y1 = int(floor(y)) + int(ceil(max_y - min_y + fy)) + bi;
+
+  int canvas_w = surface.getLogicalWidth(), canvas_h = surface.getLogicalHeight();
+  if (mask_x0 >= canvas_w || mask_y0 >= canvas_h || mask_x1 <= 0 || mask_y1 <= 0) {
+    return;
+  }
+  // masks reaching far outside the canvas are cropped and not cached
+  if (mask_x0 < -bi || mask_y0 < -bi || mask_x1 > canvas_w + bi || mask_y1 > canvas_h + bi) {
+    mask_x0 = std::max(mask_x0, -bi);
+    mask_y0 = std::max(mask_y0, -bi);
+    mask_x1 = std::min(mask_x1, canvas_w + bi);
+    mask_y1 = std::min(mask_y1, canvas_h + bi);
+    geometry = 0;
+  }
+
+  ShadowCache::Key key = { ShadowCache::hashValue(fy, ShadowCache::hashValue(fx, geometry)), b, getDisplayScale(), lineWidth.getValue() };
+  std::shared_ptr<Surface> shadow;
+  if (geometry) {
+    shadow = shadow_cache.get(key);
+  }
+  if (!shadow) {
+    shadow = createSurface(mask_x1 - mask_x0, mask_y1 - mask_y0, R8);
+    shadow->setRenderQuality(render_quality);
+    // the shape is drawn opaque and unclipped, and the alpha, color and clip are applied when compositing
+    Style shadow_style(this);
+    shadow_style = Color(0.0f, 0.0f, 0.0f, 1.0f);
+    render(*shadow, shadow_style, shadowOffsetX.getValue() - mask_x0, shadowOffsetY.getValue() - mask_y0);
+    if (prefiltered) {
+      // already blurred
+    } else if (bs > getBlurThreshold()) {
+      shadow->pyramidBlur(bs, bs);
+    } else {
+      shadow->slowBlur(bs, bs);
+    }
+    if (geometry) {
+      shadow_cache.put(key, shadow);
+    }
+  }
+  surface.drawMask(*shadow, Point(mask_x0, mask_y0), shadow->getLogicalWidth(), shadow->getLogicalHeight(), shadowColor.getValue(), getDisplayScale(), globalAlpha.getValue(), clipPath);
+}
+
+Style &
+Context::createPattern(const std::shared_ptr<Image> & image, const std::string & repeat) {
+  Style::RepeatMode mode = Style::REPEAT;
+  if (repeat == "repeat-x") mode = Style::REPEAT_X;
+  else if (repeat == "repeat-y") mode = Style::REPEAT_Y;
+  else if (repeat == "no-repeat") mode = Style::NO_REPEAT;
+  current_pattern.setType(Style::PATTERN);
+  current_pattern.setPattern(image, mode);
+  return current_pattern;
+}
+
 Context &
 Context::save() {
   restore_stack.push_back(*this);
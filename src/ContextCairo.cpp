@@ -1,7 +1,13 @@
 #include <ContextCairo.h>
 
+#include "PixelKernels.h"
+#include "Resampler.h"
+
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 
 using namespace canvas;
@@ -118,6 +124,8 @@ CairoSurface::CairoSurface(const unsigned char * buffer, size_t size) : Surface(
 }
 
 CairoSurface::~CairoSurface() {
+  clearMarkerStamps();
+  clearPatternCache();
   if (cr) {
     cairo_destroy(cr);
   }
@@ -137,6 +145,7 @@ void
 CairoSurface::markDirty() {
   assert(surface);
   cairo_surface_mark_dirty(surface);
+  clearMipmaps();
 }
 
 void
@@ -146,26 +155,25 @@ CairoSurface::resize(unsigned int _logical_width, unsigned int _logical_height,
     cairo_destroy(cr);
     cr = 0;
   }
+  current_clip.clear();
+  clip_is_rect = false;
+  clearMipmaps();
   if (surface) cairo_surface_destroy(surface);  
   surface = cairo_image_surface_create(getCairoFormat(getFormat()), _actual_width, _actual_height);
   assert(surface);
 } 
 
-void
-CairoSurface::sendPath(const Path2D & path) {
-  initializeContext();
-
-  cairo_new_path(cr);
-  for (auto pc : path.getData()) {
+static void emitPath(cairo_t * cr, const Path2D & path, double offset) {
+  for (auto & pc : path.getData()) {
     switch (pc.type) {
-    case PathComponent::MOVE_TO: cairo_move_to(cr, pc.x0 + 0.5, pc.y0 + 0.5); break;
-    case PathComponent::LINE_TO: cairo_line_to(cr, pc.x0 + 0.5, pc.y0 + 0.5); break;
+    case PathComponent::MOVE_TO: cairo_move_to(cr, pc.x0 + offset, pc.y0 + offset); break;
+    case PathComponent::LINE_TO: cairo_line_to(cr, pc.x0 + offset, pc.y0 + offset); break;
     case PathComponent::CLOSE: cairo_close_path(cr); break;
     case PathComponent::ARC:
       if (!pc.anticlockwise) {
-	cairo_arc(cr, pc.x0 + 0.5, pc.y0 + 0.5, pc.radius, pc.sa, pc.ea);
+	cairo_arc(cr, pc.x0 + offset, pc.y0 + offset, pc.radius, pc.sa, pc.ea);
       } else {
-	cairo_arc_negative(cr, pc.x0 + 0.5, pc.y0 + 0.5, pc.radius, pc.sa, pc.ea);
+	cairo_arc_negative(cr, pc.x0 + offset, pc.y0 + offset, pc.radius, pc.sa, pc.ea);
       }
       break;
     }
@@ -173,36 +181,335 @@ CairoSurface::sendPath(const Path2D & path) {
 }
 
 void
-CairoSurface::renderPath(RenderMode mode, const Path2D & path, const Style & style, float lineWidth, Operator op, float displayScale, float globalAlpha, float sadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath) {
+CairoSurface::sendPath(const Path2D & path, const Matrix & transform) {
   initializeContext();
 
+  cairo_new_path(cr);
+
+  // The path is stored in device space as it is built, so applying the
+  // transform through the Cairo matrix leaves the line width unaffected
+  if (!transform.isIdentity()) {
+    cairo_matrix_t m;
+    cairo_matrix_init(&m, transform.getA(), transform.getB(), transform.getC(), transform.getD(), transform.getE() + 0.5, transform.getF() + 0.5);
+    cairo_save(cr);
+    cairo_transform(cr, &m);
+    emitPath(cr, path, 0.0);
+    cairo_restore(cr);
+  } else {
+    emitPath(cr, path, 0.5);
+  }
+}
+
+static inline bool isIntegral(double v) {
+  return v == floor(v);
+}
+
+// The clip is resolved once and left active in the Cairo context until a
+// draw call arrives with a different clip path. Pixel-aligned rectangles are
+// sent as boxes, which Cairo handles as a plain scissor; other shapes are
+// rasterized into a coverage mask that Cairo keeps with the clip.
+void
+CairoSurface::setClip(const Path2D & clipPath) {
+  initializeContext();
+
+  if (clipPath == current_clip) {
+    return;
+  }
+  if (!current_clip.empty()) {
+    cairo_reset_clip(cr);
+  }
+  current_clip = clipPath;
+  clip_is_rect = false;
+  
   if (!clipPath.empty()) {
-    sendPath(clipPath);
+    double min_x, min_y, max_x, max_y;
+    if (clipPath.isRect(min_x, min_y, max_x, max_y) &&
+	isIntegral(min_x + 0.5) && isIntegral(min_y + 0.5) && isIntegral(max_x + 0.5) && isIntegral(max_y + 0.5)) {
+      clip_is_rect = true;
+      clip_x0 = int(min_x + 0.5);
+      clip_y0 = int(min_y + 0.5);
+      clip_x1 = int(max_x + 0.5);
+      clip_y1 = int(max_y + 0.5);
+      cairo_new_path(cr);
+      cairo_rectangle(cr, clip_x0, clip_y0, clip_x1 - clip_x0, clip_y1 - clip_y0);
+    } else {
+      sendPath(clipPath);
+    }
+    // the clip is rasterized with the current antialias, which an aligned fillRect may have turned off
+    setAntialias(getQualityAntialias());
     cairo_clip(cr);
   }
+}
 
+static cairo_operator_t getCairoOperator(Operator op) {
   switch (op) {
-  case SOURCE_OVER: cairo_set_operator(cr, CAIRO_OPERATOR_OVER); break;
-  case COPY: cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE); break;
+  case SOURCE_OVER: return CAIRO_OPERATOR_OVER;
+  case COPY: return CAIRO_OPERATOR_SOURCE;
+  case SOURCE_IN: return CAIRO_OPERATOR_IN;
+  case SOURCE_OUT: return CAIRO_OPERATOR_OUT;
+  case SOURCE_ATOP: return CAIRO_OPERATOR_ATOP;
+  case DESTINATION_OVER: return CAIRO_OPERATOR_DEST_OVER;
+  case DESTINATION_IN: return CAIRO_OPERATOR_DEST_IN;
+  case DESTINATION_OUT: return CAIRO_OPERATOR_DEST_OUT;
+  case DESTINATION_ATOP: return CAIRO_OPERATOR_DEST_ATOP;
+  case XOR: return CAIRO_OPERATOR_XOR;
+  case LIGHTER: return CAIRO_OPERATOR_ADD;
+  case CLEAR: return CAIRO_OPERATOR_CLEAR;
+  case MULTIPLY: return CAIRO_OPERATOR_MULTIPLY;
+  case SCREEN: return CAIRO_OPERATOR_SCREEN;
+  case OVERLAY: return CAIRO_OPERATOR_OVERLAY;
+  case DARKEN: return CAIRO_OPERATOR_DARKEN;
+  case LIGHTEN: return CAIRO_OPERATOR_LIGHTEN;
+  case COLOR_DODGE: return CAIRO_OPERATOR_COLOR_DODGE;
+  case COLOR_BURN: return CAIRO_OPERATOR_COLOR_BURN;
+  case HARD_LIGHT: return CAIRO_OPERATOR_HARD_LIGHT;
+  case SOFT_LIGHT: return CAIRO_OPERATOR_SOFT_LIGHT;
+  case DIFFERENCE: return CAIRO_OPERATOR_DIFFERENCE;
+  case EXCLUSION: return CAIRO_OPERATOR_EXCLUSION;
   }
-  
-  cairo_pattern_t * pat = 0;
-  if (style.getType() == Style::LINEAR_GRADIENT) {
-    pat = cairo_pattern_create_linear(style.x0 * displayScale, style.y0 * displayScale, style.x1 * displayScale, style.y1 * displayScale);
-    for (map<float, Color>::const_iterator it = style.getColors().begin(); it != style.getColors().end(); it++) {
-      cairo_pattern_add_color_stop_rgba(pat, it->first, it->second.red, it->second.green, it->second.blue, it->second.alpha * globalAlpha);
+  return CAIRO_OPERATOR_OVER;
+}
+
+void
+CairoSurface::setOperator(Operator op) {
+  cairo_operator_t cairo_op = getCairoOperator(op);
+  if (cairo_op != applied_operator) {
+    cairo_set_operator(cr, cairo_op);
+    applied_operator = cairo_op;
+  }
+}
+
+void
+CairoSurface::setSourceColor(const Color & color, float globalAlpha) {
+  float alpha = color.alpha * globalAlpha;
+  if (!has_source_color || color.red != source_red || color.green != source_green || color.blue != source_blue || alpha != source_alpha) {
+    cairo_set_source_rgba(cr, color.red, color.green, color.blue, alpha);
+    has_source_color = true;
+    source_red = color.red;
+    source_green = color.green;
+    source_blue = color.blue;
+    source_alpha = alpha;
+  }
+}
+
+void
+CairoSurface::setSourcePattern(cairo_pattern_t * pattern) {
+  cairo_set_source(cr, pattern);
+  has_source_color = false;
+}
+
+void
+CairoSurface::setLineWidth(double width) {
+  if (width != applied_line_width) {
+    cairo_set_line_width(cr, width);
+    applied_line_width = width;
+  }
+}
+
+void
+CairoSurface::setAntialias(cairo_antialias_t antialias) {
+  if (antialias != applied_antialias) {
+    cairo_set_antialias(cr, antialias);
+    applied_antialias = antialias;
+  }
+}
+
+cairo_antialias_t
+CairoSurface::getQualityAntialias() const {
+  switch (getRenderQuality()) {
+  case RENDER_FAST: return CAIRO_ANTIALIAS_FAST;
+  case RENDER_BALANCED: return CAIRO_ANTIALIAS_GOOD;
+  default: return CAIRO_ANTIALIAS_BEST;
+  }
+}
+
+double
+CairoSurface::getQualityTolerance() const {
+  switch (getRenderQuality()) {
+  case RENDER_FAST: return 0.5;
+  case RENDER_BALANCED: return 0.25;
+  default: return 0.1; // Cairo default
+  }
+}
+
+void
+CairoSurface::setRenderQuality(RenderQuality quality) {
+  if (quality == getRenderQuality()) return;
+  Surface::setRenderQuality(quality);
+  if (cr) {
+    setAntialias(getQualityAntialias());
+    cairo_set_tolerance(cr, getQualityTolerance());
+  }
+  has_font_options = false; // the font options depend on the quality
+  clearMarkerStamps();
+}
+
+void
+CairoSurface::setFont(const Font & font, float displayScale) {
+  cairo_font_slant_t slant = font.style == Font::NORMAL_STYLE ? CAIRO_FONT_SLANT_NORMAL : (font.style == Font::ITALIC ? CAIRO_FONT_SLANT_ITALIC : CAIRO_FONT_SLANT_OBLIQUE);
+  cairo_font_weight_t weight = font.weight.isBold() ? CAIRO_FONT_WEIGHT_BOLD : CAIRO_FONT_WEIGHT_NORMAL;
+  if (!has_font || slant != font_slant || weight != font_weight || font.family != font_family) {
+    cairo_select_font_face(cr, font.family.c_str(), slant, weight);
+    font_family = font.family;
+    font_slant = slant;
+    font_weight = weight;
+    font_size = 0; // selecting the face resets the size
+    has_font = true;
+  }
+  if (!has_font_options || font.antialiasing != font_antialiasing || font.hinting != font_hinting || font.cleartype != font_cleartype) {
+    // Subpixel antialiasing and unhinted metrics are used only at the best quality
+    cairo_font_options_t * options = cairo_font_options_create();
+    RenderQuality quality = getRenderQuality();
+    if (!font.antialiasing) {
+      cairo_font_options_set_antialias(options, CAIRO_ANTIALIAS_NONE);
+    } else if (font.cleartype && quality == RENDER_BEST) {
+      cairo_font_options_set_antialias(options, CAIRO_ANTIALIAS_SUBPIXEL);
+    } else {
+      cairo_font_options_set_antialias(options, CAIRO_ANTIALIAS_GRAY);
+    }
+    if (!font.hinting) {
+      cairo_font_options_set_hint_style(options, CAIRO_HINT_STYLE_NONE);
+    } else {
+      cairo_font_options_set_hint_style(options, quality == RENDER_FAST ? CAIRO_HINT_STYLE_FULL : CAIRO_HINT_STYLE_SLIGHT);
+    }
+    cairo_font_options_set_hint_metrics(options, quality == RENDER_BEST ? CAIRO_HINT_METRICS_OFF : CAIRO_HINT_METRICS_ON);
+    cairo_set_font_options(cr, options);
+    cairo_font_options_destroy(options);
+    font_antialiasing = font.antialiasing;
+    font_hinting = font.hinting;
+    font_cleartype = font.cleartype;
+    has_font_options = true;
+  }
+  double size = font.size * displayScale;
+  if (size != font_size) {
+    cairo_set_font_size(cr, size);
+    font_size = size;
+  }
+}
+
+cairo_pattern_t *
+CairoSurface::getPattern(const Style & style, float displayScale, float globalAlpha) {
+  unsigned int image_id = style.getType() == Style::PATTERN && style.getImage() ? style.getImage()->getId() : 0;
+  pattern_clock++;
+  for (auto & e : pattern_cache) {
+    if (e.type == style.getType() && e.displayScale == displayScale && e.globalAlpha == globalAlpha &&
+	e.x0 == style.x0 && e.y0 == style.y0 && e.x1 == style.x1 && e.y1 == style.y1 &&
+	e.r0 == style.r0 && e.r1 == style.r1 && e.image_id == image_id && e.repeat == style.getRepeat() &&
+	e.colors == style.getColors()) {
+      e.last_used = pattern_clock;
+      return e.pattern;
+    }
+  }
+
+  CachedPattern e;
+  e.type = style.getType();
+  e.x0 = style.x0;
+  e.y0 = style.y0;
+  e.x1 = style.x1;
+  e.y1 = style.y1;
+  e.r0 = style.r0;
+  e.r1 = style.r1;
+  e.displayScale = displayScale;
+  e.globalAlpha = globalAlpha;
+  e.colors = style.getColors();
+  e.image_id = image_id;
+  e.repeat = style.getRepeat();
+  e.last_used = pattern_clock;
+
+  if (e.type == Style::PATTERN) {
+    if (style.getImage()) {
+      e.image_surface = std::make_shared<CairoSurface>(*style.getImage());
+      e.pattern = cairo_pattern_create_for_surface(e.image_surface->surface);
+    } else {
+      e.pattern = cairo_pattern_create_rgba(0, 0, 0, 0);
+    }
+    // the image is in logical pixels
+    cairo_matrix_t matrix;
+    cairo_matrix_init_scale(&matrix, 1.0 / displayScale, 1.0 / displayScale);
+    cairo_pattern_set_matrix(e.pattern, &matrix);
+    cairo_pattern_set_extend(e.pattern, e.repeat == Style::NO_REPEAT ? CAIRO_EXTEND_NONE : CAIRO_EXTEND_REPEAT);
+  } else {
+    if (e.type == Style::RADIAL_GRADIENT) {
+      e.pattern = cairo_pattern_create_radial(e.x0 * displayScale, e.y0 * displayScale, e.r0 * displayScale, e.x1 * displayScale, e.y1 * displayScale, e.r1 * displayScale);
+    } else {
+      e.pattern = cairo_pattern_create_linear(e.x0 * displayScale, e.y0 * displayScale, e.x1 * displayScale, e.y1 * displayScale);
+    }
+    for (auto & cs : e.colors) {
+      cairo_pattern_add_color_stop_rgba(e.pattern, cs.first, cs.second.red, cs.second.green, cs.second.blue, cs.second.alpha * globalAlpha);
+    }
+  }
+
+  if (pattern_cache.size() < PATTERN_CACHE_SIZE) {
+    pattern_cache.push_back(e);
+    return e.pattern;
+  }
+  auto it = std::min_element(pattern_cache.begin(), pattern_cache.end(), [](const CachedPattern & a, const CachedPattern & b) { return a.last_used < b.last_used; });
+  cairo_pattern_destroy(it->pattern);
+  *it = e;
+  return e.pattern;
+}
+
+void
+CairoSurface::clearPatternCache() {
+  for (auto & e : pattern_cache) {
+    cairo_pattern_destroy(e.pattern);
+  }
+  pattern_cache.clear();
+}
+
+void
+CairoSurface::renderPath(RenderMode mode, const Path2D & path, const Style & style, float lineWidth, Operator op, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath) {
+  renderPath(mode, path, Matrix(), style, lineWidth, op, displayScale, globalAlpha, shadowBlur, shadowOffsetX, shadowOffsetY, shadowColor, clipPath);
+}
+
+void
+CairoSurface::renderPath(RenderMode mode, const Path2D & path, const Matrix & transform, const Style & style, float lineWidth, Operator op, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath) {
+  initializeContext();
+  clearMipmaps();
+  setClip(clipPath);
+
+  setOperator(op);
+  setAntialias(getQualityAntialias());
+  if (mode == STROKE) {
+    setLineWidth(lineWidth * displayScale);
+  }
+
+  bool use_group = false, clip_band = false;
+  if (style.getType() == Style::LINEAR_GRADIENT || style.getType() == Style::RADIAL_GRADIENT || style.getType() == Style::PATTERN) {
+    setSourcePattern(getPattern(style, displayScale, globalAlpha));
+    if (style.getType() == Style::PATTERN) {
+      // gradients have the alpha in their stops, patterns are composited through a group
+      use_group = globalAlpha < 1.0f;
+      clip_band = style.getRepeat() == Style::REPEAT_X || style.getRepeat() == Style::REPEAT_Y;
     }
-    cairo_set_source(cr, pat);    
   } else if (style.getType() == Style::FILTER) {
-    double min_x, min_y, max_x, max_y;
-    path.getExtents(min_x, min_y, max_x, max_y);
+    // the pixels under the shape are replaced with a filtered copy of themselves
+    if (!style.getFilter() || !setFilteredSource(path, transform, *style.getFilter(), mode == STROKE ? lineWidth * displayScale : 0.0)) {
+      return;
+    }
+    setOperator(COPY);
   } else {
-    cairo_set_source_rgba(cr, style.color.red, style.color.green, style.color.blue, style.color.alpha * globalAlpha);
+    setSourceColor(style.color, globalAlpha);
   }
-  sendPath(path);
+
+  if (clip_band) {
+    // Cairo can only repeat in both directions, so the other direction is clipped to a single tile
+    cairo_save(cr);
+    auto & img = *style.getImage();
+    if (style.getRepeat() == Style::REPEAT_X) {
+      cairo_rectangle(cr, 0, 0, getActualWidth(), img.getHeight() * displayScale);
+    } else {
+      cairo_rectangle(cr, 0, 0, img.getWidth() * displayScale, getActualHeight());
+    }
+    cairo_clip(cr);
+  }
+  if (use_group) {
+    cairo_push_group(cr);
+  }
+  
+  sendPath(path, transform);
   switch (mode) {
   case STROKE:
-    cairo_set_line_width(cr, lineWidth * displayScale);
     // cairo_set_line_join(cr, CAIRO_LINE_JOIN_ROUND);
     cairo_stroke(cr);  
     break;
@@ -210,35 +517,263 @@ CairoSurface::renderPath(RenderMode mode, const Path2D & path, const Style & sty
     cairo_fill(cr);
     break;
   }
-  
-  if (pat) {
-    cairo_pattern_destroy(pat);
-    cairo_set_source_rgb(cr, 0.0, 0.0, 0.0);
+
+  if (use_group) {
+    cairo_pop_group_to_source(cr);
+    cairo_paint_with_alpha(cr, globalAlpha);
   }
-  if (!clipPath.empty()) {
-    cairo_reset_clip(cr);
+  if (clip_band) {
+    cairo_restore(cr);
   }
 }
 
+// The copy covers the extents of the shape and the outset of the filter, so
+// that for example a blur can read the pixels around the shape
+bool
+CairoSurface::setFilteredSource(const Path2D & path, const Matrix & transform, const Filter & filter, double pad) {
+  if (cairo_image_surface_get_format(surface) != CAIRO_FORMAT_ARGB32 || path.empty()) {
+    return false;
+  }
+  double x0, y0, x1, y1;
+  path.getExtents(x0, y0, x1, y1);
+  Point corners[] = {
+    transform.multiply(x0, y0), transform.multiply(x1, y0),
+    transform.multiply(x0, y1), transform.multiply(x1, y1)
+  };
+  double min_x = corners[0].x, min_y = corners[0].y, max_x = min_x, max_y = min_y;
+  for (auto & c : corners) {
+    min_x = std::min(min_x, c.x);
+    min_y = std::min(min_y, c.y);
+    max_x = std::max(max_x, c.x);
+    max_y = std::max(max_y, c.y);
+  }
+  int outset = filter.getOutset() + int(ceil(pad)) + 1;
+  int ix0 = std::max(int(floor(min_x)) - outset, 0);
+  int iy0 = std::max(int(floor(min_y)) - outset, 0);
+  int ix1 = std::min(int(ceil(max_x)) + outset, int(getActualWidth()));
+  int iy1 = std::min(int(ceil(max_y)) + outset, int(getActualHeight()));
+  if (ix0 >= ix1 || iy0 >= iy1) {
+    return false;
+  }
+
+  unsigned int w = ix1 - ix0, h = iy1 - iy0;
+  CairoSurface tmp(w, h, w, h, RGBA8);
+  flush();
+  const unsigned char * src = cairo_image_surface_get_data(surface);
+  int stride = cairo_image_surface_get_stride(surface);
+  unsigned char * dst = (unsigned char *)tmp.lockMemory(true);
+  for (unsigned int row = 0; row < h; row++) {
+    memcpy(dst + row * w * 4, src + (iy0 + row) * stride + ix0 * 4, w * 4);
+  }
+  tmp.releaseMemory();
+  filter.apply(tmp, getBlurThreshold());
+
+  // the pattern keeps its own reference to the copy
+  cairo_set_source_surface(cr, tmp.surface, ix0, iy0);
+  has_source_color = false;
+  return true;
+}
+
 void
-CairoSurface::renderText(RenderMode mode, const Font & font, const Style & style, TextBaseline textBaseline, TextAlign textAlign, const std::string & text, const Point & p, float lineWidth, Operator op, float displayScale, float alpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath) {
+CairoSurface::fillRect(double x, double y, double w, double h, const Color & color, Operator op, float displayScale, float globalAlpha, const Path2D & clipPath) {
   initializeContext();
+  clearMipmaps();
+  setClip(clipPath);
+
+  // Same half pixel offset as in sendPath(): coordinates are pixel centers, so
+  // a rectangle covers whole pixels only when its edges are at half-integer
+  // coordinates, e.g. fillRect(9.5, 9.5, 10, 10) fills pixels 10 to 19.
+  // Integer coordinates half cover the edge pixels and go through cairo_fill.
+  double x0 = x + 0.5, y0 = y + 0.5, x1 = x + w + 0.5, y1 = y + h + 0.5;
+  bool is_aligned = isIntegral(x0) && isIntegral(y0) && isIntegral(x1) && isIntegral(y1);
+  float alpha = color.alpha * globalAlpha;
+  cairo_format_t format = cairo_image_surface_get_format(surface);
+
+  if (is_aligned && (clipPath.empty() || clip_is_rect) && (op == COPY || (op == SOURCE_OVER && alpha >= 1.0f)) &&
+      (format == CAIRO_FORMAT_ARGB32 || format == CAIRO_FORMAT_RGB24 || format == CAIRO_FORMAT_A8)) {
+    // Opaque or copied pixel-aligned rectangles are written directly into the surface memory
+    int ix0 = std::max(int(x0), 0), iy0 = std::max(int(y0), 0);
+    int ix1 = std::min(int(x1), cairo_image_surface_get_width(surface));
+    int iy1 = std::min(int(y1), cairo_image_surface_get_height(surface));
+    if (clip_is_rect) {
+      ix0 = std::max(ix0, clip_x0);
+      iy0 = std::max(iy0, clip_y0);
+      ix1 = std::min(ix1, clip_x1);
+      iy1 = std::min(iy1, clip_y1);
+    }
+    if (ix0 >= ix1 || iy0 >= iy1) {
+      return;
+    }
+    
+    cairo_surface_flush(surface);
+    unsigned char * data = cairo_image_surface_get_data(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+    unsigned int a = (unsigned int)(alpha * 255.0f + 0.5f);
+    if (format == CAIRO_FORMAT_A8) {
+      for (int row = iy0; row < iy1; row++) {
+	memset(data + row * stride + ix0, a, ix1 - ix0);
+      }
+    } else {
+      // Cairo uses premultiplied native endian ARGB
+      unsigned int r = (unsigned int)(color.red * alpha * 255.0f + 0.5f);
+      unsigned int g = (unsigned int)(color.green * alpha * 255.0f + 0.5f);
+      unsigned int b = (unsigned int)(color.blue * alpha * 255.0f + 0.5f);
+      uint32_t pixel = (a << 24) | (r << 16) | (g << 8) | b;
+      for (int row = iy0; row < iy1; row++) {
+	uint32_t * ptr = (uint32_t *)(data + row * stride) + ix0;
+	std::fill(ptr, ptr + (ix1 - ix0), pixel);
+      }
+    }
+    cairo_surface_mark_dirty_rectangle(surface, ix0, iy0, ix1 - ix0, iy1 - iy0);
+    return;
+  }
 
-  if (!clipPath.empty()) {
-    sendPath(clipPath);
-    cairo_clip(cr);
+  setOperator(op);
+  setSourceColor(color, globalAlpha);
+  cairo_new_path(cr);
+  cairo_rectangle(cr, x0, y0, w, h);
+  setAntialias(is_aligned ? CAIRO_ANTIALIAS_NONE : getQualityAntialias());
+  cairo_fill(cr);
+  if (is_aligned) {
+    // clips and text strokes rely on the quality antialias being in place
+    setAntialias(getQualityAntialias());
   }
+}
 
-  switch (op) {
-  case SOURCE_OVER: cairo_set_operator(cr, CAIRO_OPERATOR_OVER); break;
-  case COPY: cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE); break;
+void
+CairoSurface::clearMarkerStamps() {
+  for (auto & stamp : marker_stamps) {
+    if (stamp) {
+      cairo_surface_destroy(stamp);
+      stamp = 0;
+    }
+  }
+  marker_shape.clear();
+}
+
+// Returns the coverage of the shape rasterized at the given subpixel phase.
+// Stamps are created lazily and kept until a different shape is drawn.
+cairo_surface_t *
+CairoSurface::getMarkerStamp(const Path2D & shape, unsigned int phase) {
+  if (shape != marker_shape) {
+    clearMarkerStamps();
+    marker_shape = shape;
+    double min_x, min_y, max_x, max_y;
+    shape.getExtents(min_x, min_y, max_x, max_y);
+    // one pixel of margin for antialiasing and one for the subpixel offset
+    marker_x0 = int(floor(min_x)) - 1;
+    marker_y0 = int(floor(min_y)) - 1;
+    marker_width = int(ceil(max_x)) + 3 - marker_x0;
+    marker_height = int(ceil(max_y)) + 3 - marker_y0;
+  }
+  cairo_surface_t * & stamp = marker_stamps[phase];
+  if (!stamp) {
+    stamp = cairo_image_surface_create(CAIRO_FORMAT_A8, marker_width, marker_height);
+    cairo_t * stamp_cr = cairo_create(stamp);
+    cairo_set_antialias(stamp_cr, getQualityAntialias());
+    cairo_set_tolerance(stamp_cr, getQualityTolerance());
+    double dx = double(phase % MARKER_SUBPIXELS) / MARKER_SUBPIXELS, dy = double(phase / MARKER_SUBPIXELS) / MARKER_SUBPIXELS;
+    cairo_translate(stamp_cr, dx - marker_x0, dy - marker_y0);
+    emitPath(stamp_cr, shape, 0.5);
+    cairo_fill(stamp_cr);
+    cairo_destroy(stamp_cr);
+    cairo_surface_flush(stamp);
+  }
+  return stamp;
+}
+
+static inline unsigned int mul255(unsigned int a, unsigned int b) {
+  unsigned int t = a * b + 128;
+  return (t + (t >> 8)) >> 8;
+}
+
+void
+CairoSurface::drawMarkers(const Path2D & shape, const Style & style, const Point * points, size_t n, const Color * colors, float displayScale, float globalAlpha, const Path2D & clipPath) {
+  if (style.getType() != Style::SOLID || shape.empty()) {
+    Surface::drawMarkers(shape, style, points, n, colors, displayScale, globalAlpha, clipPath);
+    return;
   }
   
-  cairo_set_source_rgba(cr, style.color.red, style.color.green, style.color.blue, style.color.alpha * alpha);
-  cairo_select_font_face(cr, font.family.c_str(),
-			 font.style == Font::NORMAL_STYLE ? CAIRO_FONT_SLANT_NORMAL : (font.style == Font::ITALIC ? CAIRO_FONT_SLANT_ITALIC : CAIRO_FONT_SLANT_OBLIQUE),
-			 font.weight.isBold() ? CAIRO_FONT_WEIGHT_BOLD : CAIRO_FONT_WEIGHT_NORMAL);
-  cairo_set_font_size(cr, font.size * displayScale);
+  initializeContext();
+  clearMipmaps();
+  setClip(clipPath);
+
+  if (cairo_image_surface_get_format(surface) != CAIRO_FORMAT_ARGB32 || (!clipPath.empty() && !clip_is_rect)) {
+    // let Cairo composite the stamps so that the clip mask is applied
+    setOperator(SOURCE_OVER);
+    for (size_t i = 0; i < n; i++) {
+      const Color & c = colors ? colors[i] : style.color;
+      double fx = floor(points[i].x), fy = floor(points[i].y);
+      unsigned int phase = (unsigned int)((points[i].y - fy) * MARKER_SUBPIXELS) * MARKER_SUBPIXELS + (unsigned int)((points[i].x - fx) * MARKER_SUBPIXELS);
+      cairo_surface_t * stamp = getMarkerStamp(shape, phase);
+      setSourceColor(c, globalAlpha);
+      cairo_mask_surface(cr, stamp, fx + marker_x0, fy + marker_y0);
+    }
+    return;
+  }
+
+  int surface_width = cairo_image_surface_get_width(surface), surface_height = cairo_image_surface_get_height(surface);
+  int bx0 = 0, by0 = 0, bx1 = surface_width, by1 = surface_height;
+  if (clip_is_rect) {
+    bx0 = std::max(bx0, clip_x0);
+    by0 = std::max(by0, clip_y0);
+    bx1 = std::min(bx1, clip_x1);
+    by1 = std::min(by1, clip_y1);
+  }
+
+  cairo_surface_flush(surface);
+  unsigned char * data = cairo_image_surface_get_data(surface);
+  int stride = cairo_image_surface_get_stride(surface);
+  int dirty_x0 = bx1, dirty_y0 = by1, dirty_x1 = bx0, dirty_y1 = by0;
+  
+  for (size_t i = 0; i < n; i++) {
+    double fx = floor(points[i].x), fy = floor(points[i].y);
+    unsigned int phase = (unsigned int)((points[i].y - fy) * MARKER_SUBPIXELS) * MARKER_SUBPIXELS + (unsigned int)((points[i].x - fx) * MARKER_SUBPIXELS);
+    cairo_surface_t * stamp = getMarkerStamp(shape, phase);
+    const unsigned char * stamp_data = cairo_image_surface_get_data(stamp);
+    int stamp_stride = cairo_image_surface_get_stride(stamp);
+
+    int x0 = int(fx) + marker_x0, y0 = int(fy) + marker_y0;
+    int sx0 = std::max(bx0 - x0, 0), sy0 = std::max(by0 - y0, 0);
+    int sx1 = std::min(bx1 - x0, marker_width), sy1 = std::min(by1 - y0, marker_height);
+    if (sx0 >= sx1 || sy0 >= sy1) continue;
+    
+    const Color & c = colors ? colors[i] : style.color;
+    unsigned int a = (unsigned int)(c.alpha * globalAlpha * 255.0f + 0.5f);
+    unsigned int r = mul255((unsigned int)(c.red * 255.0f + 0.5f), a);
+    unsigned int g = mul255((unsigned int)(c.green * 255.0f + 0.5f), a);
+    unsigned int b = mul255((unsigned int)(c.blue * 255.0f + 0.5f), a);
+    // the color in the memory order of native endian ARGB
+    uint32_t pixel = (a << 24) | (r << 16) | (g << 8) | b;
+    unsigned char color[4];
+    memcpy(color, &pixel, 4);
+
+    for (int sy = sy0; sy < sy1; sy++) {
+      const unsigned char * cov_ptr = stamp_data + sy * stamp_stride;
+      unsigned char * dst = data + (y0 + sy) * stride + 4 * x0;
+      PixelKernels::blendMask(cov_ptr + sx0, dst + 4 * sx0, sx1 - sx0, color);
+    }
+    dirty_x0 = std::min(dirty_x0, x0 + sx0);
+    dirty_y0 = std::min(dirty_y0, y0 + sy0);
+    dirty_x1 = std::max(dirty_x1, x0 + sx1);
+    dirty_y1 = std::max(dirty_y1, y0 + sy1);
+  }
+  
+  if (dirty_x0 < dirty_x1 && dirty_y0 < dirty_y1) {
+    cairo_surface_mark_dirty_rectangle(surface, dirty_x0, dirty_y0, dirty_x1 - dirty_x0, dirty_y1 - dirty_y0);
+  }
+}
+
+void
+CairoSurface::renderText(RenderMode mode, const Font & font, const Style & style, TextBaseline textBaseline, TextAlign textAlign, const std::string & text, const Point & p, float lineWidth, Operator op, float displayScale, float alpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath) {
+  initializeContext();
+  clearMipmaps();
+  setClip(clipPath);
+
+  setOperator(op);
+  
+  setSourceColor(style.color, alpha);
+  setFont(font, displayScale);
   
   double x = p.x * displayScale;
   double y = p.y * displayScale;
@@ -271,7 +806,8 @@ CairoSurface::renderText(RenderMode mode, const Font & font, const Style & style
   
   switch (mode) {
   case STROKE:
-    cairo_set_line_width(cr, lineWidth);
+    setLineWidth(lineWidth);
+    setAntialias(getQualityAntialias());
     cairo_text_path(cr, text.c_str());
     cairo_stroke(cr);
     break;
@@ -279,17 +815,12 @@ CairoSurface::renderText(RenderMode mode, const Font & font, const Style & style
     cairo_show_text(cr, text.c_str());
     break;
   }
-
-  if (!clipPath.empty()) {
-    cairo_reset_clip(cr);
-  }
 }
 
 TextMetrics
 CairoSurface::measureText(const Font & font, const std::string & text, TextBaseline textBaseline, float displayScale) {
   initializeContext();
-  cairo_select_font_face(cr, font.family.c_str(), font.style == Font::NORMAL_STYLE ? CAIRO_FONT_SLANT_NORMAL : (font.style == Font::ITALIC ? CAIRO_FONT_SLANT_ITALIC : CAIRO_FONT_SLANT_OBLIQUE), font.weight.isBold() ? CAIRO_FONT_WEIGHT_BOLD : CAIRO_FONT_WEIGHT_NORMAL);
-  cairo_set_font_size(cr, font.size * displayScale);
+  setFont(font, displayScale);
   cairo_text_extents_t te;
   cairo_text_extents(cr, text.c_str(), &te);
 
@@ -305,47 +836,135 @@ CairoSurface::measureText(const Font & font, const std::string & text, TextBasel
   return TextMetrics((float) te.width / displayScale, (fe.descent - baseline) / displayScale, (fe.ascent - baseline) / displayScale); //, (float)te.height);
 }
 
+CairoSurface &
+CairoSurface::getMipmap(double target_width, double target_height) {
+  cairo_format_t format = cairo_image_surface_get_format(surface);
+  if (format != CAIRO_FORMAT_ARGB32 && format != CAIRO_FORMAT_RGB24) {
+    return *this;
+  }
+  CairoSurface * level = this;
+  for (unsigned int i = 0; ; i++) {
+    unsigned int w = level->getActualWidth(), h = level->getActualHeight();
+    unsigned int w2 = (w + 1) / 2, h2 = (h + 1) / 2;
+    if ((w <= 1 && h <= 1) || w2 < target_width || h2 < target_height) {
+      return *level;
+    }
+    if (i == mipmaps.size()) {
+      level->flush();
+      std::unique_ptr<CairoSurface> next(new CairoSurface(w2, h2, w2, h2, level->getFormat()));
+      // ARGB32 and RGB24 rows have no padding
+      const unsigned char * input = cairo_image_surface_get_data(level->surface);
+      unsigned char * output = (unsigned char *)next->lockMemory(true);
+      Resampler::resize(input, w, h, output, w2, h2, level->getFormat() == RGB8 ? RGB8 : RGBA8, RESAMPLE_BOX);
+      next->releaseMemory();
+      mipmaps.push_back(std::move(next));
+    }
+    level = mipmaps[i].get();
+  }
+}
+
+CairoSurface &
+CairoSurface::getCachedImage(const Image & image) {
+  image_clock++;
+  for (auto & ci : image_cache) {
+    if (ci.image_id == image.getId()) {
+      ci.last_used = image_clock;
+      return *ci.surface;
+    }
+  }
+  CachedImage ci = { image.getId(), std::make_shared<CairoSurface>(image), image_clock };
+  if (image_cache.size() < IMAGE_CACHE_SIZE) {
+    image_cache.push_back(ci);
+    return *image_cache.back().surface;
+  }
+  auto lru = std::min_element(image_cache.begin(), image_cache.end(), [](const CachedImage & a, const CachedImage & b) { return a.last_used < b.last_used; });
+  *lru = ci;
+  return *lru->surface;
+}
+
 void
-CairoSurface::drawNativeSurface(CairoSurface & img, const Point & p, double w, double h, float displayScale, float globalAlpha, const Path2D & clipPath, bool imageSmoothingEnabled) {
+CairoSurface::drawNativeSurface(CairoSurface & img, const Point & p, double w, double h, float displayScale, float globalAlpha, const Path2D & clipPath, bool imageSmoothingEnabled, ImageSmoothingQuality imageSmoothingQuality) {
   initializeContext();
-
-  if (!clipPath.empty()) {
-    sendPath(clipPath);
-    cairo_clip(cr);
+  setClip(clipPath);
+  setOperator(SOURCE_OVER);
+
+  // Low and medium quality draw downscaled images from the mip level closest to the target size,
+  // so that the filtering cost does not depend on the size of the source
+  CairoSurface * source = &img;
+  cairo_filter_t filter = CAIRO_FILTER_NEAREST;
+  imageSmoothingQuality = limitSmoothingQuality(imageSmoothingQuality);
+  if (imageSmoothingEnabled) {
+    if (imageSmoothingQuality == SMOOTHING_HIGH) {
+      filter = CAIRO_FILTER_BEST;
+    } else if (imageSmoothingQuality == SMOOTHING_MEDIUM) {
+      source = &img.getMipmap(fabs(w), fabs(h));
+      filter = CAIRO_FILTER_GOOD;
+    } else {
+      source = &img.getMipmap(fabs(w), fabs(h));
+      filter = getRenderQuality() == RENDER_FAST ? CAIRO_FILTER_FAST : CAIRO_FILTER_BILINEAR;
+    }
   }
 
-  double sx = w / img.getActualWidth(), sy = h / img.getActualHeight();
+  double sx = w / source->getActualWidth(), sy = h / source->getActualHeight();
   cairo_save(cr);
   cairo_scale(cr, sx, sy);
-  cairo_set_source_surface(cr, img.surface, (p.x / sx) + 0.5, (p.y / sy) + 0.5);
-  cairo_pattern_set_filter(cairo_get_source(cr), imageSmoothingEnabled ? CAIRO_FILTER_BEST : CAIRO_FILTER_NEAREST);
+  cairo_set_source_surface(cr, source->surface, (p.x / sx) + 0.5, (p.y / sy) + 0.5);
+  cairo_pattern_set_filter(cairo_get_source(cr), filter);
   if (globalAlpha < 1.0f) {
     cairo_paint_with_alpha(cr, globalAlpha);
   } else {
     cairo_paint(cr);
   }
-  cairo_set_source_rgb(cr, 0.0f, 0.0f, 0.0f); // is this needed?
-  cairo_restore(cr);
+  cairo_restore(cr); // restores the previous source
+  clearMipmaps(); // after the paint, since the surface may have been drawn onto itself
+}
 
-  if (!clipPath.empty()) {
-    cairo_reset_clip(cr);
+void
+CairoSurface::drawMask(Surface & _mask, const Point & p, double w, double h, const Color & color, float displayScale, float globalAlpha, const Path2D & clipPath) {
+  CairoSurface * mask = dynamic_cast<CairoSurface*>(&_mask);
+  if (!mask) {
+    Surface::drawMask(_mask, p, w, h, color, displayScale, globalAlpha, clipPath);
+    return;
   }
+  
+  initializeContext();
+  clearMipmaps();
+  setClip(clipPath);
+  mask->flush();
+  
+  setOperator(SOURCE_OVER);
+  setSourceColor(color, globalAlpha);
+
+  // same placement as in drawNativeSurface()
+  double sx = w / mask->getActualWidth(), sy = h / mask->getActualHeight();
+  cairo_pattern_t * pattern = cairo_pattern_create_for_surface(mask->surface);
+  cairo_matrix_t matrix;
+  cairo_matrix_init_scale(&matrix, 1.0 / sx, 1.0 / sy);
+  cairo_matrix_translate(&matrix, -(p.x + 0.5 * sx), -(p.y + 0.5 * sy));
+  cairo_pattern_set_matrix(pattern, &matrix);
+  cairo_pattern_set_filter(pattern, CAIRO_FILTER_NEAREST);
+  cairo_mask(cr, pattern);
+  cairo_pattern_destroy(pattern);
 }
 
 void
-CairoSurface::drawImage(Surface & _img, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled) {
+CairoSurface::drawImage(Surface & _img, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled, ImageSmoothingQuality imageSmoothingQuality) {
   CairoSurface * cs_ptr = dynamic_cast<CairoSurface*>(&_img);
   if (cs_ptr) {
-    drawNativeSurface(*cs_ptr, p, w, h, displayScale, globalAlpha, clipPath, imageSmoothingEnabled);    
+    drawNativeSurface(*cs_ptr, p, w, h, displayScale, globalAlpha, clipPath, imageSmoothingEnabled, imageSmoothingQuality);    
   } else {
     auto img = _img.createImage();
     CairoSurface cs(*img);
-    drawNativeSurface(cs, p, w, h, displayScale, globalAlpha, clipPath, imageSmoothingEnabled);
+    drawNativeSurface(cs, p, w, h, displayScale, globalAlpha, clipPath, imageSmoothingEnabled, imageSmoothingQuality);
   }
 }
 
 void
-CairoSurface::drawImage(const Image & _img, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled) {
-  CairoSurface img(_img);
-  drawNativeSurface(img, p, w, h, displayScale, globalAlpha, clipPath, imageSmoothingEnabled);
+CairoSurface::drawImage(const Image & _img, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled, ImageSmoothingQuality imageSmoothingQuality) {
+  if (imageSmoothingEnabled && limitSmoothingQuality(imageSmoothingQuality) != SMOOTHING_HIGH && 2 * fabs(w) <= _img.getWidth() && 2 * fabs(h) <= _img.getHeight()) {
+    drawNativeSurface(getCachedImage(_img), p, w, h, displayScale, globalAlpha, clipPath, imageSmoothingEnabled, imageSmoothingQuality);
+  } else {
+    CairoSurface img(_img);
+    drawNativeSurface(img, p, w, h, displayScale, globalAlpha, clipPath, imageSmoothingEnabled, imageSmoothingQuality);
+  }
 }
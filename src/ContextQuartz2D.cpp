@@ -147,6 +147,35 @@ Quartz2DSurface::sendPath(const Path2D & path, float scale) {
   }
 }
 
+static CGBlendMode getBlendMode(Operator op) {
+  switch (op) {
+  case SOURCE_OVER: return kCGBlendModeNormal;
+  case COPY: return kCGBlendModeCopy;
+  case SOURCE_IN: return kCGBlendModeSourceIn;
+  case SOURCE_OUT: return kCGBlendModeSourceOut;
+  case SOURCE_ATOP: return kCGBlendModeSourceAtop;
+  case DESTINATION_OVER: return kCGBlendModeDestinationOver;
+  case DESTINATION_IN: return kCGBlendModeDestinationIn;
+  case DESTINATION_OUT: return kCGBlendModeDestinationOut;
+  case DESTINATION_ATOP: return kCGBlendModeDestinationAtop;
+  case XOR: return kCGBlendModeXOR;
+  case LIGHTER: return kCGBlendModePlusLighter;
+  case CLEAR: return kCGBlendModeClear;
+  case MULTIPLY: return kCGBlendModeMultiply;
+  case SCREEN: return kCGBlendModeScreen;
+  case OVERLAY: return kCGBlendModeOverlay;
+  case DARKEN: return kCGBlendModeDarken;
+  case LIGHTEN: return kCGBlendModeLighten;
+  case COLOR_DODGE: return kCGBlendModeColorDodge;
+  case COLOR_BURN: return kCGBlendModeColorBurn;
+  case HARD_LIGHT: return kCGBlendModeHardLight;
+  case SOFT_LIGHT: return kCGBlendModeSoftLight;
+  case DIFFERENCE: return kCGBlendModeDifference;
+  case EXCLUSION: return kCGBlendModeExclusion;
+  }
+  return kCGBlendModeNormal;
+}
+
 void
 Quartz2DSurface::renderPath(RenderMode mode, const Path2D & path, const Style & style, float lineWidth, Operator op, float display_scale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath) {
   initializeContext();
@@ -163,14 +192,7 @@ Quartz2DSurface::renderPath(RenderMode mode, const Path2D & path, const Style &
     setShadow(shadowOffsetX, shadowOffsetY, shadowBlur, shadowColor, display_scale);
   }
   
-  switch (op) {
-  case SOURCE_OVER:
-    CGContextSetBlendMode(gc, kCGBlendModeNormal);
-    break;
-  case COPY:
-    CGContextSetBlendMode(gc, kCGBlendModeCopy);
-    break;
-  }
+  CGContextSetBlendMode(gc, getBlendMode(op));
   switch (mode) {
   case STROKE:
     sendPath(path, display_scale);
@@ -253,7 +275,7 @@ Quartz2DSurface::resize(unsigned int _logical_width, unsigned int _logical_heigh
 }
 
 void
-Quartz2DSurface::drawImage(const Image & _img, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled) {
+Quartz2DSurface::drawImage(const Image & _img, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled, ImageSmoothingQuality imageSmoothingQuality) {
   initializeContext();
   bool has_shadow = shadowBlur > 0.0f || shadowOffsetX != 0.0f || shadowOffsetY != 0.0f;
   if (has_shadow || !clipPath.empty()) {
@@ -274,7 +296,17 @@ Quartz2DSurface::drawImage(const Image & _img, const Point & p, double w, double
   assert(img);
   flipY();
   if (globalAlpha < 1.0f) CGContextSetAlpha(gc, globalAlpha);
+  CGInterpolationQuality interpolation = kCGInterpolationNone;
+  if (imageSmoothingEnabled) {
+    switch (limitSmoothingQuality(imageSmoothingQuality)) {
+    case SMOOTHING_LOW: interpolation = kCGInterpolationLow; break;
+    case SMOOTHING_MEDIUM: interpolation = kCGInterpolationMedium; break;
+    case SMOOTHING_HIGH: interpolation = kCGInterpolationHigh; break;
+    }
+  }
+  CGContextSetInterpolationQuality(gc, interpolation);
   CGContextDrawImage(gc, CGRectMake(displayScale * p.x, getActualHeight() - 1 - displayScale * (p.y + h), displayScale * w, displayScale * h), img);
+  CGContextSetInterpolationQuality(gc, kCGInterpolationHigh); // the default set in initializeContext()
   if (globalAlpha < 1.0f) CGContextSetAlpha(gc, 1.0f);
   flipY();
   
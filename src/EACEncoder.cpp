@@ -0,0 +1,120 @@
+#include "EACEncoder.h"
+
+#include <algorithm>
+#include <climits>
+
+using namespace std;
+using namespace canvas;
+
+static const int modifier_table[16][8] = {
+  { -3, -6, -9, -15, 2, 5, 8, 14 },
+  { -3, -7, -10, -13, 2, 6, 9, 12 },
+  { -2, -5, -8, -13, 1, 4, 7, 12 },
+  { -2, -4, -6, -13, 1, 3, 5, 12 },
+  { -3, -6, -8, -12, 2, 5, 7, 11 },
+  { -3, -7, -9, -11, 2, 6, 8, 10 },
+  { -4, -7, -8, -11, 3, 6, 7, 10 },
+  { -3, -5, -8, -11, 2, 4, 7, 10 },
+  { -2, -6, -8, -10, 1, 5, 7, 9 },
+  { -2, -5, -8, -10, 1, 4, 7, 9 },
+  { -2, -4, -8, -10, 1, 3, 7, 9 },
+  { -2, -5, -7, -10, 1, 4, 6, 9 },
+  { -3, -4, -7, -10, 2, 3, 6, 9 },
+  { -1, -2, -3, -10, 0, 1, 2, 9 },
+  { -4, -6, -8, -9, 3, 5, 7, 8 },
+  { -3, -5, -7, -9, 2, 4, 6, 8 }
+};
+
+namespace {
+  // The alpha blocks decode to base + modifier * multiplier. The 11 bit
+  // blocks decode to base * 8 + 4 + modifier * multiplier * 8, and a zero
+  // multiplier means a multiplier of 1/8.
+  struct EACMode {
+    int scale, offset, max_value, min_multiplier;
+
+    int decode(int base, int multiplier, int modifier) const {
+      int v = base * scale + offset + (multiplier ? modifier * multiplier * scale : modifier);
+      return v < 0 ? 0 : (v > max_value ? max_value : v);
+    }
+  };
+};
+
+// Picks the nearest modifier for each pixel and returns the squared error
+static int
+findIndices(const EACMode & mode, const int * target, int base, int multiplier, int table, unsigned char * indices) {
+  int values[8];
+  for (int i = 0; i < 8; i++) {
+    values[i] = mode.decode(base, multiplier, modifier_table[table][i]);
+  }
+  int total = 0;
+  for (int p = 0; p < 16; p++) {
+    int best = INT_MAX, best_index = 0;
+    for (int i = 0; i < 8; i++) {
+      int d = values[i] - target[p];
+      if (d * d < best) {
+	best = d * d;
+	best_index = i;
+      }
+    }
+    if (indices) indices[p] = (unsigned char)best_index;
+    total += best;
+  }
+  return total;
+}
+
+static void
+compressBlock(const EACMode & mode, unsigned char * dest, const int * target) {
+  int lo = *std::min_element(target, target + 16), hi = *std::max_element(target, target + 16);
+  int best_error = INT_MAX, best_base = 0, best_multiplier = 1, best_table = 0;
+  for (int table = 0; table < 16 && best_error; table++) {
+    // the most negative modifier is in the fourth column and the most positive in the last
+    int low_mod = modifier_table[table][3], high_mod = modifier_table[table][7];
+    int m0 = ((hi - lo) + (high_mod - low_mod) * mode.scale / 2) / ((high_mod - low_mod) * mode.scale);
+    for (int multiplier = std::max(m0 - 1, mode.min_multiplier); multiplier <= std::min(m0 + 1, 15); multiplier++) {
+      // the base that centers the range of the table on the range of the block
+      int spread = multiplier ? multiplier * mode.scale : 1;
+      int center = (lo + hi) / 2 - mode.offset - (low_mod + high_mod) * spread / 2;
+      int b0 = std::min(std::max((center + mode.scale / 2) / mode.scale, 0), 255);
+      for (int base = std::max(b0 - 1, 0); base <= std::min(b0 + 1, 255); base++) {
+	int error = findIndices(mode, target, base, multiplier, table, 0);
+	if (error < best_error) {
+	  best_error = error;
+	  best_base = base;
+	  best_multiplier = multiplier;
+	  best_table = table;
+	}
+      }
+    }
+  }
+
+  unsigned char indices[16];
+  findIndices(mode, target, best_base, best_multiplier, best_table, indices);
+  // the indices are stored big endian and column by column
+  unsigned long long bits = 0;
+  for (int x = 0; x < 4; x++) {
+    for (int y = 0; y < 4; y++) {
+      bits = (bits << 3) | indices[y * 4 + x];
+    }
+  }
+  dest[0] = (unsigned char)best_base;
+  dest[1] = (unsigned char)((best_multiplier << 4) | best_table);
+  for (int i = 0; i < 6; i++) {
+    dest[2 + i] = (unsigned char)(bits >> (40 - 8 * i));
+  }
+}
+
+void
+EACEncoder::compressAlphaBlock(unsigned char * dest, const unsigned char * src) {
+  static const EACMode mode = { 1, 0, 255, 1 };
+  int target[16];
+  for (int i = 0; i < 16; i++) target[i] = src[i];
+  compressBlock(mode, dest, target);
+}
+
+void
+EACEncoder::compressR11Block(unsigned char * dest, const unsigned char * src) {
+  static const EACMode mode = { 8, 4, 2047, 0 };
+  int target[16];
+  for (int i = 0; i < 16; i++) target[i] = (src[i] * 2047 + 127) / 255;
+  compressBlock(mode, dest, target);
+}
@@ -0,0 +1,20 @@
+#ifndef _CANVAS_EACENCODER_H_
+#define _CANVAS_EACENCODER_H_
+
+namespace canvas {
+  // Encoder for the EAC blocks of ETC2. A block stores a base value, a
+  // multiplier and one of 16 modifier tables, and each pixel selects one of
+  // the eight modifiers of the table. The encoder searches all tables with
+  // the base and multiplier that best fit the range of the block.
+  // The input is 16 values in row-major order, and the output 8 bytes.
+  // The functions are thread-safe.
+  class EACEncoder {
+  public:
+    // The alpha block of GL_COMPRESSED_RGBA8_ETC2_EAC
+    static void compressAlphaBlock(unsigned char * dest, const unsigned char * src);
+    // A channel of GL_COMPRESSED_R11_EAC or GL_COMPRESSED_RG11_EAC
+    static void compressR11Block(unsigned char * dest, const unsigned char * src);
+  };
+};
+
+#endif
@@ -0,0 +1,217 @@
+#include <Filter.h>
+
+#include <Surface.h>
+#include "PixelKernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cassert>
+
+using namespace std;
+using namespace canvas;
+
+// Blur radii above the threshold use the pyramid blur
+static void blurBuffer(unsigned char * buffer, unsigned int width, unsigned int height, unsigned int channels, float radius, float blur_threshold) {
+  if (radius > blur_threshold) {
+    PixelKernels::pyramidBlur(buffer, width, height, width * channels, channels, radius, radius);
+  } else {
+    PixelKernels::gaussianBlur(buffer, width, height, width * channels, channels, radius, radius);
+  }
+}
+
+// Surfaces hold native endian ARGB as in Cairo, which is B, G, R, A in memory,
+// so the red and blue rows and columns of the matrix are swapped
+static void toNativeOrder(const float * matrix, float * output) {
+  static const unsigned int channels[] = { 2, 1, 0, 3 };
+  for (unsigned int i = 0; i < 4; i++) {
+    for (unsigned int j = 0; j < 4; j++) {
+      output[i * 5 + j] = matrix[channels[i] * 5 + channels[j]];
+    }
+    output[i * 5 + 4] = matrix[channels[i] * 5 + 4];
+  }
+}
+
+static inline unsigned char toByte(float v) {
+  return (unsigned char)(v <= 0.0f ? 0 : (v >= 1.0f ? 255 : int(v * 255.0f + 0.5f)));
+}
+
+Filter &
+Filter::blur(float std_deviation) {
+  if (std_deviation > 0.0f) {
+    Stage s = { BLUR, { }, 3.0f * std_deviation, 0.0f, 0.0f, Color() };
+    stages.push_back(s);
+  }
+  return *this;
+}
+
+Filter &
+Filter::dropShadow(float offset_x, float offset_y, float blur, const Color & color) {
+  Stage s = { DROP_SHADOW, { }, blur, offset_x, offset_y, color };
+  stages.push_back(s);
+  return *this;
+}
+
+Filter &
+Filter::brightness(float a) {
+  const float m[20] = {
+    a, 0, 0, 0, 0,
+    0, a, 0, 0, 0,
+    0, 0, a, 0, 0,
+    0, 0, 0, 1, 0
+  };
+  return colorMatrix(m);
+}
+
+Filter &
+Filter::contrast(float a) {
+  float b = 0.5f - 0.5f * a;
+  const float m[20] = {
+    a, 0, 0, 0, b,
+    0, a, 0, 0, b,
+    0, 0, a, 0, b,
+    0, 0, 0, 1, 0
+  };
+  return colorMatrix(m);
+}
+
+Filter &
+Filter::grayscale(float amount) {
+  float s = 1.0f - std::max(0.0f, std::min(amount, 1.0f));
+  const float m[20] = {
+    0.2126f + 0.7874f * s, 0.7152f - 0.7152f * s, 0.0722f - 0.0722f * s, 0, 0,
+    0.2126f - 0.2126f * s, 0.7152f + 0.2848f * s, 0.0722f - 0.0722f * s, 0, 0,
+    0.2126f - 0.2126f * s, 0.7152f - 0.7152f * s, 0.0722f + 0.9278f * s, 0, 0,
+    0, 0, 0, 1, 0
+  };
+  return colorMatrix(m);
+}
+
+Filter &
+Filter::opacity(float a) {
+  const float m[20] = {
+    1, 0, 0, 0, 0,
+    0, 1, 0, 0, 0,
+    0, 0, 1, 0, 0,
+    0, 0, 0, a, 0
+  };
+  return colorMatrix(m);
+}
+
+Filter &
+Filter::colorMatrix(const float matrix[20]) {
+  if (!stages.empty() && stages.back().type == COLOR_MATRIX) {
+    // the new matrix is applied after the previous one
+    float * prev = stages.back().matrix;
+    float r[20];
+    for (unsigned int i = 0; i < 4; i++) {
+      for (unsigned int j = 0; j < 5; j++) {
+	float v = j == 4 ? matrix[i * 5 + 4] : 0.0f;
+	for (unsigned int k = 0; k < 4; k++) {
+	  v += matrix[i * 5 + k] * prev[k * 5 + j];
+	}
+	r[i * 5 + j] = v;
+      }
+    }
+    memcpy(prev, r, sizeof(r));
+  } else {
+    Stage s = { COLOR_MATRIX, { }, 0.0f, 0.0f, 0.0f, Color() };
+    memcpy(s.matrix, matrix, sizeof(s.matrix));
+    stages.push_back(s);
+  }
+  return *this;
+}
+
+int
+Filter::getOutset() const {
+  int outset = 0;
+  for (auto & s : stages) {
+    if (s.type == BLUR) {
+      outset += int(ceil(s.radius));
+    } else if (s.type == DROP_SHADOW) {
+      outset += int(ceil(s.radius)) + int(ceil(std::max(fabs(s.offset_x), fabs(s.offset_y))));
+    }
+  }
+  return outset;
+}
+
+void
+Filter::apply(Surface & surface, float blur_threshold) const {
+  apply(surface, 0, 0, surface.getActualWidth(), surface.getActualHeight(), blur_threshold);
+}
+
+void
+Filter::apply(Surface & surface, int x0, int y0, int x1, int y1, float blur_threshold) const {
+  if (surface.getFormat() != RGBA8 || stages.empty()) {
+    return;
+  }
+  x0 = std::max(x0, 0);
+  y0 = std::max(y0, 0);
+  x1 = std::min(x1, int(surface.getActualWidth()));
+  y1 = std::min(y1, int(surface.getActualHeight()));
+  if (x0 >= x1 || y0 >= y1) {
+    return;
+  }
+  unsigned int w = x1 - x0, h = y1 - y0, stride = surface.getActualWidth() * 4;
+  unsigned char * buffer = (unsigned char *)surface.lockMemory(true);
+  assert(buffer);
+  unsigned char * region = buffer + y0 * stride + x0 * 4;
+
+  for (auto & s : stages) {
+    switch (s.type) {
+    case COLOR_MATRIX:
+      {
+	float m[20];
+	toNativeOrder(s.matrix, m);
+	for (unsigned int y = 0; y < h; y++) {
+	  PixelKernels::colorMatrix(region + y * stride, w, m);
+	}
+      }
+      break;
+    case BLUR:
+      {
+	// the region is padded so that the blur can spread outside it before it is cropped
+	unsigned int pad = (unsigned int)ceil(s.radius) + 1, pw = w + 2 * pad, ph = h + 2 * pad;
+	vector<unsigned char> tmp(pw * ph * 4);
+	for (unsigned int y = 0; y < h; y++) {
+	  memcpy(&tmp[((y + pad) * pw + pad) * 4], region + y * stride, w * 4);
+	}
+	blurBuffer(tmp.data(), pw, ph, 4, s.radius, blur_threshold);
+	for (unsigned int y = 0; y < h; y++) {
+	  memcpy(region + y * stride, &tmp[((y + pad) * pw + pad) * 4], w * 4);
+	}
+      }
+      break;
+    case DROP_SHADOW:
+      {
+	unsigned int pad = (unsigned int)ceil(s.radius) + 1, pw = w + 2 * pad, ph = h + 2 * pad;
+	int dx = int(floor(s.offset_x + 0.5f)), dy = int(floor(s.offset_y + 0.5f));
+	vector<unsigned char> shadow(pw * ph);
+	for (int y = 0; y < int(h); y++) {
+	  int sy = y - dy;
+	  if (sy < 0 || sy >= int(h)) continue;
+	  const unsigned char * src = region + sy * stride;
+	  unsigned char * dst = &shadow[(y + pad) * pw + pad];
+	  for (int x = std::max(0, dx); x < std::min(int(w), int(w) + dx); x++) {
+	    dst[x] = src[(x - dx) * 4 + 3];
+	  }
+	}
+	blurBuffer(shadow.data(), pw, ph, 1, s.radius, blur_threshold);
+	const unsigned char color[4] = {
+	  toByte(s.color.blue * s.color.alpha),
+	  toByte(s.color.green * s.color.alpha),
+	  toByte(s.color.red * s.color.alpha),
+	  toByte(s.color.alpha)
+	};
+	vector<unsigned char> row(w * 4);
+	for (unsigned int y = 0; y < h; y++) {
+	  PixelKernels::colorize(&shadow[(y + pad) * pw + pad], row.data(), w, color);
+	  PixelKernels::composite(DESTINATION_OVER, row.data(), region + y * stride, w);
+	}
+      }
+      break;
+    }
+  }
+
+  surface.releaseMemory();
+}
@@ -17,4 +17,7 @@ ImageFormat ImageFormat::RGB_DXT1(3, 0, false, ImageFormat::DXT1);
 ImageFormat ImageFormat::RGBA_DXT5(4, 0, false, ImageFormat::DXT5);
 ImageFormat ImageFormat::RED_RGTC1(1, 0, false, ImageFormat::RGTC1);
 ImageFormat ImageFormat::RG_RGTC2(2, 0, false, ImageFormat::RGTC2);
+ImageFormat ImageFormat::RGBA_ETC2(4, 0, false, ImageFormat::ETC2);
+ImageFormat ImageFormat::R11_EAC(1, 0, false, ImageFormat::EAC);
+ImageFormat ImageFormat::RG11_EAC(2, 0, false, ImageFormat::EAC);
 ImageFormat ImageFormat::FLOAT32(1, 4, false);
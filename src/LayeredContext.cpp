@@ -0,0 +1,188 @@
+#include <LayeredContext.h>
+
+#include <algorithm>
+
+using namespace std;
+using namespace canvas;
+
+int
+LayeredContext::createLayer(float z) {
+  int id = next_id++;
+  layers.push_back(std::unique_ptr<Layer>(new Layer(id, factory.createContext(width, height, RGBA8, true), z)));
+  sortLayers();
+  needs_redraw = true;
+  return id;
+}
+
+void
+LayeredContext::removeLayer(int id) {
+  for (auto it = layers.begin(); it != layers.end(); it++) {
+    if ((*it)->id == id) {
+      layers.erase(it);
+      needs_redraw = true;
+      return;
+    }
+  }
+}
+
+LayeredContext::Layer *
+LayeredContext::getLayer(int id) {
+  for (auto & l : layers) {
+    if (l->id == id) return l.get();
+  }
+  return 0;
+}
+
+const LayeredContext::Layer *
+LayeredContext::getLayer(int id) const {
+  for (auto & l : layers) {
+    if (l->id == id) return l.get();
+  }
+  return 0;
+}
+
+void
+LayeredContext::updateLayer(int id, const std::function<void(Context & context)> & render) {
+  auto layer = getLayer(id);
+  if (!layer) return;
+  Context & context = *layer->context;
+  context.save();
+  context.resetTransform();
+  context.clearRect(0, 0, width, height);
+  context.restore();
+  render(context);
+  invalidate(id);
+}
+
+void
+LayeredContext::invalidate(int id) {
+  auto layer = getLayer(id);
+  if (layer) {
+    layer->needs_filter = layer->needs_upload = true;
+    needs_redraw = true;
+  }
+}
+
+void
+LayeredContext::setZ(int id, float z) {
+  auto layer = getLayer(id);
+  if (layer && layer->z != z) {
+    layer->z = z;
+    sortLayers();
+    needs_redraw = true;
+  }
+}
+
+void
+LayeredContext::setOpacity(int id, float opacity) {
+  auto layer = getLayer(id);
+  if (layer && layer->opacity != opacity) {
+    // opacity is applied when the layer is drawn, so the texture stays valid
+    layer->opacity = opacity;
+    needs_redraw = true;
+  }
+}
+
+void
+LayeredContext::setFilter(int id, const std::shared_ptr<Filter> & filter) {
+  auto layer = getLayer(id);
+  if (layer) {
+    layer->filter = filter;
+    if (!filter || filter->empty()) layer->filtered.reset();
+    invalidate(id);
+  }
+}
+
+void
+LayeredContext::setVisible(int id, bool visible) {
+  auto layer = getLayer(id);
+  if (layer && layer->visible != visible) {
+    layer->visible = visible;
+    needs_redraw = true;
+  }
+}
+
+// The content of the layers is lost, and they have to be redrawn
+void
+LayeredContext::resize(unsigned int _width, unsigned int _height) {
+  width = _width;
+  height = _height;
+  for (auto & l : layers) {
+    l->context->resize(width, height);
+    l->filtered.reset();
+    l->texture.clear();
+    l->needs_filter = l->needs_upload = true;
+  }
+  needs_redraw = true;
+}
+
+unsigned int
+LayeredContext::upload() {
+  unsigned int n = 0;
+  for (auto & l : layers) {
+    if (!l->visible) continue; // hidden layers are uploaded when they are shown
+    applyFilter(*l);
+    if (l->needs_upload && texture_factory) {
+      Surface & surface = l->getSurface();
+      if (l->texture.getTextureId() && l->texture.getActualWidth() == surface.getActualWidth() && l->texture.getActualHeight() == surface.getActualHeight()) {
+	// the existing texture is overwritten instead of reallocated
+	l->texture.updateData(*surface.createImage(), 0, 0);
+      } else {
+	l->texture = texture_factory(surface);
+      }
+      l->needs_upload = false;
+      n++;
+    }
+  }
+  needs_redraw = false;
+  return n;
+}
+
+void
+LayeredContext::composite(Context & target) {
+  for (auto & l : layers) {
+    if (!l->visible || l->opacity <= 0.0f) continue;
+    applyFilter(*l);
+    target.save();
+    target.resetTransform();
+    target.globalAlpha = l->opacity;
+    target.globalCompositeOperation = SOURCE_OVER;
+    target.shadowBlur = 0.0f;
+    target.shadowOffsetX = 0.0f;
+    target.shadowOffsetY = 0.0f;
+    target.filter.reset();
+    target.drawImage(l->getSurface(), 0, 0, target.getWidth(), target.getHeight());
+    target.restore();
+  }
+  needs_redraw = false;
+}
+
+std::vector<const LayeredContext::Layer *>
+LayeredContext::getDrawOrder() const {
+  std::vector<const Layer *> r;
+  for (auto & l : layers) {
+    if (l->visible && l->opacity > 0.0f) r.push_back(l.get());
+  }
+  return r;
+}
+
+void
+LayeredContext::applyFilter(Layer & layer) {
+  if (!layer.needs_filter) return;
+  layer.needs_filter = false;
+  if (layer.filter && !layer.filter->empty()) {
+    // the filter runs on a copy so that the layer can still be drawn on incrementally
+    auto image = layer.context->getDefaultSurface().createImage();
+    layer.filtered = layer.context->createSurface(*image);
+    layer.filter->apply(*layer.filtered, layer.context->getBlurThreshold());
+  } else {
+    layer.filtered.reset();
+  }
+}
+
+void
+LayeredContext::sortLayers() {
+  std::stable_sort(layers.begin(), layers.end(), [](const std::unique_ptr<Layer> & a, const std::unique_ptr<Layer> & b) {
+      return a->z < b->z;
+    });
+}
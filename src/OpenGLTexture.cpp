@@ -51,6 +51,16 @@
 #endif
 #endif
 
+#ifndef GL_COMPRESSED_RGBA8_ETC2_EAC
+#define GL_COMPRESSED_RGBA8_ETC2_EAC 0x9278
+#endif
+#ifndef GL_COMPRESSED_R11_EAC
+#define GL_COMPRESSED_R11_EAC 0x9270
+#endif
+#ifndef GL_COMPRESSED_RG11_EAC
+#define GL_COMPRESSED_RG11_EAC 0x9272
+#endif
+
 #include <cassert>
 #include <iostream>
 
@@ -108,6 +118,9 @@ static format_description_s getFormatDescription(InternalFormat internal_format)
   case RED_RGTC1: return { GL_COMPRESSED_RED_RGTC1, GL_RG, 0 };
   case RG_RGTC2: return { GL_COMPRESSED_RG_RGTC2, GL_RG, 0 };
   case RGB_ETC1: return { GL_COMPRESSED_RGB8_ETC2, GL_RGB, 0 };
+  case RGBA_ETC2: return { GL_COMPRESSED_RGBA8_ETC2_EAC, GL_RGBA, 0 };
+  case R11_EAC: return { GL_COMPRESSED_R11_EAC, GL_RED, 0 };
+  case RG11_EAC: return { GL_COMPRESSED_RG11_EAC, GL_RG, 0 };
   case RGB_DXT1: return { GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_RGB, 0 };
   case RGBA_DXT5: return { GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, GL_RGBA, 0 };
   case LUMINANCE_ALPHA: return { GL_RG8, GL_RG, GL_UNSIGNED_BYTE };
@@ -222,7 +235,7 @@ OpenGLTexture::updateData(const Image & image, unsigned int x, unsigned int y) {
 void
 OpenGLTexture::generateMipmaps() {
   if (need_mipmaps) {
-    if (getInternalFormat() != RGB_DXT1 && getInternalFormat() != RGB_ETC1 && getInternalFormat() != LA44 && getInternalFormat() != RED_RGTC1 && getInternalFormat() != RG_RGTC2) {
+    if (!Image::getImageFormat(getInternalFormat()).getCompression() && getInternalFormat() != LA44) {
       glGenerateMipmap(GL_TEXTURE_2D);
     } else {
       cerr << "unable to generate mipmaps for compressed texture!\n";
@@ -1,16 +1,174 @@
 #include <Path2D.h>
 
+#include <algorithm>
 #include <cmath>
 #include <glm/glm.hpp>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 using namespace canvas;
 
 void
 Path2D::arc(const Point & p, double radius, double sa, double ea, bool anticlockwise) {
-  data.push_back(PathComponent(PathComponent::ARC, p.x, p.y, radius, sa, ea, anticlockwise));
+  editData().push_back(PathComponent(PathComponent::ARC, p.x, p.y, radius, sa, ea, anticlockwise));
   current_point = Point(p.x + radius * cos(ea), p.y + radius * sin(ea));
 }
 
+void
+Path2D::transform(const Matrix & m) {
+  if (m.isIdentity() || empty()) return;
+  bool reflect = m.getDeterminant() < 0;
+  double scale = m.getScale();
+  for (auto & pc : editData()) {
+    if (pc.type == PathComponent::CLOSE) continue;
+    Point p = m.multiply(pc.x0, pc.y0);
+    pc.x0 = p.x;
+    pc.y0 = p.y;
+    if (pc.type == PathComponent::ARC) {
+      pc.radius *= scale;
+      pc.sa = m.transformAngle(pc.sa);
+      pc.ea = m.transformAngle(pc.ea);
+      if (reflect) pc.anticlockwise = !pc.anticlockwise;
+    }
+  }
+  current_point = m.multiply(current_point);
+}
+
+void
+Path2D::polyline(const float * xy, size_t n) {
+  if (!n) return;
+  auto & data = editData();
+  data.reserve(data.size() + n);
+  data.push_back(PathComponent(PathComponent::MOVE_TO, xy[0], xy[1]));
+  for (size_t i = 1; i < n; i++) {
+    data.push_back(PathComponent(PathComponent::LINE_TO, xy[2 * i], xy[2 * i + 1]));
+  }
+  current_point = Point(xy[2 * n - 2], xy[2 * n - 1]);
+}
+
+static void transformPoints(const float * input, float * output, size_t n, const Matrix & m) {
+  float a = float(m.getA()), b = float(m.getB()), c = float(m.getC()), d = float(m.getD()), e = float(m.getE()), f = float(m.getF());
+  size_t i = 0;
+#ifdef __SSE2__
+  // two points per iteration: (x0, y0, x1, y1)
+  __m128 ab = _mm_setr_ps(a, b, a, b), cd = _mm_setr_ps(c, d, c, d), ef = _mm_setr_ps(e, f, e, f);
+  for (; i + 2 <= n; i += 2) {
+    __m128 v = _mm_loadu_ps(input + 2 * i);
+    __m128 xx = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 0, 0));
+    __m128 yy = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 1, 1));
+    _mm_storeu_ps(output + 2 * i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(xx, ab), _mm_mul_ps(yy, cd)), ef));
+  }
+#endif
+  for (; i < n; i++) {
+    float x = input[2 * i], y = input[2 * i + 1];
+    output[2 * i] = a * x + c * y + e;
+    output[2 * i + 1] = b * x + d * y + f;
+  }
+}
+
+// Keeps the first, minimum, maximum and last point of each run of points
+// falling into the same column, which preserves the rendered envelope
+static size_t decimateMinMax(float * xy, size_t n, double column_width) {
+  size_t out = 0;
+  size_t i = 0;
+  while (i < n) {
+    double column = floor(xy[2 * i] / column_width);
+    size_t first = i, min_i = i, max_i = i;
+    for (i++; i < n && floor(xy[2 * i] / column_width) == column; i++) {
+      if (xy[2 * i + 1] < xy[2 * min_i + 1]) min_i = i;
+      if (xy[2 * i + 1] > xy[2 * max_i + 1]) max_i = i;
+    }
+    size_t last = i - 1;
+    size_t selected[4] = { first, min_i < max_i ? min_i : max_i, min_i < max_i ? max_i : min_i, last };
+    size_t prev = n;
+    for (unsigned int j = 0; j < 4; j++) {
+      if (selected[j] != prev) {
+	// the output never overtakes the input so the points can be compacted in place
+	xy[2 * out] = xy[2 * selected[j]];
+	xy[2 * out + 1] = xy[2 * selected[j] + 1];
+	out++;
+	prev = selected[j];
+      }
+    }
+  }
+  return out;
+}
+
+static inline double triangleArea(const float * a, const float * b, double cx, double cy) {
+  return fabs((a[0] - cx) * (b[1] - a[1]) - (a[0] - b[0]) * (cy - a[1])) / 2;
+}
+
+static size_t decimateLTTB(float * xy, size_t n, size_t threshold) {
+  if (threshold >= n || threshold < 3) return n;
+
+  std::vector<float> sampled;
+  sampled.reserve(2 * threshold);
+  sampled.push_back(xy[0]);
+  sampled.push_back(xy[1]);
+
+  double bucket_size = double(n - 2) / (threshold - 2);
+  size_t a = 0;
+  for (size_t bucket = 0; bucket < threshold - 2; bucket++) {
+    // average of the next bucket is the third point of the triangle
+    size_t next_start = size_t((bucket + 1) * bucket_size) + 1;
+    size_t next_end = size_t((bucket + 2) * bucket_size) + 1;
+    if (next_end > n) next_end = n;
+    double avg_x = 0, avg_y = 0;
+    for (size_t i = next_start; i < next_end; i++) {
+      avg_x += xy[2 * i];
+      avg_y += xy[2 * i + 1];
+    }
+    if (next_end > next_start) {
+      avg_x /= next_end - next_start;
+      avg_y /= next_end - next_start;
+    }
+
+    size_t start = size_t(bucket * bucket_size) + 1, end = size_t((bucket + 1) * bucket_size) + 1;
+    double max_area = -1;
+    size_t selected = start;
+    for (size_t i = start; i < end; i++) {
+      double area = triangleArea(xy + 2 * a, xy + 2 * i, avg_x, avg_y);
+      if (area > max_area) {
+	max_area = area;
+	selected = i;
+      }
+    }
+    sampled.push_back(xy[2 * selected]);
+    sampled.push_back(xy[2 * selected + 1]);
+    a = selected;
+  }
+  sampled.push_back(xy[2 * n - 2]);
+  sampled.push_back(xy[2 * n - 1]);
+
+  std::copy(sampled.begin(), sampled.end(), xy);
+  return sampled.size() / 2;
+}
+
+void
+Path2D::polyline(const float * xy, size_t n, const Matrix & m, double column_width, PolylineDecimation decimation) {
+  if (!n) return;
+  std::vector<float> tmp(2 * n);
+  transformPoints(xy, tmp.data(), n, m);
+
+  if (column_width > 0) {
+    if (decimation == DECIMATE_MINMAX) {
+      n = decimateMinMax(tmp.data(), n, column_width);
+    } else if (decimation == DECIMATE_LTTB) {
+      float min_x = tmp[0], max_x = tmp[0];
+      for (size_t i = 1; i < n; i++) {
+	if (tmp[2 * i] < min_x) min_x = tmp[2 * i];
+	if (tmp[2 * i] > max_x) max_x = tmp[2 * i];
+      }
+      // two points per column is enough to show the extremes
+      n = decimateLTTB(tmp.data(), n, 2 * size_t(ceil((max_x - min_x) / column_width)) + 2);
+    }
+  }
+  
+  polyline(tmp.data(), n);
+}
+
 // Implementation by node-canvas (Node canvas is a Cairo backed Canvas implementation for NodeJS)
 // Original implementation influenced by WebKit.
 void
@@ -102,6 +260,7 @@ static inline float crossProduct(const glm::vec2 & p1, const glm::vec2 & p2, con
 // points is outside the polygon.
 bool
 Path2D::isInside(float x, float y) const {
+  auto & data = getData();
   glm::vec2 point(x, y);
   int wn = 0;
   for (unsigned int i = 0; i < data.size(); i++) {
@@ -134,3 +293,121 @@ Path2D::isInside(float x, float y) const {
   // fprintf(stderr, "inside test for polygon %Ld: %s\n", id, is_inside ? "true" : "false" );
   return is_inside;
 }
+
+bool
+Path2D::isRect(double & min_x, double & min_y, double & max_x, double & max_y) const {
+  // a rectangle is moveTo followed by three or four lineTos and an optional close
+  auto & data = getData();
+  unsigned int n = data.size();
+  if (n && data.back().type == PathComponent::CLOSE) n--;
+  if (n < 4 || n > 5 || data[0].type != PathComponent::MOVE_TO) return false;
+  for (unsigned int i = 1; i < n; i++) {
+    if (data[i].type != PathComponent::LINE_TO) return false;
+  }
+  if (n == 5 && (data[4].x0 != data[0].x0 || data[4].y0 != data[0].y0)) return false;
+  // edges must alternate between horizontal and vertical
+  bool prev_horizontal = data[0].y0 == data[1].y0;
+  for (unsigned int i = 0; i < 4; i++) {
+    auto & p0 = data[i];
+    auto & p1 = data[(i + 1) % 4];
+    bool horizontal = p0.y0 == p1.y0 && p0.x0 != p1.x0;
+    bool vertical = p0.x0 == p1.x0 && p0.y0 != p1.y0;
+    if (!horizontal && !vertical) return false;
+    if (i > 0 && horizontal == prev_horizontal) return false;
+    prev_horizontal = horizontal;
+  }
+  min_x = max_x = data[0].x0;
+  min_y = max_y = data[0].y0;
+  for (unsigned int i = 1; i < 4; i++) {
+    if (data[i].x0 < min_x) min_x = data[i].x0;
+    if (data[i].y0 < min_y) min_y = data[i].y0;
+    if (data[i].x0 > max_x) max_x = data[i].x0;
+    if (data[i].y0 > max_y) max_y = data[i].y0;
+  }
+  return min_x < max_x && min_y < max_y;
+}
+
+// Walks the outline of a rounded rectangle built with moveTo, lineTo and
+// arcTo (or arc), checking that the straight segments run along the edges
+// of the bounding box and that the arcs are the four outward quarter circles
+bool
+Path2D::isRoundedRect(double & min_x, double & min_y, double & max_x, double & max_y, double & radius) const {
+  auto & data = getData();
+  if (data.size() < 5 || data[0].type != PathComponent::MOVE_TO) return false;
+  
+  // arcTo computes the tangent points in single precision
+  const double eps = 1e-3;
+  unsigned int n_arcs = 0;
+  double cx[4], cy[4], r = 0;
+  for (auto & pc : data) {
+    if (pc.type == PathComponent::MOVE_TO && &pc != &data[0]) return false;
+    if (pc.type != PathComponent::ARC) continue;
+    if (n_arcs == 4 || pc.radius <= 0 || (n_arcs && fabs(pc.radius - r) > eps)) return false;
+    double span = pc.anticlockwise ? pc.sa - pc.ea : pc.ea - pc.sa;
+    span = fmod(span, 2 * M_PI);
+    if (span < 0) span += 2 * M_PI;
+    if (fabs(span - M_PI / 2) > eps) return false;
+    // the middle of the arc must point away from the center of the rectangle
+    double mid = pc.anticlockwise ? pc.sa - M_PI / 4 : pc.sa + M_PI / 4;
+    r = pc.radius;
+    cx[n_arcs] = pc.x0 + (cos(mid) < 0 ? -r : r);
+    cy[n_arcs] = pc.y0 + (sin(mid) < 0 ? -r : r);
+    n_arcs++;
+  }
+  if (n_arcs != 4) return false;
+
+  // the corners of the bounding box implied by the arcs
+  double x0 = std::min(std::min(cx[0], cx[1]), std::min(cx[2], cx[3]));
+  double y0 = std::min(std::min(cy[0], cy[1]), std::min(cy[2], cy[3]));
+  double x1 = std::max(std::max(cx[0], cx[1]), std::max(cx[2], cx[3]));
+  double y1 = std::max(std::max(cy[0], cy[1]), std::max(cy[2], cy[3]));
+  if (x1 - x0 < 2 * r - eps || y1 - y0 < 2 * r - eps) return false;
+  bool corners[4] = { false, false, false, false };
+  for (unsigned int i = 0; i < 4; i++) {
+    bool left = fabs(cx[i] - x0) < eps, right = fabs(cx[i] - x1) < eps;
+    bool top = fabs(cy[i] - y0) < eps, bottom = fabs(cy[i] - y1) < eps;
+    if (!(left || right) || !(top || bottom)) return false;
+    corners[(right ? 1 : 0) + (bottom ? 2 : 0)] = true;
+  }
+  if (!corners[0] || !corners[1] || !corners[2] || !corners[3]) return false;
+  
+  auto isEdge = [&](const Point & a, const Point & b) {
+    if (fabs(a.x - b.x) < eps && fabs(a.y - b.y) < eps) return true;
+    if (fabs(a.x - b.x) < eps && (fabs(a.x - x0) < eps || fabs(a.x - x1) < eps)) return true;
+    if (fabs(a.y - b.y) < eps && (fabs(a.y - y0) < eps || fabs(a.y - y1) < eps)) return true;
+    return false;
+  };
+  Point first(data[0].x0, data[0].y0), current = first;
+  for (auto & pc : data) {
+    switch (pc.type) {
+    case PathComponent::MOVE_TO:
+      break;
+    case PathComponent::LINE_TO:
+      {
+	Point p(pc.x0, pc.y0);
+	if (!isEdge(current, p)) return false;
+	current = p;
+      }
+      break;
+    case PathComponent::ARC:
+      {
+	Point start(pc.x0 + r * cos(pc.sa), pc.y0 + r * sin(pc.sa));
+	if (!isEdge(current, start)) return false;
+	current = Point(pc.x0 + r * cos(pc.ea), pc.y0 + r * sin(pc.ea));
+      }
+      break;
+    case PathComponent::CLOSE:
+      if (!isEdge(current, first)) return false;
+      current = first;
+      break;
+    }
+  }
+  if (!isEdge(current, first)) return false;
+  
+  min_x = x0;
+  min_y = y0;
+  max_x = x1;
+  max_y = y1;
+  radius = r;
+  return true;
+}
@@ -1,15 +1,25 @@
 #include <PerlinSurface.h>
+#include <ThreadPool.h>
 
 using namespace std;
 using namespace canvas;
 
 #include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#if (defined(__SSE2__) || defined(_M_X64)) && !defined(USE_FIXEDPOINT)
+#include <emmintrin.h>
+#define CANVAS_PERLIN_SSE2
+#endif
+#if defined(__AVX2__) && !defined(USE_FIXEDPOINT)
+#include <immintrin.h>
+#define CANVAS_PERLIN_AVX2
+#endif
 
-#define FIXED_PERMUTATION
 #define FIXEDBITS 14
 
-#ifdef FIXED_PERMUTATION
-static unsigned char permutation[] = { 151,160,137,91,90,15,
+static const unsigned char permutation[] = { 151,160,137,91,90,15,
 				       131,13,201,95,96,53,194,233,7,225,140,36,103,30,69,142,8,99,37,240,21,10,23,
 				       190, 6,148,247,120,234,75,0,26,197,62,94,252,219,203,117,35,11,32,57,177,33,
 				       88,237,149,56,87,174,20,125,136,171,168, 68,175,74,165,71,134,139,48,27,166,
@@ -23,7 +33,12 @@ static unsigned char permutation[] = { 151,160,137,91,90,15,
 				       49,192,214, 31,181,199,106,157,184, 84,204,176,115,121,50,45,127, 4,150,254,
 				       138,236,205,93,222,114,67,29,24,72,243,141,128,195,78,66,215,61,156,180
 };
-#endif
+
+// floorf is a library call without SSE4.1
+static inline int fastFloor(float x) {
+  int i = (int)x;
+  return x < i ? i - 1 : i;
+}
 
 static inline float fade(float t) {
   return t * t * t * (t * (t * 6 - 15) + 10);
@@ -34,43 +49,18 @@ static inline float fade(float t) {
 static inline int grad(int hashval, int x, int y, int z) {
   // CONVERT LO 4 BITS OF HASH CODE INTO 12 GRADIENT DIRECTIONS.
   int h = hashval & 15;
-#if 1
-#if 1
   int u = h < 8 ? x : y;
-#else
-  int u = h & 8 ? y : x;
-#endif
-#if 1
   int v = h < 4 ? y : h == 12 || h == 14 ? x : z;
-#else 
-  int v = h & 12 ? (h == 12 || h == 14 ? x : z) : y;
-#endif
-#if 1
   return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
-#else
-  if (h & 1) u *= -1;
-  if (h & 2) v *= -1;
-  return u + v;
-#endif
-#else
-  int xf = 0, yf = 0, zf = 0;
-  if (h & 8) xf = h & 1 ? -1 : 1;
-  else yf = h & 1 ? -1 : 1;
-  if (h & 12) {
-    if (h == 12 || h == 14) xf += h & 2 ? -1 : 1;
-    else z = hf & 2 ? -1 : 1;
-  }
-  else yf += h & 2 ? -1 : 1;
-  return xf * x + yf * y + zf * z;
-#endif
 }
 
 static inline int lerp(int t, int a, int b) {
   return a + ((t * (b - a)) >> FIXEDBITS);
 }
 
-#else
+#endif
 
+// The float versions are also used by the periodic and simplex noise with USE_FIXEDPOINT
 static inline float grad(int hashval, float x, float y, float z) {
   // CONVERT LO 4 BITS OF HASH CODE INTO 12 GRADIENT DIRECTIONS.
   int h = hashval & 15;
@@ -83,106 +73,400 @@ static inline float lerp(float t, float a, float b) {
   return a + t * (b - a);
 }
 
-#endif
+// The lattice coordinates of a cell and of its far side, wrapped to the period if there is one.
+// The corners on the far side of the last cell share the hashes of the first cell.
+static inline void wrapLattice(int fl, int period, int & i0, int & i1) {
+  if (period) {
+    i0 = ((fl % period) + period) % period;
+    i1 = i0 + 1 == period ? 0 : i0 + 1;
+  } else {
+    i0 = fl & 255;
+    i1 = i0 + 1;
+  }
+  i0 &= 255;
+  i1 &= 511;
+}
 
-PerlinSurface::PerlinSurface(unsigned int _logical_width, unsigned int _logical_height, unsigned int _actual_width, unsigned int _actual_height, int _octaves, float _alpha, float _beta)
-  : Surface(_logical_width, _logical_height, _actual_width, _actual_height), octaves(_octaves), alpha(_alpha), beta(_beta) 
-{  
-  
-#ifndef FIXED_PERMUTATION
-  int i, permutation[256];
-  for (i = 0; i < 256; i++) {
-    permutation[i] = i;
+static const float F2 = 0.3660254f, G2 = 0.21132487f; // (sqrt(3) - 1) / 2 and (3 - sqrt(3)) / 6
+static const float F3 = 1.0f / 3.0f, G3 = 1.0f / 6.0f;
+
+// The vector kernels evaluate horizontally adjacent samples. For Perlin noise
+// y and z and their part of the hash are shared by all lanes and only x is
+// vectorized, while the skew of simplex noise makes all of the cell
+// coordinates vary by lane. Without FMA they match the scalar code exactly.
+
+#ifdef CANVAS_PERLIN_SSE2
+
+static inline __m128 select4(__m128 mask, __m128 a, __m128 b) {
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline __m128 floor4(__m128 x) {
+  __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+  return _mm_sub_ps(t, _mm_and_ps(_mm_cmplt_ps(x, t), _mm_set1_ps(1.0f)));
+}
+
+static inline __m128 fade4(__m128 t) {
+  __m128 t3 = _mm_mul_ps(_mm_mul_ps(t, t), t);
+  return _mm_mul_ps(t3, _mm_add_ps(_mm_mul_ps(t, _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f))), _mm_set1_ps(10.0f)));
+}
+
+static inline __m128 lerp4(__m128 t, __m128 a, __m128 b) {
+  return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+}
+
+static inline __m128 grad4(__m128i hashval, __m128 x, __m128 y, __m128 z) {
+  __m128i h = _mm_and_si128(hashval, _mm_set1_epi32(15));
+  __m128 u = select4(_mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(8))), x, y);
+  __m128 is_x = _mm_castsi128_ps(_mm_or_si128(_mm_cmpeq_epi32(h, _mm_set1_epi32(12)), _mm_cmpeq_epi32(h, _mm_set1_epi32(14))));
+  __m128 v = select4(_mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(4))), y, select4(is_x, x, z));
+  // bits 0 and 1 of the hash flip the signs of u and v
+  __m128 sign_u = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(1)), 31));
+  __m128 sign_v = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(2)), 30));
+  return _mm_add_ps(_mm_xor_ps(u, sign_u), _mm_xor_ps(v, sign_v));
+}
+
+// Wraps the lattice x coordinates of the lanes like wrapLattice(). The
+// division may round to the neighboring multiple of the period, which the
+// comparisons correct.
+static inline void wrapLattice4(__m128 flx, int period, __m128i & i0, __m128i & i1) {
+  __m128i one = _mm_set1_epi32(1);
+  if (period) {
+    __m128 pf = _mm_set1_ps(float(period));
+    __m128i pi = _mm_set1_epi32(period);
+    i0 = _mm_cvttps_epi32(_mm_sub_ps(flx, _mm_mul_ps(floor4(_mm_div_ps(flx, pf)), pf)));
+    i0 = _mm_add_epi32(i0, _mm_and_si128(_mm_cmplt_epi32(i0, _mm_setzero_si128()), pi));
+    i0 = _mm_sub_epi32(i0, _mm_andnot_si128(_mm_cmplt_epi32(i0, pi), pi));
+    i1 = _mm_add_epi32(i0, one);
+    i1 = _mm_andnot_si128(_mm_cmpeq_epi32(i1, pi), i1);
+  } else {
+    i0 = _mm_and_si128(_mm_cvttps_epi32(flx), _mm_set1_epi32(255));
+    i1 = _mm_add_epi32(i0, one);
+  }
+  i0 = _mm_and_si128(i0, _mm_set1_epi32(255));
+  i1 = _mm_and_si128(i1, _mm_set1_epi32(511));
+}
+
+// SSE2 has no gather, so the permutation is looked up for each lane.
+// A nonzero px or py makes the noise periodic like evaluatePeriodicPerlin().
+static inline __m128 perlin4(const int * p, __m128 x, float y, float z, int px, int py) {
+  int fly = (int)floorf(y), flz = (int)floorf(z);
+  int Y0, Y1, Z = flz & 255;
+  wrapLattice(fly, py, Y0, Y1);
+  y -= fly;
+  z -= flz;
+  float v = fade(y), w = fade(z);
+
+  __m128 flx = floor4(x);
+  x = _mm_sub_ps(x, flx);
+  __m128 u = fade4(x);
+  __m128i X0v, X1v;
+  wrapLattice4(flx, px, X0v, X1v);
+  alignas(16) int X0[4], X1[4], h[8][4];
+  _mm_store_si128((__m128i *)X0, X0v);
+  _mm_store_si128((__m128i *)X1, X1v);
+  for (int i = 0; i < 4; i++) {
+    int AA = p[p[X0[i]] + Y0] + Z, AB = p[p[X0[i]] + Y1] + Z;
+    int BA = p[p[X1[i]] + Y0] + Z, BB = p[p[X1[i]] + Y1] + Z;
+    h[0][i] = p[AA];
+    h[1][i] = p[BA];
+    h[2][i] = p[AB];
+    h[3][i] = p[BB];
+    h[4][i] = p[AA + 1];
+    h[5][i] = p[BA + 1];
+    h[6][i] = p[AB + 1];
+    h[7][i] = p[BB + 1];
+  }
+  __m128 x1 = _mm_sub_ps(x, _mm_set1_ps(1.0f));
+  __m128 y0 = _mm_set1_ps(y), y1 = _mm_set1_ps(y - 1), z0 = _mm_set1_ps(z), z1 = _mm_set1_ps(z - 1);
+  __m128 vv = _mm_set1_ps(v), ww = _mm_set1_ps(w);
+#define H(i) _mm_load_si128((const __m128i *)h[i])
+  return lerp4(ww, lerp4(vv, lerp4(u, grad4(H(0), x,  y0, z0),
+				      grad4(H(1), x1, y0, z0)),
+			    lerp4(u, grad4(H(2), x,  y1, z0),
+				      grad4(H(3), x1, y1, z0))),
+	       lerp4(vv, lerp4(u, grad4(H(4), x,  y0, z1),
+				      grad4(H(5), x1, y0, z1)),
+			 lerp4(u, grad4(H(6), x,  y1, z1),
+				      grad4(H(7), x1, y1, z1))));
+#undef H
+}
+
+static inline __m128 simplexCorner4(__m128i h, __m128 x, __m128 y) {
+  __m128 t = _mm_sub_ps(_mm_sub_ps(_mm_set1_ps(0.5f), _mm_mul_ps(x, x)), _mm_mul_ps(y, y));
+  t = _mm_and_ps(_mm_cmpgt_ps(t, _mm_setzero_ps()), _mm_mul_ps(t, t));
+  return _mm_mul_ps(_mm_mul_ps(t, t), grad4(h, x, y, _mm_setzero_ps()));
+}
+
+static inline __m128 simplexCorner4(__m128i h, __m128 x, __m128 y, __m128 z) {
+  __m128 t = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(_mm_set1_ps(0.6f), _mm_mul_ps(x, x)), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+  t = _mm_and_ps(_mm_cmpgt_ps(t, _mm_setzero_ps()), _mm_mul_ps(t, t));
+  return _mm_mul_ps(_mm_mul_ps(t, t), grad4(h, x, y, z));
+}
+
+static inline __m128 simplex4(const int * p, __m128 x, float y) {
+  __m128 one = _mm_set1_ps(1.0f), yy = _mm_set1_ps(y);
+  __m128 s = _mm_mul_ps(_mm_add_ps(x, yy), _mm_set1_ps(F2));
+  __m128i i = _mm_cvttps_epi32(floor4(_mm_add_ps(x, s))), j = _mm_cvttps_epi32(floor4(_mm_add_ps(yy, s)));
+  __m128 t = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(i, j)), _mm_set1_ps(G2));
+  __m128 x0 = _mm_sub_ps(x, _mm_sub_ps(_mm_cvtepi32_ps(i), t)), y0 = _mm_sub_ps(yy, _mm_sub_ps(_mm_cvtepi32_ps(j), t));
+  __m128 lower = _mm_cmpgt_ps(x0, y0);
+  __m128 i1 = _mm_and_ps(lower, one), j1 = _mm_andnot_ps(lower, one);
+  __m128 x1 = _mm_add_ps(_mm_sub_ps(x0, i1), _mm_set1_ps(G2)), y1 = _mm_add_ps(_mm_sub_ps(y0, j1), _mm_set1_ps(G2));
+  __m128 x2 = _mm_add_ps(_mm_sub_ps(x0, one), _mm_set1_ps(2.0f * G2)), y2 = _mm_add_ps(_mm_sub_ps(y0, one), _mm_set1_ps(2.0f * G2));
+  alignas(16) int ii[4], jj[4], o[4], h[3][4];
+  _mm_store_si128((__m128i *)ii, _mm_and_si128(i, _mm_set1_epi32(255)));
+  _mm_store_si128((__m128i *)jj, _mm_and_si128(j, _mm_set1_epi32(255)));
+  _mm_store_si128((__m128i *)o, _mm_and_si128(_mm_castps_si128(lower), _mm_set1_epi32(1)));
+  for (int k = 0; k < 4; k++) {
+    h[0][k] = p[ii[k] + p[jj[k]]];
+    h[1][k] = p[ii[k] + o[k] + p[jj[k] + 1 - o[k]]];
+    h[2][k] = p[ii[k] + 1 + p[jj[k] + 1]];
   }
-  for (i = 0; i < 256; i++) {
-    int tmp = permutation[i];
-    int j = rand_r(&seed) & 255;
-    permutation[i] = permutation[j];
-    permutation[j] = tmp;
+#define H(i) _mm_load_si128((const __m128i *)h[i])
+  return _mm_mul_ps(_mm_set1_ps(70.0f), _mm_add_ps(_mm_add_ps(simplexCorner4(H(0), x0, y0),
+							       simplexCorner4(H(1), x1, y1)),
+						    simplexCorner4(H(2), x2, y2)));
+#undef H
+}
+
+static inline __m128 simplex4(const int * p, __m128 x, float y, float z) {
+  __m128 one = _mm_set1_ps(1.0f), yy = _mm_set1_ps(y), zz = _mm_set1_ps(z);
+  __m128 s = _mm_mul_ps(_mm_add_ps(_mm_add_ps(x, yy), zz), _mm_set1_ps(F3));
+  __m128i i = _mm_cvttps_epi32(floor4(_mm_add_ps(x, s)));
+  __m128i j = _mm_cvttps_epi32(floor4(_mm_add_ps(yy, s)));
+  __m128i k = _mm_cvttps_epi32(floor4(_mm_add_ps(zz, s)));
+  __m128 t = _mm_mul_ps(_mm_cvtepi32_ps(_mm_add_epi32(_mm_add_epi32(i, j), k)), _mm_set1_ps(G3));
+  __m128 x0 = _mm_sub_ps(x, _mm_sub_ps(_mm_cvtepi32_ps(i), t));
+  __m128 y0 = _mm_sub_ps(yy, _mm_sub_ps(_mm_cvtepi32_ps(j), t));
+  __m128 z0 = _mm_sub_ps(zz, _mm_sub_ps(_mm_cvtepi32_ps(k), t));
+  // the same ranking as in the scalar code, as lane masks
+  __m128 xy = _mm_cmpge_ps(x0, y0), xz = _mm_cmpge_ps(x0, z0), yz = _mm_cmpge_ps(y0, z0);
+  __m128 i1 = _mm_and_ps(xy, xz), j1 = _mm_andnot_ps(xy, yz), k1 = _mm_andnot_ps(xz, _mm_andnot_ps(yz, _mm_castsi128_ps(_mm_set1_epi32(-1))));
+  __m128 i2 = _mm_or_ps(xy, xz), j2 = _mm_or_ps(_mm_andnot_ps(xy, _mm_castsi128_ps(_mm_set1_epi32(-1))), yz), k2 = _mm_andnot_ps(_mm_and_ps(xz, yz), _mm_castsi128_ps(_mm_set1_epi32(-1)));
+  __m128 g1 = _mm_set1_ps(G3), g2 = _mm_set1_ps(2.0f * G3), g3 = _mm_set1_ps(3.0f * G3);
+  __m128 x1 = _mm_add_ps(_mm_sub_ps(x0, _mm_and_ps(i1, one)), g1), y1 = _mm_add_ps(_mm_sub_ps(y0, _mm_and_ps(j1, one)), g1), z1 = _mm_add_ps(_mm_sub_ps(z0, _mm_and_ps(k1, one)), g1);
+  __m128 x2 = _mm_add_ps(_mm_sub_ps(x0, _mm_and_ps(i2, one)), g2), y2 = _mm_add_ps(_mm_sub_ps(y0, _mm_and_ps(j2, one)), g2), z2 = _mm_add_ps(_mm_sub_ps(z0, _mm_and_ps(k2, one)), g2);
+  __m128 x3 = _mm_add_ps(_mm_sub_ps(x0, one), g3), y3 = _mm_add_ps(_mm_sub_ps(y0, one), g3), z3 = _mm_add_ps(_mm_sub_ps(z0, one), g3);
+  alignas(16) int ii[4], jj[4], kk[4], o1[3][4], o2[3][4], h[4][4];
+  __m128i byte = _mm_set1_epi32(255), bit = _mm_set1_epi32(1);
+  _mm_store_si128((__m128i *)ii, _mm_and_si128(i, byte));
+  _mm_store_si128((__m128i *)jj, _mm_and_si128(j, byte));
+  _mm_store_si128((__m128i *)kk, _mm_and_si128(k, byte));
+  _mm_store_si128((__m128i *)o1[0], _mm_and_si128(_mm_castps_si128(i1), bit));
+  _mm_store_si128((__m128i *)o1[1], _mm_and_si128(_mm_castps_si128(j1), bit));
+  _mm_store_si128((__m128i *)o1[2], _mm_and_si128(_mm_castps_si128(k1), bit));
+  _mm_store_si128((__m128i *)o2[0], _mm_and_si128(_mm_castps_si128(i2), bit));
+  _mm_store_si128((__m128i *)o2[1], _mm_and_si128(_mm_castps_si128(j2), bit));
+  _mm_store_si128((__m128i *)o2[2], _mm_and_si128(_mm_castps_si128(k2), bit));
+  for (int l = 0; l < 4; l++) {
+    h[0][l] = p[ii[l] + p[jj[l] + p[kk[l]]]];
+    h[1][l] = p[ii[l] + o1[0][l] + p[jj[l] + o1[1][l] + p[kk[l] + o1[2][l]]]];
+    h[2][l] = p[ii[l] + o2[0][l] + p[jj[l] + o2[1][l] + p[kk[l] + o2[2][l]]]];
+    h[3][l] = p[ii[l] + 1 + p[jj[l] + 1 + p[kk[l] + 1]]];
   }
+#define H(i) _mm_load_si128((const __m128i *)h[i])
+  return _mm_mul_ps(_mm_set1_ps(32.0f), _mm_add_ps(_mm_add_ps(_mm_add_ps(simplexCorner4(H(0), x0, y0, z0),
+									  simplexCorner4(H(1), x1, y1, z1)),
+							       simplexCorner4(H(2), x2, y2, z2)),
+						    simplexCorner4(H(3), x3, y3, z3)));
+#undef H
+}
+
+#endif
+
+#ifdef CANVAS_PERLIN_AVX2
+
+static inline __m256 fade8(__m256 t) {
+  __m256 t3 = _mm256_mul_ps(_mm256_mul_ps(t, t), t);
+#ifdef __FMA__
+  return _mm256_mul_ps(t3, _mm256_fmadd_ps(t, _mm256_fmsub_ps(t, _mm256_set1_ps(6.0f), _mm256_set1_ps(15.0f)), _mm256_set1_ps(10.0f)));
+#else
+  return _mm256_mul_ps(t3, _mm256_add_ps(_mm256_mul_ps(t, _mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6.0f)), _mm256_set1_ps(15.0f))), _mm256_set1_ps(10.0f)));
+#endif
+}
+
+static inline __m256 lerp8(__m256 t, __m256 a, __m256 b) {
+#ifdef __FMA__
+  return _mm256_fmadd_ps(t, _mm256_sub_ps(b, a), a);
+#else
+  return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
 #endif
-  for(int i = 0; i < 256 ; i++) {
-    p[256 + i] = p[i] = permutation[i]; 
+}
+
+static inline __m256 grad8(__m256i hashval, __m256 x, __m256 y, __m256 z) {
+  __m256i h = _mm256_and_si256(hashval, _mm256_set1_epi32(15));
+  __m256 u = _mm256_blendv_ps(y, x, _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(8), h)));
+  __m256 is_x = _mm256_castsi256_ps(_mm256_or_si256(_mm256_cmpeq_epi32(h, _mm256_set1_epi32(12)), _mm256_cmpeq_epi32(h, _mm256_set1_epi32(14))));
+  __m256 v = _mm256_blendv_ps(_mm256_blendv_ps(z, x, is_x), y, _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(4), h)));
+  __m256 sign_u = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(1)), 31));
+  __m256 sign_v = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(2)), 30));
+  return _mm256_add_ps(_mm256_xor_ps(u, sign_u), _mm256_xor_ps(v, sign_v));
+}
+
+static inline void wrapLattice8(__m256 flx, int period, __m256i & i0, __m256i & i1) {
+  __m256i one = _mm256_set1_epi32(1);
+  if (period) {
+    __m256 pf = _mm256_set1_ps(float(period));
+    __m256i pi = _mm256_set1_epi32(period);
+    i0 = _mm256_cvttps_epi32(_mm256_sub_ps(flx, _mm256_mul_ps(_mm256_floor_ps(_mm256_div_ps(flx, pf)), pf)));
+    i0 = _mm256_add_epi32(i0, _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), i0), pi));
+    i0 = _mm256_sub_epi32(i0, _mm256_andnot_si256(_mm256_cmpgt_epi32(pi, i0), pi));
+    i1 = _mm256_add_epi32(i0, one);
+    i1 = _mm256_andnot_si256(_mm256_cmpeq_epi32(i1, pi), i1);
+  } else {
+    i0 = _mm256_and_si256(_mm256_cvttps_epi32(flx), _mm256_set1_epi32(255));
+    i1 = _mm256_add_epi32(i0, one);
   }
+  i0 = _mm256_and_si256(i0, _mm256_set1_epi32(255));
+  i1 = _mm256_and_si256(i1, _mm256_set1_epi32(511));
+}
+
+#define GATHER(i) _mm256_i32gather_epi32(p, i, 4)
+
+// The hashes of the eight corners are gathered from the permutation for all lanes at once
+static inline __m256 perlin8(const int * p, __m256 x, float y, float z, int px, int py) {
+  int fly = (int)floorf(y), flz = (int)floorf(z);
+  int Y0, Y1, Z = flz & 255;
+  wrapLattice(fly, py, Y0, Y1);
+  y -= fly;
+  z -= flz;
+  float v = fade(y), w = fade(z);
+
+  __m256 flx = _mm256_floor_ps(x);
+  x = _mm256_sub_ps(x, flx);
+  __m256 u = fade8(x);
+  __m256i X0, X1;
+  wrapLattice8(flx, px, X0, X1);
+  __m256i one = _mm256_set1_epi32(1), ZZ = _mm256_set1_epi32(Z);
+  __m256i A = GATHER(X0), B = GATHER(X1);
+  __m256i AA = _mm256_add_epi32(GATHER(_mm256_add_epi32(A, _mm256_set1_epi32(Y0))), ZZ);
+  __m256i AB = _mm256_add_epi32(GATHER(_mm256_add_epi32(A, _mm256_set1_epi32(Y1))), ZZ);
+  __m256i BA = _mm256_add_epi32(GATHER(_mm256_add_epi32(B, _mm256_set1_epi32(Y0))), ZZ);
+  __m256i BB = _mm256_add_epi32(GATHER(_mm256_add_epi32(B, _mm256_set1_epi32(Y1))), ZZ);
+
+  __m256 x1 = _mm256_sub_ps(x, _mm256_set1_ps(1.0f));
+  __m256 y0 = _mm256_set1_ps(y), y1 = _mm256_set1_ps(y - 1), z0 = _mm256_set1_ps(z), z1 = _mm256_set1_ps(z - 1);
+  __m256 vv = _mm256_set1_ps(v), ww = _mm256_set1_ps(w);
+#define G1(i) GATHER(_mm256_add_epi32(i, one))
+  return lerp8(ww, lerp8(vv, lerp8(u, grad8(GATHER(AA), x,  y0, z0),
+				      grad8(GATHER(BA), x1, y0, z0)),
+			    lerp8(u, grad8(GATHER(AB), x,  y1, z0),
+				      grad8(GATHER(BB), x1, y1, z0))),
+	       lerp8(vv, lerp8(u, grad8(G1(AA), x,  y0, z1),
+				      grad8(G1(BA), x1, y0, z1)),
+			 lerp8(u, grad8(G1(AB), x,  y1, z1),
+				      grad8(G1(BB), x1, y1, z1))));
+#undef G1
+}
+
+static inline __m256 simplexCorner8(__m256i h, __m256 x, __m256 y) {
+  __m256 t = _mm256_sub_ps(_mm256_sub_ps(_mm256_set1_ps(0.5f), _mm256_mul_ps(x, x)), _mm256_mul_ps(y, y));
+  t = _mm256_and_ps(_mm256_cmp_ps(t, _mm256_setzero_ps(), _CMP_GT_OQ), _mm256_mul_ps(t, t));
+  return _mm256_mul_ps(_mm256_mul_ps(t, t), grad8(h, x, y, _mm256_setzero_ps()));
+}
+
+static inline __m256 simplexCorner8(__m256i h, __m256 x, __m256 y, __m256 z) {
+  __m256 t = _mm256_sub_ps(_mm256_sub_ps(_mm256_sub_ps(_mm256_set1_ps(0.6f), _mm256_mul_ps(x, x)), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z));
+  t = _mm256_and_ps(_mm256_cmp_ps(t, _mm256_setzero_ps(), _CMP_GT_OQ), _mm256_mul_ps(t, t));
+  return _mm256_mul_ps(_mm256_mul_ps(t, t), grad8(h, x, y, z));
+}
+
+static inline __m256 simplex8(const int * p, __m256 x, float y) {
+  __m256 one = _mm256_set1_ps(1.0f), yy = _mm256_set1_ps(y);
+  __m256 s = _mm256_mul_ps(_mm256_add_ps(x, yy), _mm256_set1_ps(F2));
+  __m256i i = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(x, s))), j = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(yy, s)));
+  __m256 t = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(i, j)), _mm256_set1_ps(G2));
+  __m256 x0 = _mm256_sub_ps(x, _mm256_sub_ps(_mm256_cvtepi32_ps(i), t)), y0 = _mm256_sub_ps(yy, _mm256_sub_ps(_mm256_cvtepi32_ps(j), t));
+  __m256 lower = _mm256_cmp_ps(x0, y0, _CMP_GT_OQ);
+  __m256 i1 = _mm256_and_ps(lower, one), j1 = _mm256_andnot_ps(lower, one);
+  __m256 x1 = _mm256_add_ps(_mm256_sub_ps(x0, i1), _mm256_set1_ps(G2)), y1 = _mm256_add_ps(_mm256_sub_ps(y0, j1), _mm256_set1_ps(G2));
+  __m256 x2 = _mm256_add_ps(_mm256_sub_ps(x0, one), _mm256_set1_ps(2.0f * G2)), y2 = _mm256_add_ps(_mm256_sub_ps(y0, one), _mm256_set1_ps(2.0f * G2));
+  __m256i byte = _mm256_set1_epi32(255), bit = _mm256_set1_epi32(1);
+  __m256i ii = _mm256_and_si256(i, byte), jj = _mm256_and_si256(j, byte);
+  __m256i o = _mm256_and_si256(_mm256_castps_si256(lower), bit);
+  __m256i h0 = GATHER(_mm256_add_epi32(ii, GATHER(jj)));
+  __m256i h1 = GATHER(_mm256_add_epi32(_mm256_add_epi32(ii, o), GATHER(_mm256_sub_epi32(_mm256_add_epi32(jj, bit), o))));
+  __m256i h2 = GATHER(_mm256_add_epi32(_mm256_add_epi32(ii, bit), GATHER(_mm256_add_epi32(jj, bit))));
+  return _mm256_mul_ps(_mm256_set1_ps(70.0f), _mm256_add_ps(_mm256_add_ps(simplexCorner8(h0, x0, y0),
+									 simplexCorner8(h1, x1, y1)),
+							      simplexCorner8(h2, x2, y2)));
+}
+
+static inline __m256 simplex8(const int * p, __m256 x, float y, float z) {
+  __m256 one = _mm256_set1_ps(1.0f), yy = _mm256_set1_ps(y), zz = _mm256_set1_ps(z);
+  __m256 s = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(x, yy), zz), _mm256_set1_ps(F3));
+  __m256i i = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(x, s)));
+  __m256i j = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(yy, s)));
+  __m256i k = _mm256_cvttps_epi32(_mm256_floor_ps(_mm256_add_ps(zz, s)));
+  __m256 t = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_add_epi32(i, j), k)), _mm256_set1_ps(G3));
+  __m256 x0 = _mm256_sub_ps(x, _mm256_sub_ps(_mm256_cvtepi32_ps(i), t));
+  __m256 y0 = _mm256_sub_ps(yy, _mm256_sub_ps(_mm256_cvtepi32_ps(j), t));
+  __m256 z0 = _mm256_sub_ps(zz, _mm256_sub_ps(_mm256_cvtepi32_ps(k), t));
+  __m256 xy = _mm256_cmp_ps(x0, y0, _CMP_GE_OQ), xz = _mm256_cmp_ps(x0, z0, _CMP_GE_OQ), yz = _mm256_cmp_ps(y0, z0, _CMP_GE_OQ);
+  __m256 ones = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+  __m256 i1 = _mm256_and_ps(xy, xz), j1 = _mm256_andnot_ps(xy, yz), k1 = _mm256_andnot_ps(xz, _mm256_andnot_ps(yz, ones));
+  __m256 i2 = _mm256_or_ps(xy, xz), j2 = _mm256_or_ps(_mm256_andnot_ps(xy, ones), yz), k2 = _mm256_andnot_ps(_mm256_and_ps(xz, yz), ones);
+  __m256 g1 = _mm256_set1_ps(G3), g2 = _mm256_set1_ps(2.0f * G3), g3 = _mm256_set1_ps(3.0f * G3);
+  __m256 x1 = _mm256_add_ps(_mm256_sub_ps(x0, _mm256_and_ps(i1, one)), g1), y1 = _mm256_add_ps(_mm256_sub_ps(y0, _mm256_and_ps(j1, one)), g1), z1 = _mm256_add_ps(_mm256_sub_ps(z0, _mm256_and_ps(k1, one)), g1);
+  __m256 x2 = _mm256_add_ps(_mm256_sub_ps(x0, _mm256_and_ps(i2, one)), g2), y2 = _mm256_add_ps(_mm256_sub_ps(y0, _mm256_and_ps(j2, one)), g2), z2 = _mm256_add_ps(_mm256_sub_ps(z0, _mm256_and_ps(k2, one)), g2);
+  __m256 x3 = _mm256_add_ps(_mm256_sub_ps(x0, one), g3), y3 = _mm256_add_ps(_mm256_sub_ps(y0, one), g3), z3 = _mm256_add_ps(_mm256_sub_ps(z0, one), g3);
+  __m256i byte = _mm256_set1_epi32(255), bit = _mm256_set1_epi32(1);
+  __m256i ii = _mm256_and_si256(i, byte), jj = _mm256_and_si256(j, byte), kk = _mm256_and_si256(k, byte);
+#define CORNER(oi, oj, ok) GATHER(_mm256_add_epi32(_mm256_add_epi32(ii, oi), GATHER(_mm256_add_epi32(_mm256_add_epi32(jj, oj), GATHER(_mm256_add_epi32(kk, ok))))))
+#define BIT(m) _mm256_and_si256(_mm256_castps_si256(m), bit)
+  __m256i h0 = CORNER(_mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256());
+  __m256i h1 = CORNER(BIT(i1), BIT(j1), BIT(k1));
+  __m256i h2 = CORNER(BIT(i2), BIT(j2), BIT(k2));
+  __m256i h3 = CORNER(bit, bit, bit);
+#undef CORNER
+#undef BIT
+  return _mm256_mul_ps(_mm256_set1_ps(32.0f), _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(simplexCorner8(h0, x0, y0, z0),
+										  simplexCorner8(h1, x1, y1, z1)),
+								       simplexCorner8(h2, x2, y2, z2)),
+							    simplexCorner8(h3, x3, y3, z3)));
+}
+
+#undef GATHER
+
+#endif
+
+PerlinSurface::PerlinSurface(unsigned int _logical_width, unsigned int _logical_height, unsigned int _actual_width, unsigned int _actual_height, int _octaves, float _alpha, float _beta, unsigned int _seed)
+  : Surface(_logical_width, _logical_height, _actual_width, _actual_height, RGBA8), octaves(_octaves), alpha(_alpha), beta(_beta), seed(_seed)
+{  
+  initializePermutation();
 #ifdef USE_FIXEDPOINT
   int n = 1 << FIXEDBITS;
   fadetbl = new int[n];
   for (int i = 0; i < n; i++) {
     fadetbl[i] = (int)(fade((float)i / n) * n);
   }
-  for (int h = 0; h < 15; h++) {
-    int xf = 0, yf = 0, zf = 0;
-    if (h & 8) xf = h & 1 ? -1 : 1;
-    else yf = h & 1 ? -1 : 1;
-    if (h & 12) {
-      if (h == 12 || h == 14) xf += h & 2 ? -1 : 1;
-      else zf = h & 2 ? -1 : 1;
-    }
-    else yf += h & 2 ? -1 : 1;
-    xftable[h] = xf;
-    yftable[h] = yf;
-    zftable[h] = zf;
-  }
 #endif
 }
 
 float
 PerlinSurface::evaluatePerlin(float x, float y, float z) {
 #ifdef USE_FIXEDPOINT
-  int b = 1 << FIXEDBITS;
-  int bm = b - 1;
-  float fpf = 1.0 / b;
-#endif  
-#ifdef USE_FIXEDPOINT
-#if 1
-  int x = int(vec[i].x * b), y = int(vec[i].y * b), z = int(vec[i].z * b);
-#else
-  int x = 0, y = 0, z = 0;
-#endif
-#if 1
-  int flx = x >> FIXEDBITS, fly = y >> FIXEDBITS, flz = z >> FIXEDBITS;
-  int X = flx & 255, Y = fly & 255, Z = flz & 255;
-  x = x & bm;
-  y = y & bm;
-  z = z & bm;
-  int u = fadetbl[x], v = fadetbl[y], w = fadetbl[z];
+  // The coordinates have FIXEDBITS fractional bits, and the fade curve is looked up from a table
+  const int b = 1 << FIXEDBITS, bm = b - 1;
+  int xi = int(floorf(x * b)), yi = int(floorf(y * b)), zi = int(floorf(z * b));
+  int X = (xi >> FIXEDBITS) & 255, Y = (yi >> FIXEDBITS) & 255, Z = (zi >> FIXEDBITS) & 255;
+  xi &= bm;
+  yi &= bm;
+  zi &= bm;
+  int u = fadetbl[xi], v = fadetbl[yi], w = fadetbl[zi];
   int A = p[X    ] + Y, AA = p[A] + Z, AB = p[A + 1] + Z;
   int B = p[X + 1] + Y, BA = p[B] + Z, BB = p[B + 1] + Z;
-#else 
-  int u = 0, v = 0, w = 0;
-  int A = 0, B = 0, AA = 0, AB = 0, BA = 0, BB = 0;
-#endif
-  int x2 = x - b, y2 = y - b, z2 = z - b;
-#if 1
-  int g1 = grad(p[AA  ], x,   y,  z  );
-  int g2 = grad(p[BA  ], x2,  y,  z  );
-  int g3 = grad(p[AB  ], x,   y2, z  );
-  int g4 = grad(p[BB  ], x2,  y2, z  );
-  int g5 = grad(p[AA+1], x,   y,  z2 );
-  int g6 = grad(p[BA+1], x2,  y,  z2 );
-  int g7 = grad(p[AB+1], x,   y2, z2 );
-  int g8 = grad(p[BB+1], x2,  y2, z2 );
-#else
-  int h;
-  h = p[AA  ] & 15; int g1 = xftable[h] * x  + yftable[h] * y  + zftable[h] * z;
-  h = p[BA  ] & 15; int g2 = xftable[h] * x2 + yftable[h] * y  + zftable[h] * z;
-  h = p[AB  ] & 15; int g3 = xftable[h] * x  + yftable[h] * y2 + zftable[h] * z;
-  h = p[BB  ] & 15; int g4 = xftable[h] * x2 + yftable[h] * y2 + zftable[h] * z;
-  h = p[AA+1] & 15; int g5 = xftable[h] * x  + yftable[h] * y  + zftable[h] * z2;
-  h = p[BA+1] & 15; int g6 = xftable[h] * x2 + yftable[h] * y  + zftable[h] * z2;
-  h = p[AB+1] & 15; int g7 = xftable[h] * x  + yftable[h] * y2 + zftable[h] * z2;
-  h = p[BB+1] & 15; int g8 = xftable[h] * x2 + yftable[h] * y2 + zftable[h] * z2;
-  // int g1 = 0, g2 = 0, g3 = 0, g4 = 0, g5 = 0, g6 = 0, g7 = 0, g8 = 0;
-#endif
-#if 1
-  int val = lerp(w, lerp(v, lerp(u, g1, g2),
-			 lerp(u, g3, g4)),
-		 lerp(v, lerp(u, g5, g6),
-		      lerp(u, g7, g8)));
-#else 
-  int val = 0;
-#endif
-  return fpf * val;
+  int x2 = xi - b, y2 = yi - b, z2 = zi - b;
+  int val = lerp(w, lerp(v, lerp(u, grad(p[AA  ], xi,  yi,  zi ),
+				  grad(p[BA  ], x2,  yi,  zi )),
+			  lerp(u, grad(p[AB  ], xi,  y2,  zi ),
+				  grad(p[BB  ], x2,  y2,  zi ))),
+		 lerp(v, lerp(u, grad(p[AA+1], xi,  yi,  z2 ),
+				  grad(p[BA+1], x2,  yi,  z2 )),
+			  lerp(u, grad(p[AB+1], xi,  y2,  z2 ),
+				  grad(p[BB+1], x2,  y2,  z2 ))));
+  return float(val) / b;
 #else
   
   // Find the unit cube that contains the point
@@ -210,16 +494,273 @@ PerlinSurface::evaluatePerlin(float x, float y, float z) {
 #endif
 }
 
+float
+PerlinSurface::evaluatePeriodicPerlin(float x, float y, float z, int px, int py) {
+  int flx = (int)floorf(x), fly = (int)floorf(y), flz = (int)floorf(z);
+  int X0, X1, Y0, Y1, Z = flz & 255;
+  wrapLattice(flx, px, X0, X1);
+  wrapLattice(fly, py, Y0, Y1);
+  x -= flx;
+  y -= fly;
+  z -= flz;
+  float u = fade(x), v = fade(y), w = fade(z);
+  int AA = p[p[X0] + Y0] + Z, AB = p[p[X0] + Y1] + Z;
+  int BA = p[p[X1] + Y0] + Z, BB = p[p[X1] + Y1] + Z;
+  return lerp(w, lerp(v, lerp(u, grad(p[AA  ], x,   y,   z  ),
+			         grad(p[BA  ], x-1, y,   z  )),
+		         lerp(u, grad(p[AB  ], x,   y-1, z  ),
+			         grad(p[BB  ], x-1, y-1, z  ))),
+	         lerp(v, lerp(u, grad(p[AA+1], x,   y,   z-1),
+			         grad(p[BA+1], x-1, y,   z-1)),
+		         lerp(u, grad(p[AB+1], x,   y-1, z-1),
+			         grad(p[BB+1], x-1, y-1, z-1))));
+}
+
+// The contribution of a simplex corner falls to zero at a radius of sqrt(0.5) in 2D and sqrt(0.6) in 3D.
+// It is computed without branches, since whether a corner is within the radius is unpredictable.
+static inline float simplexCorner(int h, float x, float y) {
+  float t = 0.5f - x * x - y * y;
+  t = t > 0 ? t * t : 0;
+  return t * t * grad(h, x, y, 0.0f);
+}
+
+static inline float simplexCorner(int h, float x, float y, float z) {
+  float t = 0.6f - x * x - y * y - z * z;
+  t = t > 0 ? t * t : 0;
+  return t * t * grad(h, x, y, z);
+}
+
+// Simplex noise after Stefan Gustavson's reference implementation. The
+// result is in [-1, 1], while classic Perlin noise stays within about 0.7.
+float
+PerlinSurface::evaluateSimplex(float x, float y) {
+  // skew the input space to find the simplex cell
+  float s = (x + y) * F2;
+  int i = fastFloor(x + s), j = fastFloor(y + s);
+  float t = (i + j) * G2;
+  float x0 = x - (i - t), y0 = y - (j - t);
+  // the lower or upper triangle of the cell
+  int i1 = x0 > y0 ? 1 : 0, j1 = 1 - i1;
+  float x1 = x0 - i1 + G2, y1 = y0 - j1 + G2;
+  float x2 = x0 - 1.0f + 2.0f * G2, y2 = y0 - 1.0f + 2.0f * G2;
+  int ii = i & 255, jj = j & 255;
+  return 70.0f * (simplexCorner(p[ii + p[jj]], x0, y0) +
+		  simplexCorner(p[ii + i1 + p[jj + j1]], x1, y1) +
+		  simplexCorner(p[ii + 1 + p[jj + 1]], x2, y2));
+}
+
+float
+PerlinSurface::evaluateSimplex(float x, float y, float z) {
+  float s = (x + y + z) * F3;
+  int i = fastFloor(x + s), j = fastFloor(y + s), k = fastFloor(z + s);
+  float t = (i + j + k) * G3;
+  float x0 = x - (i - t), y0 = y - (j - t), z0 = z - (k - t);
+  // The second corner steps along the largest offset and the third along the two largest.
+  // The ranking is computed without branches, since the order is random from sample to sample.
+  int xy = x0 >= y0, xz = x0 >= z0, yz = y0 >= z0;
+  int i1 = xy & xz, j1 = (1 - xy) & yz, k1 = (1 - xz) & (1 - yz);
+  int i2 = xy | xz, j2 = (1 - xy) | yz, k2 = (1 - xz) | (1 - yz);
+  int ii = i & 255, jj = j & 255, kk = k & 255;
+  return 32.0f * (simplexCorner(p[ii + p[jj + p[kk]]], x0, y0, z0) +
+		  simplexCorner(p[ii + i1 + p[jj + j1 + p[kk + k1]]], x0 - i1 + G3, y0 - j1 + G3, z0 - k1 + G3) +
+		  simplexCorner(p[ii + i2 + p[jj + j2 + p[kk + k2]]], x0 - i2 + 2.0f * G3, y0 - j2 + 2.0f * G3, z0 - k2 + 2.0f * G3) +
+		  simplexCorner(p[ii + 1 + p[jj + 1 + p[kk + 1]]], x0 - 1.0f + 3.0f * G3, y0 - 1.0f + 3.0f * G3, z0 - 1.0f + 3.0f * G3));
+}
+
 float
 PerlinSurface::evaluate(float x, float y, float z) {
   float scale = 1;
   float v = 0;
+  int px = period_x, py = period_y;
   for (int o = 0; o < octaves; o++) {
-    v += evaluatePerlin(x, y, z) / scale;
+    float n;
+    switch (noise_type) {
+    case NOISE_SIMPLEX_2D: n = evaluateSimplex(x, y); break;
+    case NOISE_SIMPLEX_3D: n = evaluateSimplex(x, y, z); break;
+    default: n = px || py ? evaluatePeriodicPerlin(x, y, z, px, py) : evaluatePerlin(x, y, z);
+    }
+    v += n / scale;
     x *= beta;
     y *= beta;
     z *= beta;
     scale *= alpha;
+    px = int(px * beta + 0.5f);
+    py = int(py * beta + 0.5f);
   }
   return v;
 }
+
+void
+PerlinSurface::evaluateRow(float x, float y, float z, float dx, size_t n, float * output) {
+  size_t i = 0;
+#ifdef CANVAS_PERLIN_AVX2
+  for (; i + 8 <= n; i += 8) {
+    __m256 xx = _mm256_add_ps(_mm256_set1_ps(x), _mm256_mul_ps(_mm256_add_ps(_mm256_set1_ps(float(i)), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7)), _mm256_set1_ps(dx)));
+    __m256 v = _mm256_setzero_ps();
+    float yy = y, zz = z, scale = 1;
+    int px = period_x, py = period_y;
+    for (int o = 0; o < octaves; o++) {
+      __m256 noise;
+      switch (noise_type) {
+      case NOISE_SIMPLEX_2D: noise = simplex8(p, xx, yy); break;
+      case NOISE_SIMPLEX_3D: noise = simplex8(p, xx, yy, zz); break;
+      default: noise = perlin8(p, xx, yy, zz, px, py);
+      }
+      v = _mm256_add_ps(v, _mm256_div_ps(noise, _mm256_set1_ps(scale)));
+      xx = _mm256_mul_ps(xx, _mm256_set1_ps(beta));
+      yy *= beta;
+      zz *= beta;
+      scale *= alpha;
+      px = int(px * beta + 0.5f);
+      py = int(py * beta + 0.5f);
+    }
+    _mm256_storeu_ps(output + i, v);
+  }
+#endif
+#ifdef CANVAS_PERLIN_SSE2
+  for (; i + 4 <= n; i += 4) {
+    __m128 xx = _mm_add_ps(_mm_set1_ps(x), _mm_mul_ps(_mm_add_ps(_mm_set1_ps(float(i)), _mm_setr_ps(0, 1, 2, 3)), _mm_set1_ps(dx)));
+    __m128 v = _mm_setzero_ps();
+    float yy = y, zz = z, scale = 1;
+    int px = period_x, py = period_y;
+    for (int o = 0; o < octaves; o++) {
+      __m128 noise;
+      switch (noise_type) {
+      case NOISE_SIMPLEX_2D: noise = simplex4(p, xx, yy); break;
+      case NOISE_SIMPLEX_3D: noise = simplex4(p, xx, yy, zz); break;
+      default: noise = perlin4(p, xx, yy, zz, px, py);
+      }
+      v = _mm_add_ps(v, _mm_div_ps(noise, _mm_set1_ps(scale)));
+      xx = _mm_mul_ps(xx, _mm_set1_ps(beta));
+      yy *= beta;
+      zz *= beta;
+      scale *= alpha;
+      px = int(px * beta + 0.5f);
+      py = int(py * beta + 0.5f);
+    }
+    _mm_storeu_ps(output + i, v);
+  }
+#endif
+  for (; i < n; i++) {
+    output[i] = evaluate(x + float(i) * dx, y, z);
+  }
+}
+
+void
+PerlinSurface::initializePermutation() {
+  unsigned char perm[256];
+  memcpy(perm, permutation, 256);
+  if (seed) {
+    // Fisher-Yates shuffle with a 32-bit LCG, so that the noise is the same on all platforms
+    unsigned int state = seed;
+    for (int i = 255; i > 0; i--) {
+      state = state * 1664525 + 1013904223;
+      int j = (state >> 8) % (i + 1);
+      std::swap(perm[i], perm[j]);
+    }
+  }
+  for (int i = 0; i < 256; i++) {
+    p[256 + i] = p[i] = perm[i];
+  }
+}
+
+void
+PerlinSurface::setSeed(unsigned int _seed) {
+  if (_seed != seed) {
+    seed = _seed;
+    initializePermutation();
+    clearTiles();
+  }
+}
+
+void
+PerlinSurface::clearTiles() {
+  tiles.clear();
+  tiles_x = tiles_y = 0;
+}
+
+void
+PerlinSurface::resize(unsigned int _logical_width, unsigned int _logical_height, unsigned int _actual_width, unsigned int _actual_height, InternalFormat _format) {
+  Surface::resize(_logical_width, _logical_height, _actual_width, _actual_height, RGBA8);
+  releaseMemory();
+  clearTiles();
+}
+
+void
+PerlinSurface::generateTiles(unsigned int x0, unsigned int y0, unsigned int x1, unsigned int y1) {
+  unsigned int w = getActualWidth(), h = getActualHeight();
+  if (tiles.empty()) {
+    tiles_x = (w + TILE_SIZE - 1) / TILE_SIZE;
+    tiles_y = (h + TILE_SIZE - 1) / TILE_SIZE;
+    tiles.resize(tiles_x * tiles_y);
+  }
+  std::vector<unsigned int> missing;
+  for (unsigned int ty = y0 / TILE_SIZE; ty * TILE_SIZE < y1; ty++) {
+    for (unsigned int tx = x0 / TILE_SIZE; tx * TILE_SIZE < x1; tx++) {
+      if (!tiles[ty * tiles_x + tx]) missing.push_back(ty * tiles_x + tx);
+    }
+  }
+  double range = noise_type == NOISE_PERLIN ? 0.7 : 1.0;
+  // each tile is written by one thread, and the vector itself is not resized
+  parallelFor(0, missing.size(), 1, [&](size_t i0, size_t i1) {
+      for (size_t i = i0; i < i1; i++) {
+	unsigned int tx = missing[i] % tiles_x, ty = missing[i] / tiles_x;
+	unsigned int tw = std::min(TILE_SIZE, w - tx * TILE_SIZE), th = std::min(TILE_SIZE, h - ty * TILE_SIZE);
+	unsigned char * tile = new unsigned char[tw * th];
+	unsigned char * output = tile;
+	float row[TILE_SIZE];
+	for (unsigned int y = ty * TILE_SIZE; y < ty * TILE_SIZE + th; y++) {
+	  // sampled at pixel centers, since the noise is zero at the integer lattice
+	  evaluateRow((tx * TILE_SIZE + 0.5f) * frequency, (y + 0.5f) * frequency, slice, frequency, tw, row);
+	  for (unsigned int x = 0; x < tw; x++) {
+	    int f = int((row[x] + range) / (2 * range) * 255);
+	    *output++ = f < 0 ? 0 : (f >= 255 ? 255 : (unsigned char)f);
+	  }
+	}
+	tiles[missing[i]].reset(tile);
+      }
+    });
+}
+
+// Expands the tiles under the region into opaque gray RGBA pixels
+void
+PerlinSurface::copyRegion(unsigned char * output, unsigned int x0, unsigned int y0, unsigned int w, unsigned int h) const {
+  unsigned int actual_w = getActualWidth();
+  parallelFor(0, h, getRowGrain(w * 4), [&](size_t row0, size_t row1) {
+      for (size_t row = row0; row < row1; row++) {
+	unsigned int y = y0 + row, ty = y / TILE_SIZE;
+	unsigned char * out = output + row * w * 4;
+	for (unsigned int x = x0; x < x0 + w; ) {
+	  unsigned int tx = x / TILE_SIZE, tw = std::min(TILE_SIZE, actual_w - tx * TILE_SIZE);
+	  unsigned int end = std::min(x0 + w, tx * TILE_SIZE + tw);
+	  const unsigned char * input = tiles[ty * tiles_x + tx].get() + (y - ty * TILE_SIZE) * tw + (x - tx * TILE_SIZE);
+	  for (; x < end; x++) {
+	    unsigned char v = *input++;
+	    *out++ = v;
+	    *out++ = v;
+	    *out++ = v;
+	    *out++ = 255;
+	  }
+	}
+      }
+    });
+}
+
+void *
+PerlinSurface::lockMemory(bool write_access) {
+  unsigned int w = getActualWidth(), h = getActualHeight();
+  generateTiles(0, 0, w, h);
+  delete[] buffer;
+  buffer = new unsigned char[w * h * 4];
+  copyRegion(buffer, 0, 0, w, h);
+  return buffer;
+}
+
+void *
+PerlinSurface::lockMemoryPartial(unsigned int x0, unsigned int y0, unsigned int required_width, unsigned int required_height) {
+  generateTiles(x0, y0, x0 + required_width, y0 + required_height);
+  delete[] partial_buffer;
+  partial_buffer = new unsigned char[required_width * required_height * 4];
+  copyRegion(partial_buffer, x0, y0, required_width, required_height);
+  return partial_buffer;
+}
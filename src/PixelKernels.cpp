@@ -0,0 +1,584 @@
+#include "PixelKernels.h"
+
+#include <ThreadPool.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CANVAS_PIXEL_SSE2
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define CANVAS_PIXEL_NEON
+#endif
+
+using namespace canvas;
+
+// Exact rounded division by 255 for x <= 255 * 255 * 2
+static inline unsigned int div255(unsigned int x) {
+  x += 128;
+  return (x + (x >> 8)) >> 8;
+}
+
+#ifdef CANVAS_PIXEL_SSE2
+static inline __m128i div255_epi16(__m128i x) {
+  x = _mm_add_epi16(x, _mm_set1_epi16(128));
+  return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+// Broadcasts the alpha of each of the two pixels in the 16-bit lanes
+static inline __m128i alpha_epi16(__m128i x) {
+  return _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+// Expands four mask bytes to four copies each
+static inline __m128i expand_mask(const unsigned char * mask) {
+  int32_t m;
+  memcpy(&m, mask, 4);
+  __m128i mv = _mm_cvtsi32_si128(m);
+  mv = _mm_unpacklo_epi8(mv, mv);
+  return _mm_unpacklo_epi16(mv, mv);
+}
+
+// d * (1 - sa) for two pixels in 16-bit lanes
+static inline __m128i out_epi16(__m128i s, __m128i d) {
+  __m128i inv = _mm_sub_epi16(_mm_set1_epi16(255), alpha_epi16(s));
+  return div255_epi16(_mm_mullo_epi16(d, inv));
+}
+
+// s + d * (1 - sa) for two pixels in 16-bit lanes
+static inline __m128i over_epi16(__m128i s, __m128i d) {
+  return _mm_add_epi16(s, out_epi16(s, d));
+}
+#endif
+
+#ifdef __AVX2__
+static inline __m256i div255_epi16_256(__m256i x) {
+  x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+  return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+static inline __m256i out_epi16_256(__m256i s, __m256i d) {
+  __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+  __m256i inv = _mm256_sub_epi16(_mm256_set1_epi16(255), a);
+  return div255_epi16_256(_mm256_mullo_epi16(d, inv));
+}
+
+static inline __m256i over_epi16_256(__m256i s, __m256i d) {
+  return _mm256_add_epi16(s, out_epi16_256(s, d));
+}
+#endif
+
+#ifdef CANVAS_PIXEL_NEON
+static inline uint8x8_t div255_u16(uint16x8_t x) {
+  return vrshrn_n_u16(vrsraq_n_u16(x, x, 8), 8);
+}
+#endif
+
+void
+PixelKernels::colorize(const unsigned char * mask, unsigned char * dst, size_t n, const unsigned char color[4]) {
+  size_t i = 0;
+#if defined(CANVAS_PIXEL_SSE2)
+  __m128i zero = _mm_setzero_si128();
+  __m128i color16 = _mm_set_epi16(color[3], color[2], color[1], color[0], color[3], color[2], color[1], color[0]);
+  for (; i + 4 <= n; i += 4) {
+    __m128i m = expand_mask(mask + i);
+    __m128i lo = div255_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(m, zero), color16));
+    __m128i hi = div255_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(m, zero), color16));
+    _mm_storeu_si128((__m128i *)(dst + 4 * i), _mm_packus_epi16(lo, hi));
+  }
+#elif defined(CANVAS_PIXEL_NEON)
+  uint8x8_t c0 = vdup_n_u8(color[0]), c1 = vdup_n_u8(color[1]), c2 = vdup_n_u8(color[2]), c3 = vdup_n_u8(color[3]);
+  for (; i + 8 <= n; i += 8) {
+    uint8x8_t m = vld1_u8(mask + i);
+    uint8x8x4_t out;
+    out.val[0] = div255_u16(vmull_u8(m, c0));
+    out.val[1] = div255_u16(vmull_u8(m, c1));
+    out.val[2] = div255_u16(vmull_u8(m, c2));
+    out.val[3] = div255_u16(vmull_u8(m, c3));
+    vst4_u8(dst + 4 * i, out);
+  }
+#endif
+  for (; i < n; i++) {
+    unsigned int m = mask[i];
+    unsigned char * d = dst + 4 * i;
+    d[0] = (unsigned char)div255(color[0] * m);
+    d[1] = (unsigned char)div255(color[1] * m);
+    d[2] = (unsigned char)div255(color[2] * m);
+    d[3] = (unsigned char)div255(color[3] * m);
+  }
+}
+
+void
+PixelKernels::blendMask(const unsigned char * mask, unsigned char * dst, size_t n, const unsigned char color[4]) {
+  size_t i = 0;
+#if defined(CANVAS_PIXEL_SSE2)
+  __m128i zero = _mm_setzero_si128();
+  __m128i color16 = _mm_set_epi16(color[3], color[2], color[1], color[0], color[3], color[2], color[1], color[0]);
+  for (; i + 4 <= n; i += 4) {
+    int32_t m4;
+    memcpy(&m4, mask + i, 4);
+    if (!m4) continue;
+    __m128i m = expand_mask(mask + i);
+    __m128i d = _mm_loadu_si128((const __m128i *)(dst + 4 * i));
+    __m128i s_lo = div255_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(m, zero), color16));
+    __m128i s_hi = div255_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(m, zero), color16));
+    __m128i lo = over_epi16(s_lo, _mm_unpacklo_epi8(d, zero));
+    __m128i hi = over_epi16(s_hi, _mm_unpackhi_epi8(d, zero));
+    _mm_storeu_si128((__m128i *)(dst + 4 * i), _mm_packus_epi16(lo, hi));
+  }
+#elif defined(CANVAS_PIXEL_NEON)
+  uint8x8_t c0 = vdup_n_u8(color[0]), c1 = vdup_n_u8(color[1]), c2 = vdup_n_u8(color[2]), c3 = vdup_n_u8(color[3]);
+  for (; i + 8 <= n; i += 8) {
+    uint8x8_t m = vld1_u8(mask + i);
+    uint8x8x4_t d = vld4_u8(dst + 4 * i);
+    uint8x8_t sa = div255_u16(vmull_u8(m, c3));
+    uint8x8_t inv = vmvn_u8(sa);
+    d.val[0] = vqadd_u8(div255_u16(vmull_u8(m, c0)), div255_u16(vmull_u8(d.val[0], inv)));
+    d.val[1] = vqadd_u8(div255_u16(vmull_u8(m, c1)), div255_u16(vmull_u8(d.val[1], inv)));
+    d.val[2] = vqadd_u8(div255_u16(vmull_u8(m, c2)), div255_u16(vmull_u8(d.val[2], inv)));
+    d.val[3] = vqadd_u8(sa, div255_u16(vmull_u8(d.val[3], inv)));
+    vst4_u8(dst + 4 * i, d);
+  }
+#endif
+  for (; i < n; i++) {
+    unsigned int m = mask[i];
+    if (!m) continue;
+    unsigned char * d = dst + 4 * i;
+    unsigned int sa = div255(color[3] * m), inv = 255 - sa;
+    d[0] = (unsigned char)(div255(color[0] * m) + div255(d[0] * inv));
+    d[1] = (unsigned char)(div255(color[1] * m) + div255(d[1] * inv));
+    d[2] = (unsigned char)(div255(color[2] * m) + div255(d[2] * inv));
+    d[3] = (unsigned char)(sa + div255(d[3] * inv));
+  }
+}
+
+void
+PixelKernels::multiply(unsigned char * dst, size_t n, const unsigned char color[4]) {
+  size_t i = 0;
+#if defined(CANVAS_PIXEL_SSE2)
+  __m128i zero = _mm_setzero_si128();
+  __m128i color16 = _mm_set_epi16(color[3], color[2], color[1], color[0], color[3], color[2], color[1], color[0]);
+  for (; i + 4 <= n; i += 4) {
+    __m128i d = _mm_loadu_si128((const __m128i *)(dst + 4 * i));
+    __m128i lo = div255_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), color16));
+    __m128i hi = div255_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), color16));
+    _mm_storeu_si128((__m128i *)(dst + 4 * i), _mm_packus_epi16(lo, hi));
+  }
+#elif defined(CANVAS_PIXEL_NEON)
+  uint8x8_t c0 = vdup_n_u8(color[0]), c1 = vdup_n_u8(color[1]), c2 = vdup_n_u8(color[2]), c3 = vdup_n_u8(color[3]);
+  for (; i + 8 <= n; i += 8) {
+    uint8x8x4_t d = vld4_u8(dst + 4 * i);
+    d.val[0] = div255_u16(vmull_u8(d.val[0], c0));
+    d.val[1] = div255_u16(vmull_u8(d.val[1], c1));
+    d.val[2] = div255_u16(vmull_u8(d.val[2], c2));
+    d.val[3] = div255_u16(vmull_u8(d.val[3], c3));
+    vst4_u8(dst + 4 * i, d);
+  }
+#endif
+  for (; i < n; i++) {
+    unsigned char * d = dst + 4 * i;
+    d[0] = (unsigned char)div255(d[0] * color[0]);
+    d[1] = (unsigned char)div255(d[1] * color[1]);
+    d[2] = (unsigned char)div255(d[2] * color[2]);
+    d[3] = (unsigned char)div255(d[3] * color[3]);
+  }
+}
+
+// Porter-Duff factors for source and destination, scaled to 255
+static inline bool get_factors(Operator op, unsigned int sa, unsigned int da, unsigned int & fs, unsigned int & fd) {
+  switch (op) {
+  case CLEAR: fs = 0; fd = 0; return true;
+  case COPY: fs = 255; fd = 0; return true;
+  case SOURCE_OVER: fs = 255; fd = 255 - sa; return true;
+  case SOURCE_IN: fs = da; fd = 0; return true;
+  case SOURCE_OUT: fs = 255 - da; fd = 0; return true;
+  case SOURCE_ATOP: fs = da; fd = 255 - sa; return true;
+  case DESTINATION_OVER: fs = 255 - da; fd = 255; return true;
+  case DESTINATION_IN: fs = 0; fd = sa; return true;
+  case DESTINATION_OUT: fs = 0; fd = 255 - sa; return true;
+  case DESTINATION_ATOP: fs = 255 - da; fd = sa; return true;
+  case XOR: fs = 255 - da; fd = 255 - sa; return true;
+  case LIGHTER: fs = 255; fd = 255; return true;
+  default: return false;
+  }
+}
+
+static inline float soft_light(float cs, float cb) {
+  if (cs <= 0.5f) {
+    return cb - (1 - 2 * cs) * cb * (1 - cb);
+  } else {
+    float d = cb <= 0.25f ? ((16 * cb - 12) * cb + 4) * cb : sqrtf(cb);
+    return cb + (2 * cs - 1) * (d - cb);
+  }
+}
+
+// Returns as * ab * B(cs, cb) scaled to 255 * 255 for premultiplied Cs and Cb
+static inline int blend_term(Operator op, int Cs, int Cb, int as, int ab) {
+  switch (op) {
+  case MULTIPLY: return Cs * Cb;
+  case SCREEN: return Cs * ab + Cb * as - Cs * Cb;
+  case OVERLAY: return 2 * Cb <= ab ? 2 * Cs * Cb : as * ab - 2 * (ab - Cb) * (as - Cs);
+  case HARD_LIGHT: return 2 * Cs <= as ? 2 * Cs * Cb : as * ab - 2 * (ab - Cb) * (as - Cs);
+  case DARKEN: return std::min(Cs * ab, Cb * as);
+  case LIGHTEN: return std::max(Cs * ab, Cb * as);
+  case DIFFERENCE: return abs(Cs * ab - Cb * as);
+  case EXCLUSION: return Cs * ab + Cb * as - 2 * Cs * Cb;
+  case COLOR_DODGE:
+    if (Cb == 0) return 0;
+    if (Cs >= as) return as * ab;
+    return std::min(as * ab, Cb * as * as / (as - Cs));
+  case COLOR_BURN:
+    if (Cb >= ab) return as * ab;
+    if (Cs == 0) return 0;
+    return as * ab - std::min(as * ab, (ab - Cb) * as * as / Cs);
+  case SOFT_LIGHT:
+    if (!as || !ab) return 0;
+    return int(soft_light(float(Cs) / as, float(Cb) / ab) * as * ab + 0.5f);
+  default: return Cs * ab;
+  }
+}
+
+void
+PixelKernels::composite(Operator op, const unsigned char * src, unsigned char * dst, size_t n) {
+  if (op == COPY) {
+    memcpy(dst, src, 4 * n);
+    return;
+  } else if (op == CLEAR) {
+    memset(dst, 0, 4 * n);
+    return;
+  }
+
+  size_t i = 0;
+  if (op == SOURCE_OVER) {
+#if defined(__AVX2__)
+    __m256i zero256 = _mm256_setzero_si256();
+    for (; i + 8 <= n; i += 8) {
+      __m256i s = _mm256_loadu_si256((const __m256i *)(src + 4 * i));
+      __m256i d = _mm256_loadu_si256((const __m256i *)(dst + 4 * i));
+      __m256i lo = over_epi16_256(_mm256_unpacklo_epi8(s, zero256), _mm256_unpacklo_epi8(d, zero256));
+      __m256i hi = over_epi16_256(_mm256_unpackhi_epi8(s, zero256), _mm256_unpackhi_epi8(d, zero256));
+      _mm256_storeu_si256((__m256i *)(dst + 4 * i), _mm256_packus_epi16(lo, hi));
+    }
+#endif
+#if defined(CANVAS_PIXEL_SSE2)
+    __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= n; i += 4) {
+      __m128i s = _mm_loadu_si128((const __m128i *)(src + 4 * i));
+      __m128i d = _mm_loadu_si128((const __m128i *)(dst + 4 * i));
+      __m128i lo = over_epi16(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+      __m128i hi = over_epi16(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+      _mm_storeu_si128((__m128i *)(dst + 4 * i), _mm_packus_epi16(lo, hi));
+    }
+#elif defined(CANVAS_PIXEL_NEON)
+    for (; i + 8 <= n; i += 8) {
+      uint8x8x4_t s = vld4_u8(src + 4 * i);
+      uint8x8x4_t d = vld4_u8(dst + 4 * i);
+      uint8x8_t inv = vmvn_u8(s.val[3]);
+      for (int c = 0; c < 4; c++) {
+	d.val[c] = vqadd_u8(s.val[c], div255_u16(vmull_u8(d.val[c], inv)));
+      }
+      vst4_u8(dst + 4 * i, d);
+    }
+#endif
+  } else if (op == DESTINATION_OUT) {
+#if defined(__AVX2__)
+    __m256i zero256 = _mm256_setzero_si256();
+    for (; i + 8 <= n; i += 8) {
+      __m256i s = _mm256_loadu_si256((const __m256i *)(src + 4 * i));
+      __m256i d = _mm256_loadu_si256((const __m256i *)(dst + 4 * i));
+      __m256i lo = out_epi16_256(_mm256_unpacklo_epi8(s, zero256), _mm256_unpacklo_epi8(d, zero256));
+      __m256i hi = out_epi16_256(_mm256_unpackhi_epi8(s, zero256), _mm256_unpackhi_epi8(d, zero256));
+      _mm256_storeu_si256((__m256i *)(dst + 4 * i), _mm256_packus_epi16(lo, hi));
+    }
+#endif
+#if defined(CANVAS_PIXEL_SSE2)
+    __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= n; i += 4) {
+      __m128i s = _mm_loadu_si128((const __m128i *)(src + 4 * i));
+      __m128i d = _mm_loadu_si128((const __m128i *)(dst + 4 * i));
+      __m128i lo = out_epi16(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+      __m128i hi = out_epi16(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+      _mm_storeu_si128((__m128i *)(dst + 4 * i), _mm_packus_epi16(lo, hi));
+    }
+#elif defined(CANVAS_PIXEL_NEON)
+    for (; i + 8 <= n; i += 8) {
+      uint8x8x4_t s = vld4_u8(src + 4 * i);
+      uint8x8x4_t d = vld4_u8(dst + 4 * i);
+      uint8x8_t inv = vmvn_u8(s.val[3]);
+      for (int c = 0; c < 4; c++) {
+	d.val[c] = div255_u16(vmull_u8(d.val[c], inv));
+      }
+      vst4_u8(dst + 4 * i, d);
+    }
+#endif
+  }
+
+  for (; i < n; i++) {
+    const unsigned char * s = src + 4 * i;
+    unsigned char * d = dst + 4 * i;
+    unsigned int sa = s[3], da = d[3], fs, fd;
+    if (get_factors(op, sa, da, fs, fd)) {
+      for (int c = 0; c < 4; c++) {
+	d[c] = (unsigned char)std::min(255u, div255(s[c] * fs + d[c] * fd));
+      }
+    } else {
+      for (int c = 0; c < 3; c++) {
+	int v = s[c] * (255 - da) + d[c] * (255 - sa) + blend_term(op, s[c], d[c], sa, da);
+	d[c] = (unsigned char)std::min(255u, div255(std::max(v, 0)));
+      }
+      d[3] = (unsigned char)(sa + da - div255(sa * da));
+    }
+  }
+}
+
+// out = M * (r, g, b, a, 1) on unpremultiplied colors in [0, 1], and the result is clamped and premultiplied
+void
+PixelKernels::colorMatrix(unsigned char * dst, size_t n, const float matrix[20]) {
+  size_t i = 0;
+#if defined(CANVAS_PIXEL_SSE2)
+  // the columns of the matrix, so each output channel is a lane
+  __m128 c0 = _mm_setr_ps(matrix[0], matrix[5], matrix[10], matrix[15]);
+  __m128 c1 = _mm_setr_ps(matrix[1], matrix[6], matrix[11], matrix[16]);
+  __m128 c2 = _mm_setr_ps(matrix[2], matrix[7], matrix[12], matrix[17]);
+  __m128 c3 = _mm_setr_ps(matrix[3], matrix[8], matrix[13], matrix[18]);
+  __m128 c4 = _mm_setr_ps(matrix[4], matrix[9], matrix[14], matrix[19]);
+  const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+  const __m128i izero = _mm_setzero_si128();
+  for (; i < n; i++) {
+    unsigned int a = dst[4 * i + 3];
+    if (!a && matrix[19] <= 0.0f) {
+      continue; // transparent pixels stay transparent unless the matrix adds alpha
+    }
+    int32_t px;
+    memcpy(&px, dst + 4 * i, 4);
+    __m128 v = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(px), izero), izero));
+    float inv = a ? 1.0f / a : 0.0f;
+    v = _mm_mul_ps(v, _mm_setr_ps(inv, inv, inv, 1.0f / 255.0f));
+    __m128 r = _mm_add_ps(c4, _mm_mul_ps(c0, _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0))));
+    r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+    r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))));
+    r = _mm_add_ps(r, _mm_mul_ps(c3, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3))));
+    r = _mm_min_ps(_mm_max_ps(r, zero), one);
+    float oa = _mm_cvtss_f32(_mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3))) * 255.0f;
+    r = _mm_mul_ps(r, _mm_setr_ps(oa, oa, oa, 255.0f));
+    __m128i q = _mm_cvtps_epi32(r);
+    q = _mm_packus_epi16(_mm_packs_epi32(q, izero), izero);
+    px = _mm_cvtsi128_si32(q);
+    memcpy(dst + 4 * i, &px, 4);
+  }
+#endif
+  for (; i < n; i++) {
+    unsigned char * p = dst + 4 * i;
+    unsigned int a = p[3];
+    if (!a && matrix[19] <= 0.0f) {
+      continue;
+    }
+    float inv = a ? 1.0f / a : 0.0f;
+    float v[4] = { p[0] * inv, p[1] * inv, p[2] * inv, a / 255.0f };
+    float out[4];
+    for (unsigned int k = 0; k < 4; k++) {
+      const float * row = matrix + 5 * k;
+      float x = row[0] * v[0] + row[1] * v[1] + row[2] * v[2] + row[3] * v[3] + row[4];
+      out[k] = x < 0.0f ? 0.0f : (x > 1.0f ? 1.0f : x);
+    }
+    for (unsigned int k = 0; k < 3; k++) {
+      p[k] = (unsigned char)(out[k] * out[3] * 255.0f + 0.5f);
+    }
+    p[3] = (unsigned char)(out[3] * 255.0f + 0.5f);
+  }
+}
+
+static std::vector<int> make_kernel(float radius) {
+  int r = (int)ceil(radius);
+  int rows = 2 * r + 1;
+  float sigma = radius / 3;
+  float sigma22 = 2.0f * sigma * sigma;
+  float sigmaPi2 = 2.0f * float(M_PI) * sigma;
+  float sqrtSigmaPi2 = sqrt(sigmaPi2);
+  // float radius2 = radius*radius;
+  std::vector<int> kernel;
+  kernel.reserve(rows);
+
+  int row = -r;
+  float first_value = exp(-row*row/sigma22) / sqrtSigmaPi2;
+  kernel.push_back(1);
+  
+  for (int i = 1; i < rows; i++) {
+    row++; // the first entry is already in the kernel
+    kernel.push_back(int(exp(-row * row / sigma22) / sqrtSigmaPi2 / first_value));
+  }
+  return kernel;
+}
+
+// Blurs the rows and then the columns of the buffer with the kernel of make_kernel.
+// The pixels within the kernel radius of the edges are cleared.
+template<unsigned int channels>
+static void separableBlur(unsigned char * buffer, unsigned int width, unsigned int height, size_t stride, float hradius, float vradius) {
+  unsigned char * tmp = new unsigned char[width * height * channels];
+  size_t row_bytes = width * channels, grain = getRowGrain(row_bytes);
+  if (hradius > 0.0f) {
+    std::vector<int> hkernel = make_kernel(hradius);
+    unsigned short hsize = hkernel.size();
+    int htotal = 0;
+    for (std::vector<int>::iterator it = hkernel.begin(); it != hkernel.end(); it++) {
+      htotal += *it;
+    }
+    parallelFor(0, height, grain, [&](size_t row0, size_t row1) {
+	memset(tmp + row0 * row_bytes, 0, (row1 - row0) * row_bytes);
+	for (size_t row = row0; row < row1; row++) {
+	  for (unsigned int col = 0; col + hsize < width; col++) {
+	    int c[channels] = { };
+	    for (unsigned int i = 0; i < hsize; i++) {
+	      unsigned char * ptr = buffer + row * stride + (col + i) * channels;
+	      for (unsigned int k = 0; k < channels; k++) c[k] += ptr[k] * hkernel[i];
+	    }
+	    unsigned char * ptr = tmp + (row * width + col + hsize / 2) * channels;
+	    for (unsigned int k = 0; k < channels; k++) ptr[k] = (unsigned char)(c[k] / htotal);
+	  }
+	}
+      });
+  } else {
+    for (unsigned int row = 0; row < height; row++) {
+      memcpy(tmp + row * row_bytes, buffer + row * stride, row_bytes);
+    }
+  }
+  if (vradius > 0.0f) {
+    std::vector<int> vkernel = make_kernel(vradius);
+    unsigned short vsize = vkernel.size();
+    int vtotal = 0;
+    for (std::vector<int>::iterator it = vkernel.begin(); it != vkernel.end(); it++) {
+      vtotal += *it;
+    }
+    // the vertical pass runs by output rows, so that the bands are independent and read whole rows
+    parallelFor(0, height, grain, [&](size_t row0, size_t row1) {
+	std::vector<int> c(row_bytes);
+	for (size_t row = row0; row < row1; row++) {
+	  unsigned char * dst = buffer + row * stride;
+	  if (row < vsize / 2 || row - vsize / 2 + vsize >= height) {
+	    memset(dst, 0, row_bytes);
+	    continue;
+	  }
+	  std::fill(c.begin(), c.end(), 0);
+	  for (unsigned int i = 0; i < vsize; i++) {
+	    const unsigned char * src = tmp + (row - vsize / 2 + i) * row_bytes;
+	    int weight = vkernel[i];
+	    for (size_t j = 0; j < row_bytes; j++) c[j] += src[j] * weight;
+	  }
+	  for (size_t j = 0; j < row_bytes; j++) dst[j] = (unsigned char)(c[j] / vtotal);
+	}
+      });
+  } else {
+    for (unsigned int row = 0; row < height; row++) {
+      memcpy(buffer + row * stride, tmp + row * row_bytes, row_bytes);
+    }
+  }
+  delete[] tmp;
+}
+
+void
+PixelKernels::gaussianBlur(unsigned char * buffer, unsigned int width, unsigned int height, size_t stride, unsigned int channels, float hradius, float vradius) {
+  if (channels == 4) {
+    separableBlur<4>(buffer, width, height, stride, hradius, vradius);
+  } else {
+    separableBlur<1>(buffer, width, height, stride, hradius, vradius);
+  }
+}
+
+// The radius that is left for the exact blur at the smallest level
+static const float PYRAMID_RADIUS = 4.0f;
+
+// Each level averages 2x2 blocks of the previous one, as in the mipmaps of
+// Image, until the remaining radius is small. The smallest level is blurred
+// with the exact kernel and the result is scaled back up bilinearly.
+void
+PixelKernels::pyramidBlur(unsigned char * buffer, unsigned int width, unsigned int height, size_t stride, unsigned int channels, float hradius, float vradius) {
+  unsigned int w = width, h = height, levels = 0;
+  std::vector<unsigned char> level, next;
+  const unsigned char * src = buffer;
+  size_t src_stride = stride; // the levels are packed
+  while ((hradius > PYRAMID_RADIUS || vradius > PYRAMID_RADIUS) && w > 2 && h > 2) {
+    unsigned int w2 = (w + 1) / 2, h2 = (h + 1) / 2;
+    next.resize(w2 * h2 * channels);
+    parallelFor(0, h2, getRowGrain(2 * w * channels), [&](size_t y0, size_t y1) {
+	for (unsigned int y = y0; y < y1; y++) {
+	  const unsigned char * row0 = src + 2 * y * src_stride;
+	  const unsigned char * row1 = src + std::min(2 * y + 1, h - 1) * src_stride;
+	  unsigned char * dst = next.data() + y * w2 * channels;
+	  for (unsigned int x = 0; x < w2; x++) {
+	    unsigned int x0 = 2 * x * channels, x1 = std::min(2 * x + 1, w - 1) * channels;
+	    for (unsigned int k = 0; k < channels; k++) {
+	      *dst++ = (unsigned char)((row0[x0 + k] + row0[x1 + k] + row1[x0 + k] + row1[x1 + k] + 2) / 4);
+	    }
+	  }
+	}
+      });
+    level.swap(next);
+    src = level.data();
+    src_stride = w2 * channels;
+    w = w2;
+    h = h2;
+    hradius /= 2;
+    vradius /= 2;
+    levels++;
+  }
+
+  if (!levels) {
+    gaussianBlur(buffer, w, h, stride, channels, hradius, vradius);
+  } else {
+    // the averaging and the bilinear upscaling add about a quarter pixel of variance at the smallest level
+    auto reduce = [](float r) { return r > 0.0f ? 3.0f * sqrtf(std::max(r * r / 9.0f - 0.25f, 0.01f)) : 0.0f; };
+    hradius = reduce(hradius);
+    vradius = reduce(vradius);
+    // the smallest level is padded so that its edges are not cleared by the blur
+    unsigned int px = (unsigned int)ceil(hradius) + 1, py = (unsigned int)ceil(vradius) + 1;
+    unsigned int pw = w + 2 * px, ph = h + 2 * py;
+    next.assign(pw * ph * channels, 0);
+    for (unsigned int y = 0; y < h; y++) {
+      memcpy(next.data() + ((y + py) * pw + px) * channels, level.data() + y * w * channels, w * channels);
+    }
+    gaussianBlur(next.data(), pw, ph, pw * channels, channels, hradius, vradius);
+    for (unsigned int y = 0; y < h; y++) {
+      memcpy(level.data() + y * w * channels, next.data() + ((y + py) * pw + px) * channels, w * channels);
+    }
+
+    // bilinear upscaling with 8 bit weights, pixel centers are aligned between the levels
+    float scale = 1.0f / float(1 << levels);
+    std::vector<unsigned int> xs0(width), xs1(width), xw(width);
+    for (unsigned int x = 0; x < width; x++) {
+      float fx = std::max(0.0f, (x + 0.5f) * scale - 0.5f);
+      unsigned int x0 = std::min((unsigned int)fx, w - 1);
+      xs0[x] = x0 * channels;
+      xs1[x] = std::min(x0 + 1, w - 1) * channels;
+      xw[x] = (unsigned int)((fx - x0) * 256.0f);
+    }
+    parallelFor(0, height, getRowGrain(width * channels), [&](size_t band0, size_t band1) {
+	for (unsigned int y = band0; y < band1; y++) {
+	  float fy = std::max(0.0f, (y + 0.5f) * scale - 0.5f);
+	  unsigned int y0 = std::min((unsigned int)fy, h - 1);
+	  unsigned int wy = (unsigned int)((fy - y0) * 256.0f);
+	  const unsigned char * row0 = level.data() + y0 * w * channels;
+	  const unsigned char * row1 = level.data() + std::min(y0 + 1, h - 1) * w * channels;
+	  unsigned char * dst = buffer + y * stride;
+	  for (unsigned int x = 0; x < width; x++) {
+	    unsigned int x0 = xs0[x], x1 = xs1[x], wx = xw[x];
+	    for (unsigned int k = 0; k < channels; k++) {
+	      unsigned int top = row0[x0 + k] * (256 - wx) + row0[x1 + k] * wx;
+	      unsigned int bottom = row1[x0 + k] * (256 - wx) + row1[x1 + k] * wx;
+	      *dst++ = (unsigned char)((top * (256 - wy) + bottom * wy + 32768) >> 16);
+	    }
+	  }
+	}
+      });
+  }
+}
+
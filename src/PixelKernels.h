@@ -0,0 +1,37 @@
+#ifndef _CANVAS_PIXELKERNELS_H_
+#define _CANVAS_PIXELKERNELS_H_
+
+#include <Operator.h>
+
+#include <cstddef>
+
+namespace canvas {
+  // Integer span kernels for 8-bit pixels. RGBA spans are premultiplied and
+  // have four bytes per pixel with the alpha in the last byte, which matches
+  // both RGBA8 images and Cairo ARGB32 surfaces on little endian machines.
+  // The color channels are processed in memory order, so the caller gives
+  // colors in the byte order of the target.
+  // SSE2, AVX2 and NEON versions are used when enabled at compile time. composite
+  // has them for SOURCE_OVER and DESTINATION_OUT, COPY and CLEAR are plain memory
+  // operations, and the other operators run the scalar loop.
+  class PixelKernels {
+  public:
+    // dst = color * mask, where dst is RGBA and mask is R8
+    static void colorize(const unsigned char * mask, unsigned char * dst, size_t n, const unsigned char color[4]);
+    // Composites color * mask over dst
+    static void blendMask(const unsigned char * mask, unsigned char * dst, size_t n, const unsigned char color[4]);
+    // Multiplies each channel by the corresponding channel of color
+    static void multiply(unsigned char * dst, size_t n, const unsigned char color[4]);
+    // Composites the RGBA span src onto dst with the given operator
+    static void composite(Operator op, const unsigned char * src, unsigned char * dst, size_t n);
+    // Applies a 4x5 color matrix in row-major order to premultiplied pixels
+    static void colorMatrix(unsigned char * dst, size_t n, const float matrix[20]);
+
+    // Whole buffer blurs for images of 1 or 4 channels, where the radius is three standard deviations.
+    // stride is the distance between the rows in bytes. The exact blur clears the pixels within the radius of the edges.
+    static void gaussianBlur(unsigned char * buffer, unsigned int width, unsigned int height, size_t stride, unsigned int channels, float hradius, float vradius);
+    static void pyramidBlur(unsigned char * buffer, unsigned int width, unsigned int height, size_t stride, unsigned int channels, float hradius, float vradius);
+  };
+};
+
+#endif
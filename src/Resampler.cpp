@@ -0,0 +1,309 @@
+#include "Resampler.h"
+
+#include <ThreadPool.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CANVAS_RESAMPLER_SSE2
+#endif
+
+using namespace std;
+using namespace canvas;
+
+#define WEIGHT_BITS 14
+// Fraction bits of the 16 bit intermediate. With 6 bits the overshoot of the
+// negative lobes, which reaches about 330 for Lanczos, still fits.
+#define INTERMEDIATE_BITS 6
+#define ROW_SHIFT (WEIGHT_BITS - INTERMEDIATE_BITS)
+#define COLUMN_SHIFT (WEIGHT_BITS + INTERMEDIATE_BITS)
+
+namespace {
+  // Weights of each output pixel for a window of taps input pixels starting at start
+  struct Coefficients {
+    unsigned int taps;
+    std::vector<unsigned int> start;
+    std::vector<short> weights;
+  };
+};
+
+static inline float sinc(float x) {
+  if (x == 0.0f) return 1.0f;
+  x *= 3.14159265f;
+  return sinf(x) / x;
+}
+
+static float getSupport(ResampleFilter filter) {
+  switch (filter) {
+  case RESAMPLE_BOX: return 0.5f;
+  case RESAMPLE_BILINEAR: return 1.0f;
+  case RESAMPLE_BICUBIC: return 2.0f;
+  case RESAMPLE_LANCZOS: return 3.0f;
+  }
+  return 1.0f;
+}
+
+static float evaluateFilter(ResampleFilter filter, float x) {
+  switch (filter) {
+  case RESAMPLE_BOX:
+    return x > -0.5f && x <= 0.5f ? 1.0f : 0.0f;
+  case RESAMPLE_BILINEAR:
+    x = fabsf(x);
+    return x < 1.0f ? 1.0f - x : 0.0f;
+  case RESAMPLE_BICUBIC:
+    {
+      // Catmull-Rom
+      const float a = -0.5f;
+      x = fabsf(x);
+      if (x < 1.0f) return ((a + 2.0f) * x - (a + 3.0f)) * x * x + 1.0f;
+      if (x < 2.0f) return (((x - 5.0f) * x + 8.0f) * x - 4.0f) * a;
+      return 0.0f;
+    }
+  case RESAMPLE_LANCZOS:
+    return x > -3.0f && x < 3.0f ? sinc(x) * sinc(x / 3.0f) : 0.0f;
+  }
+  return 0.0f;
+}
+
+// The kernel is stretched when downscaling so that each input pixel contributes.
+// The windows are padded to an even number of taps for the paired SIMD multiplies,
+// and moved inside the input where possible so that the padding can be read.
+static Coefficients computeCoefficients(unsigned int input_size, unsigned int output_size, ResampleFilter filter) {
+  double scale = double(input_size) / output_size;
+  double filter_scale = std::max(scale, 1.0);
+  double support = getSupport(filter) * filter_scale;
+
+  std::vector<unsigned int> first(output_size), count(output_size);
+  std::vector<std::vector<double> > values(output_size);
+  unsigned int taps = 1;
+  for (unsigned int i = 0; i < output_size; i++) {
+    double center = (i + 0.5) * scale;
+    int x0 = std::max(int(center - support + 0.5), 0);
+    int x1 = std::min(int(center + support + 0.5), int(input_size));
+    if (x1 <= x0) {
+      x0 = std::min(int(center), int(input_size) - 1);
+      x1 = x0 + 1;
+    }
+    double sum = 0.0;
+    for (int x = x0; x < x1; x++) {
+      double v = evaluateFilter(filter, float((x - center + 0.5) / filter_scale));
+      values[i].push_back(v);
+      sum += v;
+    }
+    if (sum == 0.0) {
+      // a box narrower than the pixel spacing falls between samples
+      values[i].assign(x1 - x0, 0.0);
+      values[i][std::min((unsigned int)(center - x0), (unsigned int)(x1 - x0 - 1))] = sum = 1.0;
+    }
+    for (auto & v : values[i]) v /= sum;
+    first[i] = x0;
+    count[i] = x1 - x0;
+    taps = std::max(taps, count[i]);
+  }
+
+  Coefficients c;
+  c.taps = std::min((taps + 1) & ~1U, input_size);
+  c.start.resize(output_size);
+  c.weights.assign(output_size * c.taps, 0);
+  for (unsigned int i = 0; i < output_size; i++) {
+    unsigned int shift = first[i] + c.taps > input_size ? first[i] + c.taps - input_size : 0;
+    c.start[i] = first[i] - shift;
+    short * w = c.weights.data() + i * c.taps + shift;
+    // the rounding error is added to the largest weight, so that the weights sum to one exactly
+    int total = 0, largest = 0;
+    for (unsigned int k = 0; k < count[i]; k++) {
+      w[k] = (short)lround(values[i][k] * (1 << WEIGHT_BITS));
+      total += w[k];
+      if (abs(w[k]) > abs(w[largest])) largest = k;
+    }
+    w[largest] += (1 << WEIGHT_BITS) - total;
+  }
+  return c;
+}
+
+// Passes the rows or columns through unchanged
+static Coefficients identityCoefficients(unsigned int size) {
+  Coefficients c;
+  c.taps = 1;
+  c.start.resize(size);
+  for (unsigned int i = 0; i < size; i++) c.start[i] = i;
+  c.weights.assign(size, 1 << WEIGHT_BITS);
+  return c;
+}
+
+#ifdef CANVAS_RESAMPLER_SSE2
+// Two weights in the 16 bit lanes of a 32 bit value for _mm_madd_epi16
+static inline int pairWeights(short w0, short w1) {
+  return int((unsigned int)(unsigned short)w1 << 16 | (unsigned short)w0);
+}
+#endif
+
+static inline short clampShort(int v) {
+  v >>= ROW_SHIFT;
+  return (short)(v < -32768 ? -32768 : (v > 32767 ? 32767 : v));
+}
+
+static inline unsigned char clampByte(int v) {
+  v >>= COLUMN_SHIFT;
+  return (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+// The horizontal pass writes a signed 16 bit intermediate, so that values
+// below zero and above 255 from the negative lobes are kept for the
+// vertical pass
+static void resampleRow(const unsigned char * input, short * output, unsigned int output_width, unsigned int channels, const Coefficients & c) {
+  const unsigned int taps = c.taps;
+#ifdef CANVAS_RESAMPLER_SSE2
+  if (channels == 4 && (taps & 1) == 0) {
+    const __m128i zero = _mm_setzero_si128(), round = _mm_set1_epi32(1 << (ROW_SHIFT - 1));
+    for (unsigned int x = 0; x < output_width; x++) {
+      const unsigned char * src = input + c.start[x] * 4;
+      const short * w = c.weights.data() + x * taps;
+      __m128i acc = round;
+      for (unsigned int k = 0; k < taps; k += 2) {
+	// two pixels are interleaved by channel to r0 r1 g0 g1 b0 b1 a0 a1 for the paired multiply
+	__m128i p = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(src + k * 4)), zero);
+	p = _mm_unpacklo_epi16(p, _mm_srli_si128(p, 8));
+	__m128i wp = _mm_set1_epi32(pairWeights(w[k], w[k + 1]));
+	acc = _mm_add_epi32(acc, _mm_madd_epi16(p, wp));
+      }
+      acc = _mm_srai_epi32(acc, ROW_SHIFT);
+      _mm_storel_epi64((__m128i *)(output + x * 4), _mm_packs_epi32(acc, acc));
+    }
+    return;
+  }
+#endif
+  for (unsigned int x = 0; x < output_width; x++) {
+    const unsigned char * src = input + c.start[x] * channels;
+    const short * w = c.weights.data() + x * taps;
+    for (unsigned int ch = 0; ch < channels; ch++) {
+      int acc = 1 << (ROW_SHIFT - 1);
+      for (unsigned int k = 0; k < taps; k++) {
+	acc += src[k * channels + ch] * w[k];
+      }
+      output[x * channels + ch] = clampShort(acc);
+    }
+  }
+}
+
+// Expands a row to the intermediate format when the width does not change
+static void expandRow(const unsigned char * input, short * output, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    output[i] = (short)(input[i] << INTERMEDIATE_BITS);
+  }
+}
+
+// The vertical pass works on channel values, so it is the same for all the formats
+static void resampleColumns(const short * const * rows, const short * w, unsigned int taps, unsigned char * output, size_t row_values) {
+  size_t x = 0;
+#ifdef CANVAS_RESAMPLER_SSE2
+  const __m128i zero = _mm_setzero_si128(), round = _mm_set1_epi32(1 << (COLUMN_SHIFT - 1));
+  for (; x + 16 <= row_values; x += 16) {
+    __m128i acc0 = round, acc1 = round, acc2 = round, acc3 = round;
+    for (unsigned int k = 0; k < taps; k += 2) {
+      bool pair = k + 1 < taps;
+      __m128i alo = _mm_loadu_si128((const __m128i *)(rows[k] + x)), ahi = _mm_loadu_si128((const __m128i *)(rows[k] + x + 8));
+      __m128i blo = pair ? _mm_loadu_si128((const __m128i *)(rows[k + 1] + x)) : zero;
+      __m128i bhi = pair ? _mm_loadu_si128((const __m128i *)(rows[k + 1] + x + 8)) : zero;
+      __m128i wp = _mm_set1_epi32(pairWeights(w[k], pair ? w[k + 1] : 0));
+      acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi16(alo, blo), wp));
+      acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi16(alo, blo), wp));
+      acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(_mm_unpacklo_epi16(ahi, bhi), wp));
+      acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(_mm_unpackhi_epi16(ahi, bhi), wp));
+    }
+    __m128i lo = _mm_packs_epi32(_mm_srai_epi32(acc0, COLUMN_SHIFT), _mm_srai_epi32(acc1, COLUMN_SHIFT));
+    __m128i hi = _mm_packs_epi32(_mm_srai_epi32(acc2, COLUMN_SHIFT), _mm_srai_epi32(acc3, COLUMN_SHIFT));
+    _mm_storeu_si128((__m128i *)(output + x), _mm_packus_epi16(lo, hi));
+  }
+#endif
+  for (; x < row_values; x++) {
+    int acc = 1 << (COLUMN_SHIFT - 1);
+    for (unsigned int k = 0; k < taps; k++) {
+      acc += rows[k][x] * w[k];
+    }
+    output[x] = clampByte(acc);
+  }
+}
+
+static void resample(const unsigned char * input, unsigned int input_width, unsigned int input_height, unsigned char * output, unsigned int output_width, unsigned int output_height, unsigned int channels, ResampleFilter filter) {
+  size_t input_row = size_t(input_width) * channels, output_row = size_t(output_width) * channels;
+
+  // only the input rows that contribute to the output are filtered horizontally
+  Coefficients vc = input_height == output_height ? identityCoefficients(output_height) : computeCoefficients(input_height, output_height, filter);
+  unsigned int y0 = vc.start.front(), y1 = vc.start.back() + vc.taps;
+
+  std::vector<short> tmp((y1 - y0) * output_row);
+  if (input_width != output_width) {
+    Coefficients hc = computeCoefficients(input_width, output_width, filter);
+    parallelFor(y0, y1, getRowGrain(input_row + 2 * output_row), [&](size_t row0, size_t row1) {
+	for (size_t row = row0; row < row1; row++) {
+	  resampleRow(input + row * input_row, tmp.data() + (row - y0) * output_row, output_width, channels, hc);
+	}
+      });
+  } else {
+    parallelFor(y0, y1, getRowGrain(3 * input_row), [&](size_t row0, size_t row1) {
+	for (size_t row = row0; row < row1; row++) {
+	  expandRow(input + row * input_row, tmp.data() + (row - y0) * output_row, output_row);
+	}
+      });
+  }
+
+  parallelFor(0, output_height, getRowGrain(2 * output_row * vc.taps), [&](size_t row0, size_t row1) {
+      std::vector<const short *> window(vc.taps);
+      for (size_t row = row0; row < row1; row++) {
+	for (unsigned int k = 0; k < vc.taps; k++) {
+	  window[k] = tmp.data() + (vc.start[row] - y0 + k) * output_row;
+	}
+	resampleColumns(window.data(), vc.weights.data() + row * vc.taps, vc.taps, output + row * output_row, output_row);
+      }
+    });
+}
+
+bool
+Resampler::isSupported(InternalFormat format) {
+  return format == R8 || format == RG8 || format == RGB565 || format == RGB8 || format == RGBA8;
+}
+
+void
+Resampler::resize(const unsigned char * input, unsigned int input_width, unsigned int input_height, unsigned char * output, unsigned int output_width, unsigned int output_height, InternalFormat format, ResampleFilter filter) {
+  if (!input_width || !input_height || !output_width || !output_height) return;
+  if (format == RGB565) {
+    // the fields are expanded to bytes in their packed order, so the byte order of the platform does not matter
+    size_t input_n = size_t(input_width) * input_height, output_n = size_t(output_width) * output_height;
+    std::vector<unsigned char> expanded(input_n * 4), resampled(output_n * 4);
+    const unsigned short * src = (const unsigned short *)input;
+    for (size_t i = 0; i < input_n; i++) {
+      unsigned int v = src[i], f0 = v & 0x1f, f1 = (v >> 5) & 0x3f, f2 = v >> 11;
+      expanded[i * 4 + 0] = (unsigned char)((f0 << 3) | (f0 >> 2));
+      expanded[i * 4 + 1] = (unsigned char)((f1 << 2) | (f1 >> 4));
+      expanded[i * 4 + 2] = (unsigned char)((f2 << 3) | (f2 >> 2));
+      expanded[i * 4 + 3] = 255;
+    }
+    resample(expanded.data(), input_width, input_height, resampled.data(), output_width, output_height, 4, filter);
+    unsigned short * dst = (unsigned short *)output;
+    for (size_t i = 0; i < output_n; i++) {
+      const unsigned char * p = resampled.data() + i * 4;
+      dst[i] = (unsigned short)((p[0] >> 3) | ((p[1] >> 2) << 5) | ((p[2] >> 3) << 11));
+    }
+    return;
+  }
+
+  unsigned int channels = format == R8 ? 1 : (format == RG8 ? 2 : 4);
+  resample(input, input_width, input_height, output, output_width, output_height, channels, filter);
+
+  if (format == RGBA8 && (filter == RESAMPLE_BICUBIC || filter == RESAMPLE_LANCZOS)) {
+    // the negative lobes can leave colors above the alpha, which is invalid for premultiplied pixels
+    size_t n = size_t(output_width) * output_height;
+    for (size_t i = 0; i < n; i++) {
+      unsigned char * p = output + i * 4;
+      unsigned char a = p[3];
+      if (p[0] > a) p[0] = a;
+      if (p[1] > a) p[1] = a;
+      if (p[2] > a) p[2] = a;
+    }
+  }
+}
@@ -0,0 +1,23 @@
+#ifndef _CANVAS_RESAMPLER_H_
+#define _CANVAS_RESAMPLER_H_
+
+#include <ResampleFilter.h>
+#include <InternalFormat.h>
+
+namespace canvas {
+  // Separable image resampler with 14 bit fixed point coefficients. The
+  // coefficients are computed once per output row and column, the rows are
+  // filtered horizontally into a signed 16 bit intermediate buffer with 6
+  // fraction bits, which keeps the overshoot of negative lobes, and the result
+  // vertically. RGBA8 is treated as premultiplied, so the color channels are
+  // clamped to the alpha after kernels with negative lobes. RGB8 has four bytes
+  // per pixel like RGBA8 but no clamping. RGB565 is expanded to 8 bits per
+  // channel for filtering.
+  class Resampler {
+  public:
+    static bool isSupported(InternalFormat format);
+    static void resize(const unsigned char * input, unsigned int input_width, unsigned int input_height, unsigned char * output, unsigned int output_width, unsigned int output_height, InternalFormat format, ResampleFilter filter);
+  };
+};
+
+#endif
@@ -0,0 +1,56 @@
+#include <ShadowCache.h>
+
+using namespace std;
+using namespace canvas;
+
+std::shared_ptr<Surface>
+ShadowCache::get(const Key & key) {
+  auto it = index.find(key);
+  if (it == index.end()) {
+    misses++;
+    return std::shared_ptr<Surface>();
+  }
+  hits++;
+  entries.splice(entries.begin(), entries, it->second);
+  return it->second->mask;
+}
+
+void
+ShadowCache::put(const Key & key, const std::shared_ptr<Surface> & mask) {
+  // the rows are padded to the stride, which also accounts for the bytes per pixel
+  size_t mask_bytes = size_t(mask->getStride()) * mask->getActualHeight();
+  if (mask_bytes > max_bytes) return;
+  auto it = index.find(key);
+  if (it != index.end()) {
+    bytes -= it->second->bytes;
+    entries.erase(it->second);
+    index.erase(it);
+  }
+  evict(max_bytes - mask_bytes);
+  entries.push_front(Entry{ key, mask, mask_bytes });
+  index[key] = entries.begin();
+  bytes += mask_bytes;
+}
+
+void
+ShadowCache::clear() {
+  index.clear();
+  entries.clear();
+  bytes = 0;
+}
+
+void
+ShadowCache::setMaxBytes(size_t _max_bytes) {
+  max_bytes = _max_bytes;
+  evict(max_bytes);
+}
+
+void
+ShadowCache::evict(size_t limit) {
+  while (bytes > limit && !entries.empty()) {
+    auto & e = entries.back();
+    bytes -= e.bytes;
+    index.erase(e.key);
+    entries.pop_back();
+  }
+}
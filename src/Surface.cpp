@@ -2,8 +2,11 @@
 
 #include "Color.h"
 #include "Image.h"
+#include "PixelKernels.h"
+#include "ThreadPool.h"
 
 #include <cstring>
+#include <algorithm>
 #include <vector>
 #include <cmath>
 #include <cassert>
@@ -12,297 +15,215 @@
 using namespace std;
 using namespace canvas;
 
-static vector<int> make_kernel(float radius) {
-  int r = (int)ceil(radius);
-  int rows = 2 * r + 1;
-  float sigma = radius / 3;
-  float sigma22 = 2.0f * sigma * sigma;
-  float sigmaPi2 = 2.0f * float(M_PI) * sigma;
-  float sqrtSigmaPi2 = sqrt(sigmaPi2);
-  // float radius2 = radius*radius;
-  vector<int> kernel;
-  kernel.reserve(rows);
-
-  int row = -r;
-  float first_value = exp(-row*row/sigma22) / sqrtSigmaPi2;
-  kernel.push_back(1);
-  
-  for (unsigned int i = 1; i < rows; i++, row++) {
-    // for (row++; row <= r; row++) {
-    kernel.push_back(int(exp(-row * row / sigma22) / sqrtSigmaPi2 / first_value));
-  }
-  return kernel;
-}
-
-// standard deviation, number of boxes
-static vector<int> boxesForGauss(float sigma, unsigned int n) {
-  // Ideal averaging filter width 
-  float wIdeal = sqrtf((12.0f * sigma * sigma / n) + 1);
-  int wl = int(floor(wIdeal));
-  if (wl % 2 == 0) wl--;
-  int wu = wl + 2;
-  
-  float mIdeal = (12.0f * sigma * sigma - n*wl*wl - 4*n*wl - 3*n) / (-4*wl - 4);
-  int m = int(round(mIdeal));
-  // var sigmaActual = Math.sqrt( (m*wl*wl + (n-m)*wu*wu - n)/12 );
-
-  vector<int> sizes;
-  for (int i = 0; i < n; i++) sizes.push_back(i < m ? wl : wu);
-  return sizes;
+// r is the standard deviation, while the kernels take three standard deviations
+void
+Surface::blur(float r) {
+  slowBlur(3.0f * r, 3.0f * r);
 }
 
-static void boxBlurH_4(unsigned char * scl, unsigned char * tcl, int w, int h, int r) {
-  float iarr = 1 / (r+r+1);
-  for (int ch = 0; ch < 4; ch++) {
-    for (int i=0; i < h; i++) {
-      int ti = i*w;
-      int li = ti;
-      int ri = ti + r;
-      int fv = scl[4 * ti + ch];
-      int lv = scl[4 * (ti + w - 1) + ch];
-      int val = (r+1)*fv;
-      for (int j = 0; j  < r; j++) val += scl[4 * (ti + j) + ch];
-      for (int j = 0; j <= r; j++) {
-	val += scl[4 * ri++ + ch] - fv;
-	tcl[4 * ti++ + ch] = int(round(val * iarr));
-      }
-      for (int j = r+1; j < w-r; j++) {
-	val += scl[4 * ri++ + ch] - scl[4 * li++ + ch];
-	tcl[4 * ti++ + ch] = int(round(val*iarr));
-      }
-      for (int j = w-r; j < w; j++) {
-	val += lv - scl[4 * li++ + ch];
-	tcl[4 * ti++ + ch] = int(round(val*iarr));
-      }
-    }
+void
+Surface::slowBlur(float hradius, float vradius) {
+  if (!(hradius > 0 || vradius > 0)) {
+    return;
   }
-}
 
-static void boxBlurT_4(unsigned char * scl, unsigned char * tcl, int w, int h, int r) {
-  float iarr = 1 / (r+r+1);
-  for (int ch = 0; ch < 4; ch++) {
-    for (int i = 0; i < w; i++) {
-      int ti = i;
-      int li = ti;
-      int ri = ti + r * w;
-      int fv = scl[4 * ti + ch];
-      int lv = scl[4 * (ti+w*(h-1)) + ch];
-      int val = (r+1)*fv;
-      for (int j = 0; j < r; j++) val += scl[4 * (ti+j*w) + ch];
-      for (int j = 0; j <= r; j++) {
-	val += scl[4 * ri + ch] - fv;
-	tcl[4 * ti + ch] = int(round(val*iarr));
-	ri += w;
-	ti += w;
-      }
-      for (int j = r+1; j<h-r; j++) {
-	val += scl[4 * ri + ch] - scl[4 * li + ch];
-	tcl[4 * ti + ch] = int(round(val*iarr));
-	li += w;
-	ri += w;
-	ti += w;
-      }
-      for (int j = h-r; j < h; j++) {
-	val += lv - scl[4 * li + ch];
-	tcl[4 * ti + ch] = int(round(val*iarr));
-	li += w;
-	ti += w;
-      }
-    }
-  }
-}
+  unsigned char * buffer = (unsigned char *)lockMemory(true);
+  assert(buffer);
 
-static void boxBlur_4(unsigned char * scl, unsigned char * tcl, int w, int h, int r) {
-  for (int i = 0; i < 4 * w * h; i++) tcl[i] = scl[i];
-  boxBlurH_4(tcl, scl, w, h, r);
-  boxBlurT_4(scl, tcl, w, h, r);
+  if (format == RGBA8) {
+    PixelKernels::gaussianBlur(buffer, actual_width, actual_height, getStride(), 4, hradius, vradius);
+  } else if (format == R8) {
+    PixelKernels::gaussianBlur(buffer, actual_width, actual_height, getStride(), 1, hradius, vradius);
+  }
+  releaseMemory();
 }
 
 void
-Surface::blur(float r) {
-  auto bxs = boxesForGauss(r, 3);
-
-  int w = getActualWidth(), h = getActualHeight();
-  unsigned char * scl = (unsigned char *)lockMemory(true);  
-  unsigned char * tcl = new unsigned char[w * h * 4];
+Surface::pyramidBlur(float hradius, float vradius) {
+  if (!(hradius > 0 || vradius > 0)) {
+    return;
+  }
 
-  cerr << "boxes: " << bxs[0] << ", " << bxs[1] << ", " << bxs[2] << endl;
-  
-  boxBlur_4(scl, tcl, w, h, (bxs[0]-1) / 2);
-  boxBlur_4(tcl, scl, w, h, (bxs[1]-1) / 2);
-  boxBlur_4(scl, tcl, w, h, (bxs[2]-1) / 2);
+  unsigned char * buffer = (unsigned char *)lockMemory(true);
+  assert(buffer);
 
-  memcpy(scl, tcl, w * h * 4);
-  delete[] tcl;
+  if (format == RGBA8) {
+    PixelKernels::pyramidBlur(buffer, actual_width, actual_height, getStride(), 4, hradius, vradius);
+  } else if (format == R8) {
+    PixelKernels::pyramidBlur(buffer, actual_width, actual_height, getStride(), 1, hradius, vradius);
+  }
   releaseMemory();
 }
 
+// The rounded rectangle is split into horizontal slabs: one for the straight
+// middle part and up to 16 for each band of corners, with the width of each
+// corner slab taken at its center. Within a slab the shape is a box, whose
+// convolution with a Gaussian is the product of two differences of erf, so
+// only one column and one row table is needed per slab.
 void
-Surface::slowBlur(float hradius, float vradius) {
-  if (!(hradius > 0 || vradius > 0)) {
-    return;
+Surface::fillBoxShadow(double x0, double y0, double x1, double y1, double radius, float sigma) {
+  assert(format == R8);
+  radius = std::max(0.0, std::min(radius, std::min(x1 - x0, y1 - y0) / 2));
+  struct Slab { double x0, y0, x1, y1; };
+  vector<Slab> slabs;
+  if (y1 - y0 > 2 * radius) {
+    slabs.push_back({ x0, y0 + radius, x1, y1 - radius });
+  }
+  if (radius > 0) {
+    int n = std::min(16, int(ceil(radius)));
+    double h = radius / n;
+    for (int i = 0; i < n; i++) {
+      double d = radius - (i + 0.5) * h;
+      double inset = radius - sqrt(radius * radius - d * d);
+      slabs.push_back({ x0 + inset, y0 + i * h, x1 - inset, y0 + (i + 1) * h });
+      slabs.push_back({ x0 + inset, y1 - (i + 1) * h, x1 - inset, y1 - i * h });
+    }
+  }
+
+  // The path is drawn offset by half a pixel, so pixel i samples the coordinate i
+  unsigned int w = actual_width, h = actual_height, n = slabs.size();
+  double k = 1.0 / (std::max(sigma, 0.01f) * M_SQRT2);
+  vector<float> columns(n * w), rows(n * h);
+  for (unsigned int j = 0; j < n; j++) {
+    auto & s = slabs[j];
+    for (unsigned int i = 0; i < w; i++) {
+      columns[j * w + i] = float(0.5 * (erf((i - s.x0) * k) - erf((i - s.x1) * k)));
+    }
+    for (unsigned int i = 0; i < h; i++) {
+      rows[j * h + i] = float(0.5 * (erf((i - s.y0) * k) - erf((i - s.y1) * k)));
+    }
   }
 
   unsigned char * buffer = (unsigned char *)lockMemory(true);
   assert(buffer);
-
-  if (format == RGBA8) {
-    unsigned char * tmp = new unsigned char[actual_width * actual_height * 4];
-    if (hradius > 0.0f) {
-      vector<int> hkernel = make_kernel(hradius);
-      unsigned short hsize = hkernel.size();
-      int htotal = 0;
-      for (vector<int>::iterator it = hkernel.begin(); it != hkernel.end(); it++) {
-	htotal += *it;
-      }
-      memset(tmp, 0, actual_width * actual_height * 4);
-      for (unsigned int row = 0; row < actual_height; row++) {
-	for (unsigned int col = 0; col + hsize < actual_width; col++) {
-	  int c0 = 0, c1 = 0, c2 = 0, c3 = 0;
-	  for (unsigned int i = 0; i < hsize; i++) {
-	    unsigned char * ptr = buffer + (row * actual_width + col + i) * 4;
-	    c0 += *ptr++ * hkernel[i];
-	    c1 += *ptr++ * hkernel[i];
-	    c2 += *ptr++ * hkernel[i];
-	    c3 += *ptr++ * hkernel[i];
-	  }
-	  unsigned char * ptr = tmp + (row * actual_width + col + hsize / 2) * 4;
-	  *ptr++ = (unsigned char)(c0 / htotal);
-	  *ptr++ = (unsigned char)(c1 / htotal);
-	  *ptr++ = (unsigned char)(c2 / htotal);
-	  *ptr++ = (unsigned char)(c3 / htotal);
-	}
-      }
-    } else {
-      memcpy(tmp, buffer, actual_width * actual_height * 4);
+  size_t stride = getStride();
+  vector<unsigned int> active;
+  vector<float> acc(w);
+  for (unsigned int row = 0; row < h; row++) {
+    // only the slabs within reach of the Gaussian contribute to the row
+    active.clear();
+    for (unsigned int j = 0; j < n; j++) {
+      if (rows[j * h + row] > 1.0f / 1024.0f) active.push_back(j);
     }
-    if (vradius > 0) {
-      vector<int> vkernel = make_kernel(vradius);
-      unsigned short vsize = vkernel.size();
-      int vtotal = 0;
-      for (vector<int>::iterator it = vkernel.begin(); it != vkernel.end(); it++) {
-	vtotal += *it;
-      }
-      
-      memset(buffer, 0, actual_width * actual_height * 4);
-      for (unsigned int col = 0; col < actual_width; col++) {
-	for (unsigned int row = 0; row + vsize < actual_height; row++) {
-	  int c0 = 0, c1 = 0, c2 = 0, c3 = 0;
-	  for (unsigned int i = 0; i < vsize; i++) {
-	    unsigned char * ptr = tmp + ((row + i) * actual_width + col) * 4;
-	    c0 += *ptr++ * vkernel[i];
-	    c1 += *ptr++ * vkernel[i];
-	    c2 += *ptr++ * vkernel[i];
-	    c3 += *ptr++ * vkernel[i];
-	  }
-	  unsigned char * ptr = buffer + ((row + vsize / 2) * actual_width + col) * 4;
-	  *ptr++ = (unsigned char)(c0 / vtotal);
-	  *ptr++ = (unsigned char)(c1 / vtotal);
-	  *ptr++ = (unsigned char)(c2 / vtotal);
-	  *ptr++ = (unsigned char)(c3 / vtotal);
-	}
-      }
-    } else {
-      memcpy(buffer, tmp, actual_width * actual_height * 4);
+    unsigned char * dst = buffer + row * stride;
+    if (active.empty()) {
+      memset(dst, 0, w);
+      continue;
     }
-    delete[] tmp;
-  } else if (format == R8) {
-    unsigned char * tmp = new unsigned char[actual_width * actual_height];
-    if (hradius > 0.0f) {
-      vector<int> hkernel = make_kernel(hradius);
-      unsigned short hsize = hkernel.size();
-      int htotal = 0;
-      for (vector<int>::iterator it = hkernel.begin(); it != hkernel.end(); it++) {
-	htotal += *it;
-      }
-      memset(tmp, 0, actual_width * actual_height);
-      for (unsigned int row = 0; row < actual_height; row++) {
-	for (unsigned int col = 0; col + hsize < actual_width; col++) {
-	  int c0 = 0;
-	  for (unsigned int i = 0; i < hsize; i++) {
-	    unsigned char * ptr = buffer + (row * actual_width + col + i);
-	    c0 += *ptr * hkernel[i];	    
-	  }
-	  unsigned char * ptr = tmp + (row * actual_width + col + hsize / 2);
-	  *ptr = (unsigned char)(c0 / htotal);	  
-	}
+    std::fill(acc.begin(), acc.end(), 0.0f);
+    for (auto j : active) {
+      float weight = rows[j * h + row] * 255.0f;
+      const float * c = &columns[j * w];
+      for (unsigned int i = 0; i < w; i++) {
+	acc[i] += weight * c[i];
       }
-    } else {
-      memcpy(tmp, buffer, actual_width * actual_height);
     }
-    if (vradius > 0) {
-      vector<int> vkernel = make_kernel(vradius);
-      unsigned short vsize = vkernel.size();
-      int vtotal = 0;
-      for (vector<int>::iterator it = vkernel.begin(); it != vkernel.end(); it++) {
-	vtotal += *it;
-      }
-      
-      memset(buffer, 0, actual_width * actual_height);
-      for (unsigned int col = 0; col < actual_width; col++) {
-	for (unsigned int row = 0; row + vsize < actual_height; row++) {
-	  int c0 = 0;
-	  for (unsigned int i = 0; i < vsize; i++) {
-	    unsigned char * ptr = tmp + ((row + i) * actual_width + col);
-	    c0 += *ptr++ * vkernel[i];
-	  }
-	  unsigned char * ptr = buffer + ((row + vsize / 2) * actual_width + col);
-	  *ptr = (unsigned char)(c0 / vtotal);
-	}
-      }
-    } else {
-      memcpy(buffer, tmp, actual_width * actual_height);
+    for (unsigned int i = 0; i < w; i++) {
+      float v = acc[i];
+      dst[i] = (unsigned char)(v <= 0.0f ? 0 : (v >= 255.0f ? 255 : int(v + 0.5f)));
     }
-    delete[] tmp;    
   }
   releaseMemory();
 }
 
+static inline unsigned char toByte(float v) {
+  return (unsigned char)(v <= 0.0f ? 0 : (v >= 1.0f ? 255 : int(v * 255.0f + 0.5f)));
+}
+
 void
-Surface::colorize(const Color & input_color, Surface & target) {
-  Color color = input_color;
-  color.red *= color.alpha;
-  color.green *= color.alpha;
-  color.blue *= color.alpha;
-  
+Surface::colorize(const Color & color, Surface & target) {
   assert(getFormat() == R8 && target.getFormat() == RGBA8);
   assert(getActualWidth() == target.getActualWidth() && getActualHeight() == target.getActualHeight());
   unsigned char * buffer = (unsigned char *)lockMemory(false);
   unsigned char * target_buffer = (unsigned char *)target.lockMemory(true);
 
-  for (unsigned int i = 0; i < actual_width * actual_height; i++) {
-    float input_alpha = buffer[i] / 255.0f;
-    target_buffer[4 * i + 0] = (unsigned char)(color.red * input_alpha * 255);
-    target_buffer[4 * i + 1] = (unsigned char)(color.green * input_alpha * 255);
-    target_buffer[4 * i + 2] = (unsigned char)(color.blue * input_alpha * 255);
-    target_buffer[4 * i + 3] = (unsigned char)(color.alpha * input_alpha * 255);
-  }
+  const unsigned char premultiplied_color[4] = {
+    toByte(color.red * color.alpha),
+    toByte(color.green * color.alpha),
+    toByte(color.blue * color.alpha),
+    toByte(color.alpha)
+  };
+  size_t w = actual_width, stride = getStride(), target_stride = target.getStride();
+  parallelFor(0, actual_height, getRowGrain(w * 4), [&](size_t y0, size_t y1) {
+      for (size_t y = y0; y < y1; y++) {
+	PixelKernels::colorize(buffer + y * stride, target_buffer + y * target_stride, w, premultiplied_color);
+      }
+    });
   
   releaseMemory();
   target.releaseMemory();
 }
 
-#if 0
 void
 Surface::multiply(const Color & color) {
   assert(getFormat() == RGBA8);
   unsigned char * buffer = (unsigned char *)lockMemory(true);
   assert(buffer);
-  unsigned int red = toByte(color.red);
-  unsigned int green = toByte(color.green);
-  unsigned int blue = toByte(color.blue);
-  unsigned int alpha = toByte(color.alpha);
-  for (unsigned int i = 0; i < actual_width * actual_height; i++) {
-    unsigned char * ptr = buffer + (i * 4);
-    ptr[0] = (unsigned char)(ptr[0] * red / 255);
-    ptr[1] = (unsigned char)(ptr[1] * green / 255);
-    ptr[2] = (unsigned char)(ptr[2] * blue / 255);
-    ptr[3] = (unsigned char)(ptr[3] * alpha / 255);
-  }
+  const unsigned char c[4] = { toByte(color.red), toByte(color.green), toByte(color.blue), toByte(color.alpha) };
+  size_t w = actual_width;
+  parallelFor(0, actual_height, getRowGrain(w * 4), [&](size_t y0, size_t y1) {
+      PixelKernels::multiply(buffer + y0 * w * 4, (y1 - y0) * w, c);
+    });
   releaseMemory();
 }
-#endif
 	       
+void
+Surface::renderPath(RenderMode mode, const Path2D & path, const Matrix & transform, const Style & style, float lineWidth, Operator op, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath) {
+  if (transform.isIdentity()) {
+    renderPath(mode, path, style, lineWidth, op, displayScale, globalAlpha, shadowBlur, shadowOffsetX, shadowOffsetY, shadowColor, clipPath);
+  } else {
+    Path2D tmp_path = path;
+    tmp_path.transform(transform);
+    renderPath(mode, tmp_path, style, lineWidth, op, displayScale, globalAlpha, shadowBlur, shadowOffsetX, shadowOffsetY, shadowColor, clipPath);
+  }
+}
+
+void
+Surface::drawMask(Surface & mask, const Point & p, double w, double h, const Color & color, float displayScale, float globalAlpha, const Path2D & clipPath) {
+  assert(mask.getFormat() == R8);
+  unsigned int width = mask.getActualWidth(), height = mask.getActualHeight();
+  const unsigned char premultiplied_color[4] = {
+    toByte(color.red * color.alpha * globalAlpha),
+    toByte(color.green * color.alpha * globalAlpha),
+    toByte(color.blue * color.alpha * globalAlpha),
+    toByte(color.alpha * globalAlpha)
+  };
+  std::unique_ptr<unsigned char[]> colorized(new unsigned char[4 * width * height]);
+  unsigned char * buffer = (unsigned char *)mask.lockMemory(false);
+  unsigned char * output = colorized.get();
+  size_t stride = mask.getStride();
+  parallelFor(0, height, getRowGrain(width * 4), [&](size_t y0, size_t y1) {
+      for (size_t y = y0; y < y1; y++) {
+	PixelKernels::colorize(buffer + y * stride, output + y * width * 4, width, premultiplied_color);
+      }
+    });
+  mask.releaseMemory();
+  Image image(colorized.get(), RGBA8, width, height);
+  drawImage(image, p, w, h, displayScale, 1.0f, 0.0f, 0.0f, 0.0f, color, clipPath, false);
+}
+
+void
+Surface::drawMarkers(const Path2D & shape, const Style & style, const Point * points, size_t n, const Color * colors, float displayScale, float globalAlpha, const Path2D & clipPath) {
+  Style instance_style(0, style);
+  for (size_t i = 0; i < n; i++) {
+    if (colors) instance_style = colors[i];
+    renderPath(FILL, shape, Matrix(1.0, 0.0, 0.0, 1.0, points[i].x, points[i].y), instance_style, 1.0f, SOURCE_OVER, displayScale, globalAlpha, 0.0f, 0.0f, 0.0f, Color(), clipPath);
+  }
+}
+
+void
+Surface::fillRect(double x, double y, double w, double h, const Color & color, Operator op, float displayScale, float globalAlpha, const Path2D & clipPath) {
+  Path2D path;
+  path.moveTo(Point(x, y));
+  path.lineTo(Point(x + w, y));
+  path.lineTo(Point(x + w, y + h));
+  path.lineTo(Point(x, y + h));
+  path.closePath();
+  Style style(0);
+  style = color;
+  renderPath(FILL, path, style, 1.0f, op, displayScale, globalAlpha, 0.0f, 0.0f, 0.0f, color, clipPath);
+}
+
 std::shared_ptr<Image>
 Surface::createImage() {
 
@@ -315,6 +236,11 @@ Surface::createImage() {
   return image;
 }
 
+unsigned int
+Surface::getStride() const {
+  return getActualWidth() * Image::getImageFormat(getFormat()).getBytesPerPixel();
+}
+
 void *
 Surface::lockMemoryPartial(unsigned int x0, unsigned int y0, unsigned int required_width, unsigned int required_height) {
   unsigned int * buffer = (unsigned int *)lockMemory();
@@ -323,12 +249,12 @@ Surface::lockMemoryPartial(unsigned int x0, unsigned int y0, unsigned int requir
   delete[] scaled_buffer;
   scaled_buffer = new unsigned int[required_width * required_height];
 
-  unsigned int offset = 0;
-  for (unsigned int y = y0; y < y0 + required_height; y++) {
-    for (unsigned int x = x0; x < x0 + required_width; x++) {
-      scaled_buffer[offset++] = buffer[y * actual_width + x];
-    }
-  }
+  unsigned int * output = scaled_buffer;
+  parallelFor(0, required_height, getRowGrain(required_width * 4), [&](size_t row0, size_t row1) {
+      for (size_t row = row0; row < row1; row++) {
+	memcpy(output + row * required_width, buffer + (y0 + row) * actual_width + x0, required_width * 4);
+      }
+    });
 
   return scaled_buffer;
 }
@@ -0,0 +1,202 @@
+#include <ThreadPool.h>
+
+#include <algorithm>
+
+using namespace std;
+using namespace canvas;
+
+// Bands of this size fit in the L2 cache together with their source rows
+static const size_t BAND_BYTES = 64 * 1024;
+
+static thread_local ThreadPool * current_pool = 0;
+static thread_local unsigned int current_worker = 0;
+
+static std::mutex executor_mutex;
+static std::shared_ptr<Executor> executor;
+static bool executor_initialized = false;
+
+ThreadPool::ThreadPool(unsigned int num_threads) : next_queue(0) {
+  if (!num_threads) {
+    unsigned int n = std::thread::hardware_concurrency();
+    num_threads = n > 1 ? n - 1 : 0;
+  }
+  for (unsigned int i = 0; i < num_threads; i++) {
+    workers.push_back(std::unique_ptr<Worker>(new Worker));
+  }
+  for (unsigned int i = 0; i < num_threads; i++) {
+    workers[i]->thread = std::thread(&ThreadPool::workerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  cond.notify_all();
+  for (auto & w : workers) {
+    w->thread.join();
+  }
+}
+
+void
+ThreadPool::run(std::function<void()> task) {
+  if (workers.empty()) {
+    task();
+    return;
+  }
+  unsigned int index = current_pool == this ? current_worker : next_queue++ % workers.size();
+  {
+    // the task is counted before a worker can take it
+    std::lock_guard<std::mutex> lock(mutex);
+    std::lock_guard<std::mutex> queue_lock(workers[index]->mutex);
+    workers[index]->tasks.push_back(std::move(task));
+    pending++;
+  }
+  cond.notify_one();
+}
+
+bool
+ThreadPool::takeTask(unsigned int index, std::function<void()> & task) {
+  {
+    Worker & own = *workers[index];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+  for (unsigned int i = 1; i < workers.size(); i++) {
+    Worker & victim = *workers[(index + i) % workers.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void
+ThreadPool::workerLoop(unsigned int index) {
+  current_pool = this;
+  current_worker = index;
+  while (1) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cond.wait(lock, [this]() { return stopping || pending > 0; });
+      if (!pending) return; // stopping with no work left
+    }
+    std::function<void()> task;
+    if (takeTask(index, task)) {
+      {
+	std::lock_guard<std::mutex> lock(mutex);
+	pending--;
+      }
+      task();
+    }
+  }
+}
+
+// A pool sized for the hardware, or none on a single core
+static std::shared_ptr<Executor> createDefaultExecutor() {
+  if (std::thread::hardware_concurrency() > 1) {
+    return std::make_shared<ThreadPool>();
+  } else {
+    return std::shared_ptr<Executor>();
+  }
+}
+
+std::shared_ptr<Executor>
+ThreadPool::getExecutor() {
+  std::lock_guard<std::mutex> lock(executor_mutex);
+  if (!executor_initialized) {
+    executor_initialized = true;
+    executor = createDefaultExecutor();
+  }
+  return executor;
+}
+
+void
+ThreadPool::setExecutor(const std::shared_ptr<Executor> & _executor) {
+  std::shared_ptr<Executor> old;
+  {
+    std::lock_guard<std::mutex> lock(executor_mutex);
+    old = executor;
+    executor = _executor;
+    executor_initialized = true;
+  }
+  // the old pool is joined outside the lock, after any running parallelFor has released it
+}
+
+void
+ThreadPool::setNumThreads(unsigned int num_threads) {
+  setExecutor(num_threads ? std::make_shared<ThreadPool>(num_threads) : createDefaultExecutor());
+}
+
+namespace {
+  // The bands are claimed from a shared counter, so helper tasks that start
+  // late find nothing left to do and the caller never waits for a queued task
+  struct ParallelForState {
+    std::atomic<size_t> next, done;
+    size_t begin, end, band_size, num_bands;
+    const std::function<void(size_t, size_t)> * func;
+    std::mutex mutex;
+    std::condition_variable cond;
+
+    ParallelForState() : next(0), done(0) { }
+
+    void work() {
+      size_t i;
+      while ((i = next++) < num_bands) {
+	size_t b0 = begin + i * band_size, b1 = std::min(end, b0 + band_size);
+	(*func)(b0, b1);
+	if (++done == num_bands) {
+	  std::lock_guard<std::mutex> lock(mutex);
+	  cond.notify_all();
+	}
+      }
+    }
+
+    void wait() {
+      std::unique_lock<std::mutex> lock(mutex);
+      cond.wait(lock, [this]() { return done == num_bands; });
+    }
+  };
+};
+
+void
+canvas::parallelFor(size_t begin, size_t end, size_t grain, const std::function<void(size_t begin, size_t end)> & func) {
+  if (end <= begin) return;
+  size_t n = end - begin;
+  grain = std::max(grain, size_t(1));
+  std::shared_ptr<Executor> executor = n > grain ? ThreadPool::getExecutor() : std::shared_ptr<Executor>();
+  unsigned int threads = executor ? executor->getConcurrency() : 0;
+  if (!threads) {
+    func(begin, end);
+    return;
+  }
+
+  // a few bands per thread, so that uneven bands are balanced
+  size_t num_bands = std::min((n + grain - 1) / grain, size_t(threads + 1) * 4);
+  auto state = std::make_shared<ParallelForState>();
+  state->begin = begin;
+  state->end = end;
+  state->band_size = (n + num_bands - 1) / num_bands;
+  state->num_bands = (n + state->band_size - 1) / state->band_size;
+  state->func = &func;
+
+  size_t helpers = std::min(state->num_bands - 1, size_t(threads));
+  for (size_t i = 0; i < helpers; i++) {
+    executor->run([state]() { state->work(); });
+  }
+  state->work();
+  state->wait();
+}
+
+size_t
+canvas::getRowGrain(size_t row_bytes) {
+  return std::max(BAND_BYTES / std::max(row_bytes, size_t(1)), size_t(1));
+}
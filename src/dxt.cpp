@@ -611,13 +611,14 @@ static void stb__InitDXT() {
   stb__PrepareOptTable(&stb__OMatch6[0][0],stb__Expand6,64);
 }
 
-static int init=1;
+// the tables are built once even if the first blocks are compressed in parallel
+static void stb__EnsureInit() {
+  static const bool initialized = (stb__InitDXT(), true);
+  (void)initialized;
+}
 
 void stb_compress_dxt1_block(unsigned char *dest, const unsigned char *src, bool alpha, int mode) {
-  if (init) {
-    stb__InitDXT();
-    init=0;
-  }
+  stb__EnsureInit();
   
   if (alpha) {
     stb__CompressAlphaBlock(dest,(unsigned char*) src,mode);
@@ -627,19 +628,17 @@ void stb_compress_dxt1_block(unsigned char *dest, const unsigned char *src, bool
   stb__CompressColorBlock(dest,(unsigned char*) src,mode);
 }
 
+void stb_compress_dxt5_block(unsigned char *dest, const unsigned char *src, int mode) {
+  stb_compress_dxt1_block(dest, src, true, mode);
+}
+
 void stb_compress_rgtc1_block(unsigned char *dest, const unsigned char *src) {
-  if (init) {
-    stb__InitDXT();
-    init = 0;
-  } 
+  stb__EnsureInit();
   stb__CompressRGTCBlock(dest, (unsigned char*) src);
 }
 
 void stb_compress_rgtc2_block(unsigned char *dest, const unsigned char *src) {
-  if (init) {
-    stb__InitDXT();
-    init=0;
-  }
+  stb__EnsureInit();
 
   stb__CompressRGTCBlock(dest, (unsigned char*) src);
   dest += 8;
@@ -4,6 +4,7 @@
 //
 // USAGE:
 //   call stb_compress_dxt_block() for every block (you must pad)
+//     the functions are thread-safe, the tables are initialized on the first call
 //     source should be a 4x4 block of RGBA data in row-major order;
 //     A is ignored if you specify alpha=0; you can turn on dithering
 //     and "high quality" using mode.
@@ -32,6 +33,8 @@
 #define STB_DXT_HIGHQUAL  2   // high quality mode, does two refinement steps instead of 1. ~30-40% slower.
 
 void stb_compress_dxt1_block(unsigned char *dest, const unsigned char *src, bool alpha, int mode);
+// 16 bytes: the alpha block followed by the DXT1 color block
+void stb_compress_dxt5_block(unsigned char *dest, const unsigned char *src, int mode);
 void stb_compress_rgtc1_block(unsigned char *dest, const unsigned char *src);
 void stb_compress_rgtc2_block(unsigned char *dest, const unsigned char *src);
 
@@ -0,0 +1,136 @@
+// Renders the same clipped scene twice: once with the clip kept active in
+// the Cairo context between draws, and once with the clip rebuilt for every
+// draw call like before the clip was cached. The pixels must match.
+// The clip with half-integer edges covers whole pixels and is applied as a
+// scissor rectangle that fillRect and drawMarkers clamp to, while the
+// rebuilt clips always go through cairo_clip with the clip path.
+
+#include <ContextCairo.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+using namespace canvas;
+
+static const unsigned int WIDTH = 200, HEIGHT = 150;
+static const int NUM_DRAWS = 60;
+
+// A trailing moveTo does not change the clip region, but it makes the clip
+// path differ from the previous one, so the surface cannot reuse its clip.
+// It also stops the path from being recognized as a rectangle.
+static void
+setClip(Context & context, int kind, int variant) {
+  context.beginPath();
+  switch (kind) {
+  case 0: context.rect(20, 20, 160, 100); break;
+  case 1: context.rect(20.5, 20.25, 150.5, 99.5); break;
+  case 2: context.rect(19.5, 19.5, 159, 90); break;
+  default: context.arc(100, 75, 60, 0, 2 * M_PI); break;
+  }
+  if (variant) context.moveTo(variant, 0);
+  context.clip();
+}
+
+static void
+draw(Context & context, const Image & image, int i) {
+  unsigned int seed = i * 2654435761u;
+  auto next = [&]() { seed = seed * 1103515245u + 12345u; return (seed >> 16) & 0x7fff; };
+  double x = next() % WIDTH, y = next() % HEIGHT;
+  Color color(next() % 256 / 255.0f, next() % 256 / 255.0f, next() % 256 / 255.0f, 1.0f);
+  switch (i % 7) {
+  case 0:
+    context.fillStyle = color;
+    context.fillRect(x - 20, y - 15, 40, 30);
+    break;
+  case 1:
+    context.fillStyle = Color(color.red, color.green, color.blue, 0.6f);
+    context.fillRect(x - 20.3, y - 15.6, 40.5, 30.2);
+    break;
+  case 2:
+    context.fillStyle = color;
+    context.beginPath();
+    context.arc(x, y, 5 + next() % 30, 0, 2 * M_PI);
+    context.fill();
+    break;
+  case 3:
+    context.strokeStyle = color;
+    context.lineWidth = 3;
+    context.beginPath();
+    context.moveTo(x, y);
+    context.lineTo(next() % WIDTH, next() % HEIGHT);
+    context.lineTo(next() % WIDTH, next() % HEIGHT);
+    context.stroke();
+    break;
+  case 4:
+    context.drawImage(image, x - 16, y - 16, 32 + next() % 32, 32);
+    break;
+  case 5:
+    // pixel-aligned, so written directly into the surface
+    context.fillStyle = color;
+    context.fillRect(x - 20.5, y - 15.5, 40, 30);
+    break;
+  case 6:
+    {
+      Path2D shape;
+      shape.arc(Point(0, 0), 4, 0, 2 * M_PI, false);
+      Point points[8];
+      for (auto & p : points) p = Point(next() % WIDTH + 0.3, next() % HEIGHT + 0.7);
+      Style style(&context);
+      style = color;
+      context.drawMarkers(shape, style, points, 8);
+    }
+    break;
+  }
+}
+
+static shared_ptr<Image>
+render(float display_scale, bool rebuild_clip) {
+  unsigned char checker[16 * 16 * 4];
+  for (unsigned int i = 0; i < 16 * 16; i++) {
+    unsigned char v = ((i / 16 / 4 + i % 16 / 4) % 2) ? 255 : 0;
+    checker[4 * i + 0] = v;
+    checker[4 * i + 1] = 128;
+    checker[4 * i + 2] = 255 - v;
+    checker[4 * i + 3] = 255;
+  }
+  Image image(checker, RGBA8, 16, 16);
+
+  ContextCairo context(WIDTH, HEIGHT, RGBA8, display_scale);
+  context.fillStyle = Color(1.0f, 1.0f, 1.0f, 1.0f);
+  context.fillRect(0, 0, WIDTH, HEIGHT);
+  int n = 0;
+  for (int kind = 0; kind < 4; kind++) {
+    context.save();
+    if (!rebuild_clip) setClip(context, kind, 0);
+    for (int i = 0; i < NUM_DRAWS; i++, n++) {
+      if (rebuild_clip) setClip(context, kind, 1 + i % 2);
+      draw(context, image, n);
+    }
+    context.restore();
+  }
+  return context.getDefaultSurface().createImage();
+}
+
+int
+main() {
+  int failures = 0;
+  const float scales[] = { 1.0f, 1.5f, 2.0f };
+  for (float scale : scales) {
+    auto cached = render(scale, false), reference = render(scale, true);
+    size_t size = cached->getWidth() * cached->getHeight() * 4;
+    const unsigned char * a = cached->getData(), * b = reference->getData();
+    size_t mismatches = 0;
+    int max_diff = 0;
+    for (size_t i = 0; i < size; i++) {
+      int d = abs(int(a[i]) - int(b[i]));
+      if (d > max_diff) max_diff = d;
+      // allow for rounding differences between the fast paths and Cairo
+      if (d > 1) mismatches++;
+    }
+    printf("display scale %.1f: %zu mismatching bytes, max difference %d\n", scale, mismatches, max_diff);
+    if (mismatches) failures++;
+  }
+  return failures ? 1 : 0;
+}
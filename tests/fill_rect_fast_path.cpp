@@ -0,0 +1,120 @@
+// Checks that the direct write of pixel-aligned rectangles in
+// CairoSurface::fillRect gives the same pixels as cairo_fill with the same
+// operator and clip. The rectangles are clamped to the surface and the clip,
+// and the colors are multiples of 1/255 so both must match exactly.
+
+#include <ContextCairo.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+using namespace canvas;
+
+static const unsigned int WIDTH = 160, HEIGHT = 120;
+
+struct Case {
+  const char * name;
+  double x, y, w, h;
+  Operator op;
+  Color color;
+  bool clip;
+};
+
+// the clip covers pixels 30 to 129 horizontally and 20 to 99 vertically
+static const double CLIP_X0 = 29.5, CLIP_Y0 = 19.5, CLIP_X1 = 129.5, CLIP_Y1 = 99.5;
+
+static void
+fillBackground(unsigned char * data, unsigned int stride, cairo_format_t format) {
+  srand(1);
+  for (unsigned int y = 0; y < HEIGHT; y++) {
+    unsigned char * row = data + y * stride;
+    for (unsigned int x = 0; x < WIDTH; x++) {
+      if (format == CAIRO_FORMAT_A8) {
+	row[x] = (unsigned char)(rand() % 256);
+      } else {
+	// premultiplied, so the color channels cannot exceed the alpha
+	unsigned int a = rand() % 256;
+	row[4 * x + 0] = (unsigned char)(rand() % (a + 1));
+	row[4 * x + 1] = (unsigned char)(rand() % (a + 1));
+	row[4 * x + 2] = (unsigned char)(rand() % (a + 1));
+	row[4 * x + 3] = (unsigned char)a;
+      }
+    }
+  }
+}
+
+static int
+runCase(const Case & c, InternalFormat internal_format, cairo_format_t format) {
+  Path2D clip_path;
+  if (c.clip) {
+    clip_path.moveTo(Point(CLIP_X0, CLIP_Y0));
+    clip_path.lineTo(Point(CLIP_X1, CLIP_Y0));
+    clip_path.lineTo(Point(CLIP_X1, CLIP_Y1));
+    clip_path.lineTo(Point(CLIP_X0, CLIP_Y1));
+    clip_path.closePath();
+  }
+
+  CairoSurface surface(WIDTH, HEIGHT, WIDTH, HEIGHT, internal_format);
+  fillBackground((unsigned char *)surface.lockMemory(true), surface.getStride(), format);
+  surface.releaseMemory();
+  surface.fillRect(c.x, c.y, c.w, c.h, c.color, c.op, 1.0f, 1.0f, clip_path);
+  const unsigned char * actual = (const unsigned char *)surface.lockMemory();
+
+  // the same fill with plain Cairo, with the half pixel offset of the surface
+  cairo_surface_t * reference = cairo_image_surface_create(format, WIDTH, HEIGHT);
+  cairo_surface_flush(reference);
+  fillBackground(cairo_image_surface_get_data(reference), cairo_image_surface_get_stride(reference), format);
+  cairo_surface_mark_dirty(reference);
+  cairo_t * cr = cairo_create(reference);
+  if (c.clip) {
+    cairo_rectangle(cr, CLIP_X0 + 0.5, CLIP_Y0 + 0.5, CLIP_X1 - CLIP_X0, CLIP_Y1 - CLIP_Y0);
+    cairo_clip(cr);
+  }
+  cairo_set_operator(cr, c.op == COPY ? CAIRO_OPERATOR_SOURCE : CAIRO_OPERATOR_OVER);
+  cairo_set_source_rgba(cr, c.color.red, c.color.green, c.color.blue, c.color.alpha);
+  cairo_rectangle(cr, c.x + 0.5, c.y + 0.5, c.w, c.h);
+  cairo_fill(cr);
+  cairo_destroy(cr);
+  cairo_surface_flush(reference);
+  const unsigned char * expected = cairo_image_surface_get_data(reference);
+
+  unsigned int row_bytes = format == CAIRO_FORMAT_A8 ? WIDTH : WIDTH * 4;
+  int mismatches = 0;
+  for (unsigned int y = 0; y < HEIGHT; y++) {
+    if (memcmp(actual + y * surface.getStride(), expected + y * cairo_image_surface_get_stride(reference), row_bytes) != 0) {
+      mismatches++;
+    }
+  }
+  surface.releaseMemory();
+  cairo_surface_destroy(reference);
+
+  printf("%s %s: %d mismatching rows\n", format == CAIRO_FORMAT_A8 ? "A8" : "ARGB32", c.name, mismatches);
+  return mismatches ? 1 : 0;
+}
+
+int
+main() {
+  const Color opaque(51 / 255.0f, 102 / 255.0f, 204 / 255.0f, 1.0f);
+  const Color translucent(1.0f, 0.0f, 0.0f, 51 / 255.0f);
+  const Case cases[] = {
+    { "copy", 9.5, 14.5, 50, 40, COPY, opaque, false },
+    { "copy translucent", 9.5, 14.5, 50, 40, COPY, translucent, false },
+    { "clear", 9.5, 14.5, 50, 40, COPY, Color(0.0f, 0.0f, 0.0f, 0.0f), false },
+    { "source over", 9.5, 14.5, 50, 40, SOURCE_OVER, opaque, false },
+    { "copy with rect clip", 19.5, 9.5, 100, 60, COPY, translucent, true },
+    { "source over with rect clip", 99.5, 79.5, 50, 30, SOURCE_OVER, opaque, true },
+    { "outside the clip", 0.5, 0.5, 20, 10, SOURCE_OVER, opaque, true },
+    { "clamped top left", -20.5, -10.5, 40, 30, SOURCE_OVER, opaque, false },
+    { "clamped bottom right", WIDTH - 20.5, HEIGHT - 10.5, 50, 50, COPY, opaque, false },
+    { "whole surface", -0.5, -0.5, WIDTH, HEIGHT, COPY, translucent, false },
+    { "outside the surface", WIDTH + 9.5, 9.5, 20, 20, COPY, opaque, false }
+  };
+  int failures = 0;
+  for (auto & c : cases) {
+    failures += runCase(c, RGBA8, CAIRO_FORMAT_ARGB32);
+    failures += runCase(c, R8, CAIRO_FORMAT_A8);
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,84 @@
+// Composites two layers, whose content is drawn at an offset with
+// DESTINATION_OUT and DESTINATION_IN, with different opacities, and
+// compares the result with the same shapes drawn directly into the target.
+// The rectangles have half-integer edges so that they cover whole pixels.
+
+#include <LayeredContext.h>
+#include <ContextCairo.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+using namespace canvas;
+
+static const unsigned int WIDTH = 160, HEIGHT = 120;
+
+static void
+clear(Context & context) {
+  context.fillStyle = Color(1.0f, 1.0f, 1.0f, 1.0f);
+  context.fillRect(0, 0, WIDTH, HEIGHT);
+}
+
+int
+main() {
+  CairoContextFactory factory;
+  LayeredContext layers(factory, WIDTH, HEIGHT);
+
+  // created first but drawn on top
+  int front = layers.createLayer(1.0f);
+  layers.updateLayer(front, [](Context & context) {
+      context.translate(59.5, 39.5);
+      context.fillStyle = Color(1.0f, 0.0f, 0.0f, 1.0f);
+      context.fillRect(0, 0, 80, 50);
+      // keeps only the part of the rectangle under the second one
+      context.globalCompositeOperation = DESTINATION_IN;
+      context.fillRect(10, 0, 40, 30);
+    });
+  layers.setOpacity(front, 0.5f);
+
+  int back = layers.createLayer(0.0f);
+  layers.updateLayer(back, [](Context & context) {
+      context.translate(19.5, 9.5);
+      context.fillStyle = Color(0.0f, 0.6f, 0.2f, 1.0f);
+      context.fillRect(0, 0, 100, 60);
+      // punches a hole through which the target shows
+      context.globalCompositeOperation = DESTINATION_OUT;
+      context.fillRect(30, 20, 40, 20);
+    });
+
+  ContextCairo composited(WIDTH, HEIGHT, RGBA8);
+  clear(composited);
+  layers.composite(composited);
+
+  // the same content drawn directly: the back layer as a frame of four rectangles
+  // around the hole, and the front layer as the intersection of its rectangles
+  ContextCairo direct(WIDTH, HEIGHT, RGBA8);
+  clear(direct);
+  direct.fillStyle = Color(0.0f, 0.6f, 0.2f, 1.0f);
+  direct.fillRect(19.5, 9.5, 100, 20);
+  direct.fillRect(19.5, 49.5, 100, 20);
+  direct.fillRect(19.5, 29.5, 30, 20);
+  direct.fillRect(89.5, 29.5, 30, 20);
+  direct.globalAlpha = 0.5f;
+  direct.fillStyle = Color(1.0f, 0.0f, 0.0f, 1.0f);
+  direct.fillRect(69.5, 39.5, 40, 30);
+
+  auto a = composited.getDefaultSurface().createImage(), b = direct.getDefaultSurface().createImage();
+  const unsigned char * pa = a->getData(), * pb = b->getData();
+  size_t size = WIDTH * HEIGHT * 4, mismatches = 0;
+  int max_diff = 0;
+  for (size_t i = 0; i < size; i++) {
+    int d = abs(int(pa[i]) - int(pb[i]));
+    if (d > max_diff) max_diff = d;
+    // allow for rounding differences between painting with an alpha and filling with one
+    if (d > 1) mismatches++;
+  }
+  printf("%zu mismatching bytes, max difference %d\n", mismatches, max_diff);
+
+  // the front layer over the hole blends with the white target
+  const unsigned char * p = pa + (45 * WIDTH + 75) * 4;
+  bool blended = p[3] == 255 && abs(int(p[0]) + int(p[1]) + int(p[2]) - (255 + 128 + 128)) <= 3;
+  printf("pixel over the hole: %d %d %d %d\n", p[0], p[1], p[2], p[3]);
+  return mismatches || !blended ? 1 : 0;
+}
@@ -0,0 +1,66 @@
+// Checks that the vectorized row evaluation of PerlinSurface matches the
+// scalar evaluation of each sample for classic, periodic and simplex noise.
+// The tolerance also allows for the fixed point variant built with
+// USE_FIXEDPOINT.
+
+#include <PerlinSurface.h>
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using namespace std;
+using namespace canvas;
+
+static const float TOLERANCE = 1e-3f;
+
+// PerlinSurface with the drawing functions left empty and the evaluators exposed
+class NoiseSurface : public PerlinSurface {
+public:
+  NoiseSurface(int octaves) : PerlinSurface(64, 64, 64, 64, octaves) { }
+
+  void renderPath(RenderMode mode, const Path2D & path, const Style & style, float lineWidth, Operator op, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath) override { }
+  void renderText(RenderMode mode, const Font & font, const Style & style, TextBaseline textBaseline, TextAlign textAlign, const std::string & text, const Point & p, float lineWidth, Operator op, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath) override { }
+  TextMetrics measureText(const Font & font, const std::string & text, TextBaseline textBaseline, float displayScale) override { return TextMetrics(); }
+  void drawImage(Surface & _img, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled, ImageSmoothingQuality imageSmoothingQuality) override { }
+  void drawImage(const Image & _img, const Point & p, double w, double h, float displayScale, float globalAlpha, float shadowBlur, float shadowOffsetX, float shadowOffsetY, const Color & shadowColor, const Path2D & clipPath, bool imageSmoothingEnabled, ImageSmoothingQuality imageSmoothingQuality) override { }
+
+  using PerlinSurface::evaluate;
+  using PerlinSurface::evaluateRow;
+};
+
+int
+main() {
+  const struct {
+    const char * name;
+    NoiseType type;
+    unsigned int period_x, period_y;
+  } generators[] = {
+    { "perlin", NOISE_PERLIN, 0, 0 },
+    { "periodic perlin", NOISE_PERLIN, 8, 5 },
+    { "perlin periodic in x", NOISE_PERLIN, 3, 0 },
+    { "simplex 2D", NOISE_SIMPLEX_2D, 0, 0 },
+    { "simplex 3D", NOISE_SIMPLEX_3D, 0, 0 }
+  };
+  int failures = 0;
+  for (auto & g : generators) for (int octaves = 1; octaves <= 6; octaves++) {
+    NoiseSurface surface(octaves);
+    surface.setNoiseType(g.type);
+    surface.setPeriod(g.period_x, g.period_y);
+    float max_error = 0;
+    // rows that cross lattice cells with negative and large coordinates
+    for (int row = 0; row < 50; row++) {
+      float x = -40.0f + row * 3.7f, y = -20.0f + row * 1.3f, z = row * 0.21f, dx = 1.0f / 32 + row * 0.003f;
+      const size_t n = 1003;
+      vector<float> output(n);
+      surface.evaluateRow(x, y, z, dx, n, output.data());
+      for (size_t i = 0; i < n; i++) {
+	float error = fabsf(output[i] - surface.evaluate(x + float(i) * dx, y, z));
+	if (error > max_error) max_error = error;
+      }
+    }
+    printf("%s, %d octaves: max error %g\n", g.name, octaves, max_error);
+    if (!(max_error <= TOLERANCE)) failures++;
+  }
+  return failures ? 1 : 0;
+}